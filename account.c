@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "account.h"
+#include "esniper.h"
+#include "util.h"
+#include <string.h>
+
+static account_t *accounts = NULL;	/* the first account first */
+static account_t *current = NULL;
+
+static account_t *newAccount(void);
+
+static account_t *
+newAccount(void)
+{
+	account_t *ap = (account_t *)myMalloc(sizeof(account_t));
+
+	ap->username = NULL;
+	ap->usernameEscape = NULL;
+	ap->password = NULL;
+	ap->passwordPad = NULL;
+	ap->passwordLen = 0;
+	ap->http = NULL;
+	ap->loginTime = 0;
+	ap->sessionChecked = 0;
+	ap->sessionRetry = 0;
+	ap->sessionAip = newAuctionInfo("login", "0");
+	ap->sessionLimit.since = 0;
+	ap->sessionLimit.rc = REQUEST_BIDKEY;
+	ap->next = NULL;
+	return ap;
+}
+
+account_t *
+firstAccount(void)
+{
+	if (!accounts)
+		current = accounts = newAccount();
+	return accounts;
+}
+
+account_t *
+currentAccount(void)
+{
+	(void)firstAccount();
+	return current;
+}
+
+account_t *
+getAccount(const char *username, const char *password)
+{
+	account_t *ap, *last = NULL, *old;
+
+	if (!username)
+		return firstAccount();
+	for (ap = firstAccount(); ap; ap = ap->next) {
+		const char *name = ap == current ? options.username : ap->username;
+
+		if (name && !strcasecmp(name, username))
+			return ap;
+		last = ap;
+	}
+	if (!password)
+		return NULL;
+	ap = newAccount();
+	ap->http = newHttpState();
+	last->next = ap;
+	old = current;
+	useAccount(ap);
+	setUsername(myStrdup(username));
+	setPassword(myStrdup(password));
+	useAccount(old);
+	return ap;
+}
+
+void
+useAccount(account_t *ap)
+{
+	if (!ap)
+		ap = firstAccount();
+	if (ap == currentAccount())
+		return;
+	current->username = options.username;
+	current->usernameEscape = options.usernameEscape;
+	options.username = ap->username;
+	options.usernameEscape = ap->usernameEscape;
+	ap->username = ap->usernameEscape = NULL;
+	swapPassword(&ap->password, &ap->passwordPad, &ap->passwordLen);
+	current->password = ap->password;
+	current->passwordPad = ap->passwordPad;
+	current->passwordLen = ap->passwordLen;
+	ap->password = ap->passwordPad = NULL;
+	ap->passwordLen = 0;
+	useHttpState(ap->http);
+	current = ap;
+}
+
+account_t *
+sessionAccount(const auctionInfo *aip)
+{
+	account_t *ap;
+
+	for (ap = firstAccount(); ap; ap = ap->next) {
+		if (ap->sessionAip == aip)
+			return ap;
+	}
+	return NULL;
+}
+
+void
+cleanupAccounts(void)
+{
+	account_t *ap;
+
+	useAccount(NULL);
+	for (ap = firstAccount(); ap; ap = ap->next) {
+		freeHttpState(ap->http);
+		ap->http = NULL;
+	}
+}
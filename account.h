@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ACCOUNT_H_INCLUDED
+#define ACCOUNT_H_INCLUDED
+
+#include <stddef.h>
+#include <time.h>
+#include "auctioninfo.h"
+#include "http.h"
+
+/*
+ * eBay accounts.  Each auction group (see auction.h) bids for the
+ * account that was current when it was created.  An account has its own
+ * login session, cookies and connections (see useHttpState() in http.h)
+ * and request limits (see ratelimit.h).  The event queue and host
+ * statistics are shared by all accounts.
+ *
+ * The first account is the one of the command line and configuration
+ * files.  The current account's username and password are in options
+ * and util.c, where getPassword() and others find them; useAccount()
+ * swaps them with those kept in the account.
+ */
+typedef struct account {
+	char *username;		/* kept here while not current */
+	char *usernameEscape;
+	char *password;		/* crypted, see setPassword() */
+	char *passwordPad;
+	size_t passwordLen;
+	httpState_t *http;	/* NULL for the first account */
+	time_t loginTime;	/* time of last login, 0 if none */
+	int sessionChecked;	/* saved session looked for */
+	double sessionRetry;	/* no session renewal before (monotonic clock) */
+	auctionInfo *sessionAip;/* of session renewal events and errors */
+	requestWait_t sessionLimit;/* session renewal waiting for request limit */
+	struct account *next;
+} account_t;
+
+/*
+ * Account of username, created with password if there is none.  NULL
+ * username: the first account.  Returns NULL if the account is new and
+ * password is NULL.
+ */
+extern account_t *getAccount(const char *username, const char *password);
+
+/* make ap current, NULL: the first account */
+extern void useAccount(account_t *ap);
+
+extern account_t *currentAccount(void);
+
+/* first of all accounts, the others follow through next */
+extern account_t *firstAccount(void);
+
+/* account of a session renewal event's auction, NULL if none */
+extern account_t *sessionAccount(const auctionInfo *aip);
+
+/* free the curl state of all but the first account, which is made current */
+extern void cleanupAccounts(void);
+
+#endif /* ACCOUNT_H_INCLUDED */
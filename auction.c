@@ -27,16 +27,30 @@
 /* for strcasestr  prototype in string.h */
 #define _GNU_SOURCE
 
+#include "account.h"
 #include "auction.h"
+#include "auctionfile.h"
 #include "buffer.h"
+#include "filewatch.h"
 #include "http.h"
 #include "html.h"
 #include "history.h"
+#include "host.h"
+#include "journal.h"
+#include "mailbox.h"
+#include "polling.h"
+#include "ratelimit.h"
+#include "rehearsal.h"
+#include "scheduler.h"
+#include "schema.h"
+#include "timer.h"
 #include <ctype.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
 #if defined(WIN32)
@@ -47,55 +61,134 @@
 #	include <unistd.h>
 #endif
 
-#define newRemain(aip) (aip->endTime - time(NULL) - aip->latency - options.bidtime)
+/* endTime is on the history host's clock, see host.h */
+#define newRemain(aip) ((long)(aip->endTime - historyTime() - aip->latency - options.bidtime))
+
+/* latency samples needed before a host's figures are used */
+#define MIN_LATENCY_SAMPLES 5
 
-static time_t loginTime = 0;	/* Time of last login */
 static time_t defaultLoginInterval = 12 * 60 * 60;	/* ebay login interval */
 
+/* check login this long before bid time, seconds */
+#define LOGIN_WINDOW 300
+
+/* renew login session this long before it expires, seconds */
+#define SESSION_RENEW 3600
+
+/* don't renew login session this close to a bid, seconds */
+#define SESSION_GUARD 60
+
+/* don't start other requests this close to a bid, seconds */
+#define FIRE_GUARD 10
+
+/*
+ * Result of a bid: first check this long after the end, then back off
+ * exponentially from RESULT_BACKOFF to RESULT_MAX_BACKOFF seconds until
+ * the page shows the winner, at most RESULT_POLLS checks.
+ */
+#define RESULT_DELAY 0.5
+#define RESULT_BACKOFF 0.5
+#define RESULT_MAX_BACKOFF 16
+#define RESULT_POLLS 10
+
+/* bid history requests per poll or result check, see infoRequestDone() */
+#define INFO_TRIES 3
+
+/* bid key requests per auction, see prebidResult() */
+#define PREBID_TRIES 5
+
+/* run event requests this long before looking at files and commands, seconds */
+#define BATCH_SLICE 0.1
+
+/* a bid sent in parallel with others */
+typedef struct {
+	auctionInfo *aip;
+	char *url;
+	char *logUrl;
+	int ret;	/* bid result, -1 if no response */
+	int hedged;	/* may have been sent twice */
+} bidRequest_t;
+
+/* an event whose request is in flight, see runAuctionEvents() */
+typedef struct eventRequest {
+	event_t ev;		/* ev.aip is NULL once the auction is dropped */
+	time_t start;		/* estimated send time, eBay's clock */
+	int tries;		/* requests sent */
+	int retries;		/* first poll: pages without title */
+	/* prepared by a parser thread */
+	bidHistoryPage_t *page;	/* bid history */
+	char *biduiid;		/* bid key */
+	pageInfo_t *pageInfo;	/* bid page without bid key */
+	struct eventRequest *next;
+} eventRequest_t;
+static const auctionInfo *logAuction = NULL;	/* auction of debug log */
+static httpBatch_t *eventBatch = NULL;		/* polls, bid keys, results */
+static eventRequest_t *eventRequests = NULL;	/* in flight on eventBatch */
+
 static int acceptBid(const char *pagename, auctionInfo *aip);
-static int bid(auctionInfo *aip);
+static int bid(auctionInfo *aip, const char *url, const char *logUrl);
+static char *bidUrl(const auctionInfo *aip, const char *host, char **logUrl);
+static void bidSent(auctionInfo *aip, double sent, double written);
 static int ebayLogin(auctionInfo *aip, time_t interval);
 static int forceEbayLogin(auctionInfo *aip);
+static char *sessionPath(const char *suffix);
+static void restoreSession(void);
+static void saveSession(void);
+static double plannedFire(const event_t *ev);
+static double sessionDue(const account_t *ap);
+static void scheduleSession(void);
+static void sessionEvent(void);
 static char *getIdInternal(char *s, size_t len);
 static int getInfoTiming(auctionInfo *aip, time_t *timeToFirstByte);
+static const char *historyQuery(auctionInfo *aip);
+static void infoDone(memBuf_t *mp, void *data);
 static int getQuantity(int want, int available);
 static int makeBidError(const pageInfo_t *pageInfo, auctionInfo *aip);
-static int match(memBuf_t *mp, const char *str);
 static int parseBid(memBuf_t *mp, auctionInfo *aip);
-static int preBid(auctionInfo *aip);
+static char *prebidUrl(const auctionInfo *aip);
 static int parsePreBid(memBuf_t *mp, auctionInfo *aip);
-static int printMyItemsRow(char **row, int printNewline);
-static int watch(auctionInfo *aip);
-
-/*
- * attempt to match some input, neglecting case, ignoring \r and \n.
- * returns 0 on success, -1 on failure
- */
-static int
-match(memBuf_t *mp, const char *str)
-{
-	const char *cursor;
-	int c;
-
-	log(("\n\nmatch(\"%s\")\n\n", str));
-
-	cursor = str;
-	while ((c = memGetc(mp)) != EOF) {
-		if (options.debug)
-			logChar(c);
-		if (tolower(c) == (int)*cursor) {
-			if (*++cursor == '\0') {
-				if (options.debug)
-					logChar(EOF);
-				return 0;
-			}
-		} else if (c != '\n' && c != '\r')
-			cursor = str;
-	}
-	if (options.debug)
-		logChar(EOF);
-	return -1;
-}
+static char *findBidKey(memBuf_t *mp);
+static int parsePreBidPage(char *biduiid, pageInfo_t *pageInfo, memBuf_t *mp, auctionInfo *aip);
+static int printMyItemsRow(char **row, int printNewline, FILE *fp);
+static void myItemsData(memBuf_t *mp, void *data);
+static void myItemsDone(memBuf_t *mp, void *data);
+static int getMyItemsPageCount(memBuf_t *mp);
+static void useLog(const auctionInfo *aip);
+static void printSleep(double seconds);
+static eventRequest_t *newEventRequest(const event_t *ev);
+static auctionInfo *endEventRequest(eventRequest_t *rp);
+static void queueEventRequest(eventRequest_t *rp, double startTime);
+static const event_t *auctionEvent(const auctionInfo *aip);
+static void dropEvents(auctionInfo *aip);
+static void infoEvent(const event_t *ev);
+static void infoRequestParse(memBuf_t *mp, void *data);
+static void infoRequestDone(memBuf_t *mp, void *data);
+static void historyDone(auctionInfo *aip, eventType_t type, int ret);
+static int pollDone(auctionInfo *aip, int ret);
+static int loginEvent(auctionInfo *aip);
+static void prebidEvent(const event_t *ev);
+static void sendPrebid(eventRequest_t *rp);
+static void prebidRequestParse(memBuf_t *mp, void *data);
+static void prebidRequestDone(memBuf_t *mp, void *data);
+static void prebidResult(eventRequest_t *rp, int ret);
+static void scheduleFire(auctionInfo *aip);
+static double resultTime(const auctionInfo *aip);
+static void releaseQuantity(auctionInfo *aip);
+static void auctionDone(auctionInfo *aip);
+static void auctionFailed(auctionInfo *aip);
+static int prepareBid(auctionInfo *aip);
+static void bidDone(memBuf_t *mp, void *data);
+static void rehearsalDone(memBuf_t *mp, void *data);
+static void rehearseBids(bidRequest_t *bids, int numBids);
+static void fireEvents(const event_t *first);
+static host_t *eventHost(eventType_t type, requestClass_t *rcp);
+static int limitEvent(const event_t *ev, requestWait_t *wp);
+static int resultDone(auctionInfo *aip, int ret);
+static int watchAuction(auctionInfo *aip);
+static int retireAuction(auctionGroup_t *gp, int i);
+static void repriceAuction(auctionInfo *aip, const char *bidPriceStr);
+static void groupFileChanged(const char *path, void *data);
+static int reloadWait(double until);
 
 static const char PAGEID[] = "Page id: ";
 static const char SRCID[] = "srcId: ";
@@ -243,17 +336,14 @@ getInfoTiming(auctionInfo *aip, time_t *timeToFirstByte)
 	for (i = 0; i < 3; ++i) {
 		memBuf_t *mp = NULL;
 
-		if (!aip->query) {
-			size_t urlLen = sizeof(HISTORY_URL) + strlen(options.historyHost) + strlen(aip->auction) - (2*2);
-
-			aip->query = (char *)myMalloc(urlLen);
-			sprintf(aip->query, HISTORY_URL, options.historyHost, aip->auction);
-		}
-		start = time(NULL);
-		if (!(mp = httpGet(aip->query, NULL))) {
+		start = historyTime();
+		if (!(mp = httpGetCached(historyQuery(aip), NULL))) {
 			freeMembuf(mp);
 			return httpError(aip);
 		}
+		/* time left is relative to when the page was made */
+		if (mp->date)
+			start = mp->date;
 		ret = parseBidHistory(mp, aip, start, timeToFirstByte, 0);
 		freeMembuf(mp);
 		if (i == 0 && ret == 1 && aip->auctionError == ae_mustsignin) {
@@ -268,6 +358,98 @@ getInfoTiming(auctionInfo *aip, time_t *timeToFirstByte)
 	return ret;
 }
 
+static const char *
+historyQuery(auctionInfo *aip)
+{
+	if (!aip->query) {
+		size_t urlLen = sizeof(HISTORY_URL) + strlen(options.historyHost) + strlen(aip->auction) - (2*2);
+
+		aip->query = (char *)myMalloc(urlLen);
+		sprintf(aip->query, HISTORY_URL, options.historyHost, aip->auction);
+	}
+	return aip->query;
+}
+
+/* a bid history request of getInfoParallel() */
+typedef struct {
+	auctionInfo *aip;
+	int *ret;
+	time_t start;	/* estimated send time, eBay's clock */
+	bidHistoryPage_t *page;	/* prepared by a parser thread */
+} infoRequest_t;
+
+/* parser thread, see parser.h */
+static void
+infoParse(memBuf_t *mp, void *data)
+{
+	((infoRequest_t *)data)->page = prepareBidHistory(mp);
+}
+
+static void
+infoDone(memBuf_t *mp, void *data)
+{
+	infoRequest_t *rp = (infoRequest_t *)data;
+
+	useLog(rp->aip);
+	if (!mp) {
+		*rp->ret = auctionError(rp->aip, ae_curlerror, rp->aip->query);
+		return;
+	}
+	memReset(mp);
+	/* time left is relative to when the page was made */
+	*rp->ret = parseBidHistoryPage(rp->page, mp, rp->aip, mp->date ? mp->date : rp->start, NULL, 0);
+	if (!*rp->ret)
+		printLog(stdout, "\n");
+}
+
+/*
+ * getInfoParallel(): get info on several auctions at once.  At most
+ * options.fetchConnections requests run at a time, and a token bucket
+ * of the same size spaces them options.fetchRate per minute.  Pages are
+ * parsed by parser threads while the next requests are started.
+ *
+ * ret[i] is set to getInfo()'s result for auctions[i], -1 if the
+ * auction wasn't fetched because the login failed.
+ */
+void
+getInfoParallel(auctionInfo **auctions, int numAuctions, int *ret)
+{
+	auctionInfo *dummy = newAuctionInfo("0", "0");
+	infoRequest_t *requests;
+	tokenBucket_t bucket;
+	httpBatch_t *bp;
+	int i;
+
+	for (i = 0; i < numAuctions; ++i)
+		ret[i] = -1;
+	if (ebayLogin(dummy, 0)) {
+		freeAuction(dummy);
+		return;
+	}
+	freeAuction(dummy);
+
+	log(("getInfoParallel(): %d auction(s), %d connection(s), %d per minute", numAuctions, options.fetchConnections, options.fetchRate));
+	requests = (infoRequest_t *)myMalloc((size_t)numAuctions * sizeof(infoRequest_t));
+	/* load schemas here, parser threads only read them */
+	(void)getSchema("ViewBids");
+	initTokenBucket(&bucket, options.fetchRate / 60.0, options.fetchConnections);
+	bp = newHttpBatch(options.fetchConnections);
+	for (i = 0; i < numAuctions; ++i) {
+		infoRequest_t *rp = &requests[i];
+		double wait = takeToken(&bucket);
+
+		rp->aip = auctions[i];
+		rp->ret = &ret[i];
+		rp->start = historyTime() + (time_t)wait;
+		rp->page = NULL;
+		ret[i] = 1;
+		httpBatchGetParsed(bp, historyQuery(auctions[i]), getMonotonicTime() + wait, infoParse, infoDone, rp);
+	}
+	runHttpBatch(bp);
+	freeHttpBatch(bp);
+	free(requests);
+}
+
 /*
  * Note: quant=1 is just to dupe eBay into allowing the pre-bid to get
  *	 through.  Actual quantity will be sent with bid.
@@ -275,73 +457,80 @@ getInfoTiming(auctionInfo *aip, time_t *timeToFirstByte)
 static const char PRE_BID_URL[] = "http://%s/ws/eBayISAPI.dll?MfcISAPICommand=MakeBid&fb=2&co_partner_id=&item=%s&maxbid=%s&quant=%s";
 
 /*
- * Get bid key
- *
- * returns 0 on success, 1 on failure.
+ * Url of the bid key page, to be freed by the caller.
  */
-static int
-preBid(auctionInfo *aip)
+static char *
+prebidUrl(const auctionInfo *aip)
 {
-	memBuf_t *mp = NULL;
-	int quantity = getQuantity(options.quantity, aip->quantity);
+	int quantity = getQuantity(aip->group->quantity, aip->quantity);
 	char quantityStr[12];	/* must hold an int */
 	size_t urlLen;
 	char *url;
-	int ret = 0;
-	int found = 0;
 
-	if (ebayLogin(aip, 0))
-		return 1;
 	sprintf(quantityStr, "%d", quantity);
 	urlLen = sizeof(PRE_BID_URL) + strlen(options.prebidHost) + strlen(aip->auction) + strlen(aip->bidPriceStr) + strlen(quantityStr) - (4*2);
 	url = (char *)myMalloc(urlLen);
 	sprintf(url, PRE_BID_URL, options.prebidHost, aip->auction, aip->bidPriceStr, quantityStr);
-	log(("\n\n*** preBid(): url is %s\n", url));
-	mp = httpGet(url, NULL);
-	free(url);
-	if (!mp)
-		return httpError(aip);
-
-	ret = parsePreBid(mp, aip);
-	freeMembuf(mp);
-	return ret;
+	return url;
 }
 
 static int
 parsePreBid(memBuf_t *mp, auctionInfo *aip)
 {
-	int ret = 0;
-	int found = 0;
+	char *biduiid = findBidKey(mp);
 
-	memReset(mp);
-	while (!match(mp, "name=\"uiid\"")) {
-		char *start, *value, *end;
+	return parsePreBidPage(biduiid, biduiid ? NULL : getPageInfo(mp), mp, aip);
+}
+
+/*
+ * Bid key of a bid page, NULL if there is none.  May run on a parser
+ * thread (see parser.h), so it doesn't use getUntil().
+ */
+static char *
+findBidKey(memBuf_t *mp)
+{
+	const char *s;
+
+	for (s = mp->memory; s && (s = strcasestr(s, "name=\"uiid\"")); ++s) {
+		const char *start, *value, *end, *quote;
 
-		for (start = mp->readptr; start >= mp->memory && *start != '<'; --start)
+		for (start = s; start >= mp->memory && *start != '<'; --start)
 			;
+		if (start < mp->memory)
+			continue;
 		value = strcasestr(start, "value=\"");
 		end = strchr(start, '>');
 
 		if (!value || !end || value > end)
 			continue;
-		free(aip->biduiid);
-		mp->readptr = value + 7;
-		aip->biduiid = myStrdup(getUntil(mp, '\"'));
-		log(("preBid(): biduiid is \"%s\"", aip->biduiid));
-		found = 1;
-		break;
+		value += 7;
+		quote = strchr(value, '\"');
+		return quote ? myStrndup(value, (size_t)(quote - value)) : NULL;
 	}
+	return NULL;
+}
 
-	if (!found) {
-		pageInfo_t *pageInfo = getPageInfo(mp);
+/*
+ * Second step of parsePreBid(): biduiid and pageInfo are found by
+ * findBidKey() and getPageInfo(), and freed here.
+ */
+static int
+parsePreBidPage(char *biduiid, pageInfo_t *pageInfo, memBuf_t *mp, auctionInfo *aip)
+{
+	int ret = 0;
 
+	if (biduiid) {
+		free(aip->biduiid);
+		aip->biduiid = biduiid;
+		log(("preBid(): biduiid is \"%s\"", aip->biduiid));
+	} else {
 		ret = makeBidError(pageInfo, aip);
 		if (ret < 0) {
 			ret = auctionError(aip, ae_biduiid, NULL);
 			bugReport("preBid", __FILE__, __LINE__, aip, mp, optiontab, "cannot find bid uiid");
 		}
-		freePageInfo(pageInfo);
 	}
+	freePageInfo(pageInfo);
 	return ret;
 }
 
@@ -349,6 +538,92 @@ static const char LOGIN_1_URL[] = "https://%s/ws/eBayISAPI.dll?SignIn";
 static const char LOGIN_2_URL[] = "https://%s/ws/eBayISAPI.dll?SignInWelcome&userid=%s&pass=%s&keepMeSignInOption=1";
 
 
+/*
+ * Path of a session file of the user in the log directory.  Returns
+ * malloc'ed string.
+ */
+static char *
+sessionPath(const char *suffix)
+{
+	char *name = myStrdup4(getProgname(), ".", options.username, suffix);
+	char *path, *s;
+
+	for (s = name; *s; ++s) {
+		if (*s == '/' || *s == '\\')
+			*s = '_';
+	}
+	path = logPath(options.logdir, name);
+	free(name);
+	return path;
+}
+
+/*
+ * Reuse the login session of an earlier run: its cookies and the time of
+ * its login.  The session is not checked here, requests that find it
+ * has expired ask for a new login (ae_mustsignin).
+ */
+static void
+restoreSession(void)
+{
+	account_t *ap = currentAccount();
+	char *cookies, *session;
+	FILE *fp;
+	long t = 0;
+
+	ap->sessionChecked = 1;
+	if (!options.session || !options.username)
+		return;
+	cookies = sessionPath(".cookies");
+	session = sessionPath(".session");
+	setCookieFile(cookies);
+	if ((fp = fopen(session, "r"))) {
+		if (fscanf(fp, "%ld", &t) != 1)
+			t = 0;
+		fclose(fp);
+	}
+	if (t > 0 && time(NULL) - (time_t)t < defaultLoginInterval) {
+		/* load cookies */
+		cleanupCurlStuff();
+		if (!initCurlStuff()) {
+			ap->loginTime = (time_t)t;
+			log(("reusing login session from %s", session));
+		}
+	}
+	free(cookies);
+	free(session);
+}
+
+/*
+ * Save login session for later runs.
+ */
+static void
+saveSession(void)
+{
+	char *session;
+	FILE *fp;
+
+	if (!options.session || !options.username)
+		return;
+	saveCookies();
+	session = sessionPath(".session");
+#if !defined(WIN32)
+	{
+		mode_t mask = umask(077);
+
+		fp = fopen(session, "w");
+		umask(mask);
+	}
+#else
+	fp = fopen(session, "w");
+#endif
+	if (fp) {
+		fprintf(fp, "%ld\n", (long)currentAccount()->loginTime);
+		fclose(fp);
+	} else
+		log(("cannot write %s: %s", session, strerror(errno)));
+	free(session);
+}
+
 /*
  * Force an ebay login.
  *
@@ -357,7 +632,8 @@ static const char LOGIN_2_URL[] = "https://%s/ws/eBayISAPI.dll?SignInWelcome&use
 static int
 forceEbayLogin(auctionInfo *aip)
 {
-	loginTime = 0;
+	currentAccount()->loginTime = 0;
+	clearCookies();
 	return ebayLogin(aip, 0);
 }
 
@@ -375,19 +651,20 @@ ebayLogin(auctionInfo *aip, time_t interval)
 	pageInfo_t *pp;
 	int ret = 0;
 	char *password;
+	account_t *ap = currentAccount();
+
+	if (!ap->sessionChecked)
+		restoreSession();
 
 	/* negative value forces login */
-	if (loginTime > 0) {
+	if (ap->loginTime > 0) {
 		if (interval == 0)
 			interval = defaultLoginInterval;	/* default: 12 hours */
-		if ((time(NULL) - loginTime) <= interval)
+		if ((time(NULL) - ap->loginTime) <= interval)
 			return 0;
 	}
 
-	cleanupCurlStuff();
-	if (initCurlStuff())
-		return auctionError(aip, ae_unknown, NULL);
-
+	/* connections are kept, a login must not slow down the next bid */
 	urlLen = sizeof(LOGIN_1_URL) + strlen(options.loginHost) - (1*2);
 	url = (char *)myMalloc(urlLen);
 	sprintf(url, LOGIN_1_URL, options.loginHost);
@@ -425,9 +702,10 @@ ebayLogin(auctionInfo *aip, time_t interval)
 		    (pp->pageName &&
 			(!strncasecmp(pp->pageName, "MyeBay", 6) ||
 			 !strncasecmp(pp->pageName, "My eBay", 7))
-		    ))
-			loginTime = time(NULL);
-		else if (pp->pageName &&
+		    )) {
+			ap->loginTime = time(NULL);
+			saveSession();
+		} else if (pp->pageName &&
 				(!strcmp(pp->pageName, "Welcome to eBay") ||
 				 !strcmp(pp->pageName, "Welcome to eBay - Sign in - Error")))
 			ret = auctionError(aip, ae_badpass, NULL);
@@ -591,303 +869,1566 @@ parseBid(memBuf_t *mp, auctionInfo *aip)
 
 static const char BID_URL[] = "http://%s/ws/eBayISAPI.dll?MfcISAPICommand=MakeBid&maxbid=%s&quant=%s&mode=1&uiid=%s&co_partnerid=2&user=%s&fb=2&item=%s";
 
+/* connections for bids are opened ahead of time on this url */
+static const char BID_HOST_URL[] = "http://%s/ws/eBayISAPI.dll";
+
+/* seconds before first bid connections are opened */
+#define CONNECT_LEAD 3
+/* minimum wait for a response before a hedged bid is sent again, seconds */
+#define MIN_HEDGE_DELAY 0.05
+
 /*
- * Place bid.
- *
- * Returns:
- * 0: OK
- * 1: error
+ * Create bid url for quantity aip->committed.  *logUrl is set to the
+ * url with uiid and username masked.
  */
-static int
-bid(auctionInfo *aip)
+static char *
+bidUrl(const auctionInfo *aip, const char *host, char **logUrl)
 {
-	memBuf_t *mp = NULL;
 	size_t urlLen;
-	char *url, *logUrl, *tmpUsername, *tmpUiid;
-	int ret;
-	int quantity = getQuantity(options.quantity, aip->quantity);
+	char *url, *tmpUsername, *tmpUiid;
 	char quantityStr[12];	/* must hold an int */
 
-	if (!aip->biduiid)
-		return auctionError(aip, ae_biduiid, NULL);
-
-	if (ebayLogin(aip, 0))
-		return 1;
-	sprintf(quantityStr, "%d", quantity);
+	sprintf(quantityStr, "%d", aip->committed);
 
 	/* create url */
-	urlLen = sizeof(BID_URL) + strlen(options.bidHost) + strlen(aip->bidPriceStr) + strlen(quantityStr) + strlen(aip->biduiid) + strlen(options.usernameEscape) + strlen(aip->auction) - (6*2);
+	urlLen = sizeof(BID_URL) + strlen(host) + strlen(aip->bidPriceStr) + strlen(quantityStr) + strlen(aip->biduiid) + strlen(options.usernameEscape) + strlen(aip->auction) - (6*2);
 	url = (char *)myMalloc(urlLen);
-	sprintf(url, BID_URL, options.bidHost, aip->bidPriceStr, quantityStr, aip->biduiid, options.usernameEscape, aip->auction);
+	sprintf(url, BID_URL, host, aip->bidPriceStr, quantityStr, aip->biduiid, options.usernameEscape, aip->auction);
 
-	logUrl = (char *)myMalloc(urlLen);
+	*logUrl = (char *)myMalloc(urlLen);
 	tmpUsername = stars(strlen(options.usernameEscape));
 	tmpUiid = stars(strlen(aip->biduiid));
-	sprintf(logUrl, BID_URL, options.bidHost, aip->bidPriceStr, quantityStr, tmpUiid, tmpUsername, aip->auction);
+	sprintf(*logUrl, BID_URL, host, aip->bidPriceStr, quantityStr, tmpUiid, tmpUsername, aip->auction);
 	free(tmpUsername);
 	free(tmpUiid);
+	return url;
+}
 
-	if (!options.bid) {
-		printLog(stdout, "Bidding disabled\n");
-		log(("\n\nbid(): query url:\n%s\n", logUrl));
-		ret = aip->bidResult = 0;
-	} else if (!(mp = httpGet(url, logUrl))) {
-		ret = httpError(aip);
-	} else {
-		ret = parseBid(mp, aip);
+/*
+ * Report when bid was sent, compared to the planned time.  The critical
+ * path is from timer wakeup (sent) until the request was written, 0 if
+ * unknown.
+ */
+static void
+bidSent(auctionInfo *aip, double sent, double written)
+{
+	if (aip->fireTime > 0) {
+		if (written > 0)
+			printLog(stdout, "Auction %s: Bid sent %.3f ms after planned time, critical path %.3f ms\n",
+				 aip->auction, (sent - aip->fireTime) * 1e3,
+				 (written - sent) * 1e3);
+		else
+			printLog(stdout, "Auction %s: Bid sent %.3f ms after planned time\n",
+				 aip->auction, (sent - aip->fireTime) * 1e3);
+		aip->fireTime = 0;
 	}
-	free(url);
-	free(logUrl);
-	freeMembuf(mp);
-	return ret;
-} /* bid() */
+}
 
 /*
- * watch(): watch auction until it is time to bid
+ * Place bid again with the url prepared by fireEvents(), after a new
+ * login.  Bid time has passed by then, so this is not on the critical
+ * path and its send time is not reported.
  *
- * returns:
- *	0 OK
- *	1 Error
+ * Returns:
+ * 0: OK
+ * 1: error
  */
 static int
-watch(auctionInfo *aip)
+bid(auctionInfo *aip, const char *url, const char *logUrl)
 {
-	int errorCount = 0;
-	long remain = LONG_MIN;
-	unsigned int sleepTime = 0;
-
-	log(("*** WATCHING auction %s price-each %s quantity %d bidtime %ld\n", aip->auction, aip->bidPriceStr, options.quantity, options.bidtime));
+	memBuf_t *mp;
+	int ret;
 
-	for (;;) {
-		time_t tmpLatency;
-		time_t start = time(NULL);
-		time_t timeToFirstByte = 0;
-		int ret = getInfoTiming(aip, &timeToFirstByte);
-		time_t end = time(NULL);
-
-		if (timeToFirstByte == 0)
-			timeToFirstByte = end;
-		tmpLatency = (timeToFirstByte - start);
-		if ((tmpLatency >= 0) && (tmpLatency < 600))
-			aip->latency = tmpLatency;
-		printLog(stdout, "Latency: %d seconds\n", aip->latency);
+	if (!(mp = httpGet(url, logUrl)))
+		return httpError(aip);
+	ret = parseBid(mp, aip);
+	freeMembuf(mp);
+	return ret;
+} /* bid() */
 
-		if (ret) {
-			printAuctionError(aip, stderr);
+/*
+ * useLog(): switch debug log to auction's log file, and to the account
+ * it is bid for
+ */
+static void
+useLog(const auctionInfo *aip)
+{
+	if (aip && aip->group)
+		useAccount(aip->group->account);
+	/* NULL: esniper.log */
+	if (options.debug && aip != logAuction) {
+		logOpen(aip, options.logdir);
+		logAuction = aip;
+	}
+}
 
-			/*
-			 * Fatal error?  We allow up to 50 errors, then quit.
-			 * eBay "unavailable" doesn't count towards the total.
-			 */
-			if (aip->auctionError == ae_unavailable) {
-				if (remain >= 0)
-					remain = newRemain(aip);
-				if (remain == LONG_MIN || remain > 86400) {
-					/* typical eBay maintenance period
-					 * is two hours.  Sleep for half that
-					 * amount of time.
-					 */
-					printLog(stdout, "%s: Will try again, sleeping for an hour\n", timestamp());
-					sleepTime = 3600;
-					sleep(sleepTime);
-					continue;
-				}
-			} else if (remain == LONG_MIN) {
-				/* first time through?  Give it 3 chances then
-				 * make the error fatal.
-				 */
-				int j;
-
-				for (j = 0; ret && j < 3 && aip->auctionError == ae_notitle; ++j)
-					ret = getInfo(aip);
-				if (ret)
-					return 1;
-				remain = newRemain(aip);
-			} else {
-				/* non-fatal error */
-				log(("ERROR %d!!!\n", ++errorCount));
-				if (errorCount > 50)
-					return auctionError(aip, ae_toomany, NULL);
-				printLog(stdout, "Cannot find auction - internet or eBay problem?\nWill try again after sleep.\n");
-				remain = newRemain(aip);
-			}
-		} else if (!isValidBidPrice(aip))
-			return auctionError(aip, ae_bidprice, NULL);
-		else
-			remain = newRemain(aip);
+static void
+printSleep(double seconds)
+{
+	unsigned int sleepTime = (unsigned int)(seconds + 0.5);
+
+	printf("%s: ", timestamp());
+	if (sleepTime >= 86400)
+		printLog(stdout, "Sleeping for a day\n");
+	else if (sleepTime >= 3600)
+		printLog(stdout, "Sleeping for %d hours %d minutes\n",
+			sleepTime/3600, (sleepTime % 3600) / 60);
+	else if (sleepTime >= 60)
+		printLog(stdout, "Sleeping for %d minutes %d seconds\n",
+			sleepTime/60, sleepTime % 60);
+	else
+		printLog(stdout, "Sleeping for %d seconds\n", sleepTime);
+}
 
-		/*
-		 * Check login when we are close to bidding.
-		 */
-		if (remain <= 300) {
-			if (ebayLogin(aip, defaultLoginInterval - 600))
-				return 1;
-			remain = newRemain(aip);
-		}
+/*
+ * Start the request of event ev, see queueEventRequest().
+ */
+static eventRequest_t *
+newEventRequest(const event_t *ev)
+{
+	eventRequest_t *rp = (eventRequest_t *)myMalloc(sizeof(eventRequest_t));
+
+	rp->ev = *ev;
+	rp->tries = 0;
+	rp->retries = 0;
+	rp->page = NULL;
+	rp->biduiid = NULL;
+	rp->pageInfo = NULL;
+	rp->next = eventRequests;
+	eventRequests = rp;
+	return rp;
+}
 
-		/*
-		 * if we're less than two minutes away, get bid key
-		 */
-		if (remain <= 150 && !aip->biduiid && aip->auctionError == ae_none) {
-			int i;
-
-			printf("\n");
-			for (i = 0; i < 5; ++i) {
-				/* ae_biduiid is used when the page loaded
-				 * but failed for some unknown reason.
-				 * Do not try again in this situation.
-				 */
-				if (!preBid(aip) ||
-				    aip->auctionError == ae_biduiid)
-					break;
-				if (aip->auctionError == ae_mustsignin &&
-				    forceEbayLogin(aip))
-					break;
-			}
-			if (aip->auctionError != ae_none &&
-			    aip->auctionError != ae_highbidder) {
-				printLog(stderr, "Cannot get bid key\n");
-				return 1;
-			}
-		}
+/*
+ * Request of an event is done.
+ *
+ * returns its auction, NULL if the auction was dropped meanwhile.
+ */
+static auctionInfo *
+endEventRequest(eventRequest_t *rp)
+{
+	auctionInfo *aip = rp->ev.aip;
+	eventRequest_t **rpp;
 
-		remain = newRemain(aip);
+	for (rpp = &eventRequests; *rpp != rp; rpp = &(*rpp)->next)
+		;
+	*rpp = rp->next;
+	freeBidHistoryPage(rp->page);
+	free(rp->biduiid);
+	freePageInfo(rp->pageInfo);
+	free(rp);
+	if (aip)
+		useLog(aip);
+	return aip;
+}
 
-		/* it's time!!! */
-		if (remain <= 0)
-			break;
+/*
+ * Send the request of an event on eventBatch, not before startTime
+ * (monotonic clock, 0 = now).  Polls and result checks get the bid
+ * history, bid key requests the bid page, and the page is prepared by
+ * a parser thread.  Requests keep the class of their event (see
+ * eventHost()), so that bid keys and results go before polls.
+ */
+static void
+queueEventRequest(eventRequest_t *rp, double startTime)
+{
+	auctionInfo *aip = rp->ev.aip;
+	double delay = startTime - getMonotonicTime();
+	requestClass_t rc;
+
+	(void)eventHost(rp->ev.type, &rc);
+	httpBatchClass(eventBatch, rc);
+	rp->start = historyTime() + (delay > 0 ? (time_t)delay : 0);
+	++rp->tries;
+	if (rp->ev.type == EVENT_PREBID) {
+		char *url = prebidUrl(aip);
+
+		log(("\n\n*** preBid(): url is %s\n", url));
+		httpBatchGetParsed(eventBatch, url, startTime, prebidRequestParse, prebidRequestDone, rp);
+		free(url);
+	} else
+		httpBatchGetCached(eventBatch, historyQuery(aip), startTime, infoRequestParse, infoRequestDone, rp);
+}
 
-		/*
-		 * Setup sleep schedule so we get updates once a day, then
-		 * at 2 hours, 1 hour, 5 minutes, 2 minutes
-		 */
-		if (remain <= 150)	/* 2 minutes + 30 seconds (slop) */
-			sleepTime = (unsigned int)remain;
-		else if (remain < 720)	/* 5 minutes + 2 minutes (slop) */
-			sleepTime = (unsigned int)remain - 120;
-		else if (remain < 3900)	/* 1 hour + 5 minutes (slop) */
-			sleepTime = (unsigned int)remain - 600;
-		else if (remain < 10800)/* 2 hours + 1 hour (slop) */
-			sleepTime = (unsigned int)remain - 3600;
-		else if (remain < 97200)/* 1 day + 3 hours (slop) */
-			sleepTime = (unsigned int)remain - 7200;
-		else			/* knock off one day */
-			sleepTime = 86400;
-
-		printf("%s: ", timestamp());
-		if (sleepTime >= 86400)
-			printLog(stdout, "Sleeping for a day\n");
-		else if (sleepTime >= 3600)
-			printLog(stdout, "Sleeping for %d hours %d minutes\n",
-				sleepTime/3600, (sleepTime % 3600) / 60);
-		else if (sleepTime >= 60)
-			printLog(stdout, "Sleeping for %d minutes %d seconds\n",
-				sleepTime/60, sleepTime % 60);
-		else
-			printLog(stdout, "Sleeping for %ld seconds\n", sleepTime);
-		sleep(sleepTime);
-		printf("\n");
+/*
+ * Pending event of an auction, or the event whose request is in flight.
+ * NULL if there is none.
+ */
+static const event_t *
+auctionEvent(const auctionInfo *aip)
+{
+	const event_t *ev = findEvent(aip);
+	const eventRequest_t *rp;
 
-		if ((remain=newRemain(aip)) <= 0)
-			break;
+	for (rp = eventRequests; !ev && rp; rp = rp->next) {
+		if (rp->ev.aip == aip)
+			ev = &rp->ev;
 	}
-	return 0;
-} /* watch() */
+	return ev;
+}
 
 /*
- * parameters:
- * aip	auction to bid on
- *
- * return number of items won
+ * Drop the events of an auction.  A request in flight runs to its end,
+ * but its result is thrown away.
  */
-int
-snipeAuction(auctionInfo *aip)
+static void
+dropEvents(auctionInfo *aip)
 {
-	int won = 0;
-	char *tmpUsername;
-
-	if (!aip)
-		return 0;
+	eventRequest_t *rp;
 
-	if (options.debug)
-		logOpen(aip, options.logdir);
+	cancelRequest(&aip->limit);
+	removeEvents(aip);
+	for (rp = eventRequests; rp; rp = rp->next) {
+		if (rp->ev.aip == aip)
+			rp->ev.aip = NULL;
+	}
+}
 
-	tmpUsername = stars(strlen(options.username));
-	log(("auction %s price %s quantity %d user %s bidtime %ld\n",
-	     aip->auction, aip->bidPriceStr,
-	     options.quantity, tmpUsername, options.bidtime));
-	free(tmpUsername);
+/*
+ * infoEvent(): get bid history for a poll or result check,
+ * infoRequestDone() goes on when it has arrived.
+ */
+static void
+infoEvent(const event_t *ev)
+{
+	auctionInfo *aip = ev->aip;
 
-	if (ebayLogin(aip, 0)) {
-		printAuctionError(aip, stderr);
-		return 0;
+	log(("\n\n*** getInfo auction %s price %s user %s\n", aip->auction, aip->bidPriceStr, options.username));
+	if (ev->type == EVENT_RESULT)
+		aip->won = -1;
+	if (!ebayLogin(aip, 0)) {
+		queueEventRequest(newEventRequest(ev), 0);
+		return;
 	}
+	if (ev->type == EVENT_RESULT)
+		printLog(stdout, "\nAuction %s: Post-bid info:\n", aip->auction);
+	historyDone(aip, ev->type, 1);
+}
 
-	/* 0 means "now" */
-	if ((options.bidtime == 0) ? preBid(aip) : watch(aip)) {
-		printAuctionError(aip, stderr);
-		if (aip->auctionError != ae_highbidder)
-			return 0;
-	}
+/* parser thread, see parser.h */
+static void
+infoRequestParse(memBuf_t *mp, void *data)
+{
+	((eventRequest_t *)data)->page = prepareBidHistory(mp);
+}
 
-	/* ran out of time! */
-	if (aip->endTime <= time(NULL)) {
-		(void)auctionError(aip, ae_ended, NULL);
-		printAuctionError(aip, stderr);
-		return 0;
-	}
+/*
+ * Bid history of a poll or result check has arrived (mp is NULL if the
+ * request failed).  As in getInfoTiming(), a page without time left is
+ * tried again two seconds later, and a lost login once after logging in
+ * again.  The first poll of an auction is tried 3 more times if the page
+ * has no title.
+ */
+static void
+infoRequestDone(memBuf_t *mp, void *data)
+{
+	eventRequest_t *rp = (eventRequest_t *)data;
+	auctionInfo *aip = rp->ev.aip;
+	eventType_t type = rp->ev.type;
+	int ret;
 
-	if (aip->auctionError != ae_highbidder) {
-		printLog(stdout, "\nAuction %s: Bidding...\n", aip->auction);
-		for (;;) {
-			if (bid(aip)) {
-				/* failed bid */
-				if (aip->auctionError == ae_mustsignin) {
-					if (!forceEbayLogin(aip))
-						continue;
-				}
-				printAuctionError(aip, stderr);
-				return 0;
+	if (!aip) {
+		(void)endEventRequest(rp);
+		return;
+	}
+	useLog(aip);
+	if (type == EVENT_RESULT && rp->tries == 1)
+		printLog(stdout, "\nAuction %s: Post-bid info:\n", aip->auction);
+	if (!mp)
+		ret = auctionError(aip, ae_curlerror, aip->query);
+	else {
+		memReset(mp);
+		/* time left is relative to when the page was made */
+		ret = parseBidHistoryPage(rp->page, mp, aip, mp->date ? mp->date : rp->start, NULL, 0);
+		rp->page = NULL;
+	}
+	if (rp->tries < INFO_TRIES) {
+		if (rp->tries == 1 && ret == 1 && aip->auctionError == ae_mustsignin) {
+			if (!forceEbayLogin(aip)) {
+				queueEventRequest(rp, 0);
+				return;
 			}
-			break;
+		} else if (aip->auctionError == ae_notime) {
+			/* Blank time remaining -- give it another chance */
+			queueEventRequest(rp, getMonotonicTime() + 2);
+			return;
 		}
 	}
-
-	/* view auction after bid.
-	 * Stick it in a loop in case our timing is a bit off (due
-	 * to wild swings in latency, for instance).
+	if (ret && type == EVENT_POLL && !aip->lastPollTime &&
+	    aip->auctionError == ae_notitle && rp->retries < 3) {
+		++rp->retries;
+		rp->tries = 0;
+		queueEventRequest(rp, 0);
+		return;
+	}
+	historyDone(endEventRequest(rp), type, ret);
+}
+
+/*
+ * Bid history of a poll or result check is done, ret is as getInfo()'s.
+ */
+static void
+historyDone(auctionInfo *aip, eventType_t type, int ret)
+{
+	if (type == EVENT_RESULT) {
+		if (resultDone(aip, ret) >= 0)
+			auctionDone(aip);
+	} else if (pollDone(aip, ret))
+		auctionFailed(aip);
+}
+
+/*
+ * pollDone(): bid history of a poll is done, schedule next poll or login
+ *
+ * returns:
+ *	0 OK
+ *	1 Error
+ */
+static int
+pollDone(auctionInfo *aip, int ret)
+{
+	const host_t *hp = getHost(options.bidHost);
+	long remain;
+
+	/* use the history host until we have bid host figures */
+	if (hp->latencySamples < MIN_LATENCY_SAMPLES)
+		hp = getHost(options.historyHost);
+	aip->latency = getLatency(hp, LATENCY_BID);
+	printLog(stdout, "Latency: %.3f seconds (%d%% quantile of %d requests, average %.3f)\n",
+		 aip->latency, options.latencyQuantile,
+		 hp->latencySamples, hp->latencyAverage);
+
+	if (ret) {
+		printAuctionError(aip, stderr);
+
+		/*
+		 * Fatal error?  We allow up to 50 errors, then quit.
+		 * eBay "unavailable" doesn't count towards the total.
+		 */
+		if (aip->auctionError == ae_unavailable) {
+			if (!aip->lastPollTime || newRemain(aip) > 86400) {
+				/* typical eBay maintenance period
+				 * is two hours.  Sleep for half that
+				 * amount of time.
+				 */
+				printLog(stdout, "%s: Will try again in an hour\n", timestamp());
+				addEvent(getMonotonicTime() + 3600, EVENT_POLL, aip);
+				return 0;
+			}
+		} else if (!aip->lastPollTime) {
+			/* first time through?  infoRequestDone() gave it
+			 * 3 chances, the error is fatal.
+			 */
+			return 1;
+		} else {
+			/* non-fatal error */
+			log(("ERROR %d!!!\n", ++aip->pollErrors));
+			if (aip->pollErrors > 50)
+				return auctionError(aip, ae_toomany, NULL);
+			printLog(stdout, "Cannot find auction - internet or eBay problem?\nWill try again after sleep.\n");
+		}
+	} else if (!isValidBidPrice(aip))
+		return auctionError(aip, ae_bidprice, NULL);
+
+	/*
+	 * Check login when we are close to bidding.
+	 */
+	remain = newRemain(aip);
+	if (remain <= LOGIN_WINDOW)
+		addEvent(getMonotonicTime(), EVENT_LOGIN, aip);
+	else
+		addEvent(getMonotonicTime() + getPollDelay(aip, remain), EVENT_POLL, aip);
+	if (!ret)
+		journalAuction(aip);
+	return 0;
+}
+
+/*
+ * loginEvent(): check login before bidding, schedule next poll or get
+ * bid key.  The session is normally renewed well before (see
+ * sessionEvent()), this only logs in if that failed.
+ *
+ * returns:
+ *	0 OK
+ *	1 Error
+ */
+static int
+loginEvent(auctionInfo *aip)
+{
+	long remain;
+
+	if (ebayLogin(aip, defaultLoginInterval - 600))
+		return 1;
+
+	/*
+	 * if we're less than two minutes away, get bid key
+	 */
+	remain = newRemain(aip);
+	if (remain <= 150)
+		addEvent(getMonotonicTime(), EVENT_PREBID, aip);
+	else
+		addEvent(getMonotonicTime() + getPollDelay(aip, remain), EVENT_POLL, aip);
+	return 0;
+}
+
+/*
+ * Planned bid time of an auction with pending event ev (monotonic clock),
+ * 0 if unknown or already bid.
+ */
+static double
+plannedFire(const event_t *ev)
+{
+	const auctionInfo *aip = ev->aip;
+
+	if (!aip || ev->type == EVENT_RESULT || ev->type == EVENT_SESSION)
+		return 0;
+	if (ev->type == EVENT_FIRE)
+		return ev->time;
+	if (aip->endTime <= 0)
+		return 0;
+	return wallToMonotonic((double)(aip->endTime - options.bidtime) - aip->latency -
+			       getClockOffset(getHost(options.historyHost), NULL));
+}
+
+/*
+ * sessionDue(): when to renew the login session of an account (monotonic
+ * clock).  SESSION_RENEW before it expires, moved earlier if that is in
+ * the last LOGIN_WINDOW seconds before a bid, so that no auction needs a
+ * login while it is armed.  If that time has passed, as soon as
+ * possible, but not within SESSION_GUARD seconds of a bid.  Bids of all
+ * accounts count, requests block.
+ */
+static double
+sessionDue(const account_t *ap)
+{
+	double now = getMonotonicTime();
+	double due = now + (double)(ap->loginTime + defaultLoginInterval - SESSION_RENEW - time(NULL));
+	const eventRequest_t *rp;
+	double *fires;
+	int i, numFires = 0, moved, rounds;
+
+	/* pending events and those whose request is in flight */
+	for (rp = eventRequests; rp; rp = rp->next)
+		++numFires;
+	fires = (double *)myMalloc((size_t)(eventCount() + numFires + 1) * sizeof(double));
+	numFires = 0;
+	for (i = 0; i < eventCount(); ++i)
+		fires[numFires++] = plannedFire(getEvent(i));
+	for (rp = eventRequests; rp; rp = rp->next)
+		fires[numFires++] = plannedFire(&rp->ev);
+
+	for (moved = 1, rounds = 0; moved && rounds <= numFires; ++rounds) {
+		moved = 0;
+		for (i = 0; i < numFires; ++i) {
+			double fire = fires[i];
+
+			if (fire > 0 && due > fire - LOGIN_WINDOW - SESSION_GUARD &&
+			    due < fire + SESSION_GUARD) {
+				due = fire - LOGIN_WINDOW - SESSION_GUARD;
+				moved = 1;
+			}
+		}
+	}
+	if (due < now)
+		due = now;
+	if (due < ap->sessionRetry)
+		due = ap->sessionRetry;
+	for (moved = 1, rounds = 0; moved && rounds <= numFires; ++rounds) {
+		moved = 0;
+		for (i = 0; i < numFires; ++i) {
+			double fire = fires[i];
+
+			if (fire > 0 && due > fire - SESSION_GUARD &&
+			    due < fire + SESSION_GUARD) {
+				due = fire + SESSION_GUARD;
+				moved = 1;
+			}
+		}
+	}
+	free(fires);
+	return due;
+}
+
+/*
+ * Keep one EVENT_SESSION pending at sessionDue() for each account that
+ * is logged in and has auctions watched.
+ */
+static void
+scheduleSession(void)
+{
+	account_t *ap;
+
+	for (ap = firstAccount(); ap; ap = ap->next) {
+		const event_t *ev = findEvent(ap->sessionAip);
+		const eventRequest_t *rp;
+		double due;
+		int i, watched = 0;
+
+		for (i = 0; i < eventCount() && !watched; ++i) {
+			const auctionInfo *aip = getEvent(i)->aip;
+
+			watched = aip && aip->group && aip->group->account == ap;
+		}
+		for (rp = eventRequests; rp && !watched; rp = rp->next) {
+			const auctionInfo *aip = rp->ev.aip;
+
+			watched = aip && aip->group && aip->group->account == ap;
+		}
+		if (ap->loginTime == 0 || !watched) {
+			if (ev)
+				removeEvents(ap->sessionAip);
+			continue;
+		}
+		due = sessionDue(ap);
+		if (!ev || ev->time < due - 1 || ev->time > due + 1) {
+			removeEvents(ap->sessionAip);
+			addEvent(due, EVENT_SESSION, ap->sessionAip);
+		}
+	}
+}
+
+/*
+ * sessionEvent(): renew login session of the current account for all
+ * its auctions.  If that fails, the old session is kept, and auctions
+ * log in on their own before bidding (see loginEvent()).
+ */
+static void
+sessionEvent(void)
+{
+	account_t *ap = currentAccount();
+	time_t oldLoginTime = ap->loginTime;
+
+	resetAuctionError(ap->sessionAip);
+	useLog(NULL);
+	if (ap == firstAccount())
+		printLog(stdout, "\n%s: Renewing login session\n", timestamp());
+	else
+		printLog(stdout, "\n%s: Renewing login session of %s\n", timestamp(), options.username);
+	ap->loginTime = 0;
+	if (ebayLogin(ap->sessionAip, 0)) {
+		printAuctionError(ap->sessionAip, stderr);
+		ap->loginTime = oldLoginTime;
+		ap->sessionRetry = getMonotonicTime() + LOGIN_WINDOW;
+	}
+}
+
+/*
+ * prebidEvent(): get bid key, prebidResult() schedules the bid
+ */
+static void
+prebidEvent(const event_t *ev)
+{
+	auctionInfo *aip = ev->aip;
+
+	/* 0 means "now" */
+	if (options.bidtime != 0) {
+		if (aip->biduiid || aip->auctionError != ae_none) {
+			scheduleFire(aip);
+			return;
+		}
+		printf("\n");
+	}
+	sendPrebid(newEventRequest(ev));
+}
+
+/*
+ * Send a bid key request.  A failed login counts as a failed request.
+ */
+static void
+sendPrebid(eventRequest_t *rp)
+{
+	if (!ebayLogin(rp->ev.aip, 0)) {
+		queueEventRequest(rp, 0);
+		return;
+	}
+	++rp->tries;
+	prebidResult(rp, 1);
+}
+
+/* parser thread, see parser.h */
+static void
+prebidRequestParse(memBuf_t *mp, void *data)
+{
+	eventRequest_t *rp = (eventRequest_t *)data;
+
+	if (!(rp->biduiid = findBidKey(mp)))
+		rp->pageInfo = getPageInfo(mp);
+}
+
+static void
+prebidRequestDone(memBuf_t *mp, void *data)
+{
+	eventRequest_t *rp = (eventRequest_t *)data;
+	auctionInfo *aip = rp->ev.aip;
+	int ret;
+
+	if (!aip) {
+		(void)endEventRequest(rp);
+		return;
+	}
+	useLog(aip);
+	if (!mp)
+		ret = auctionError(aip, ae_curlerror, options.prebidHost);
+	else {
+		memReset(mp);
+		ret = parsePreBidPage(rp->biduiid, rp->pageInfo, mp, aip);
+		rp->biduiid = NULL;
+		rp->pageInfo = NULL;
+	}
+	prebidResult(rp, ret);
+}
+
+/*
+ * Bid key request is done, ret is 0 on success, 1 on failure.  Try
+ * again, or schedule the bid.
+ */
+static void
+prebidResult(eventRequest_t *rp, int ret)
+{
+	auctionInfo *aip = rp->ev.aip;
+
+	if (options.bidtime == 0) {
+		(void)endEventRequest(rp);
+		if (ret) {
+			if (aip->auctionError != ae_highbidder) {
+				auctionFailed(aip);
+				return;
+			}
+			printAuctionError(aip, stderr);
+		}
+		aip->fireTime = getMonotonicTime();
+		addEvent(aip->fireTime, EVENT_FIRE, aip);
+		return;
+	}
+	/* ae_biduiid is used when the page loaded but failed for some
+	 * unknown reason.  Do not try again in this situation.
 	 */
+	if (ret && rp->tries < PREBID_TRIES &&
+	    aip->auctionError != ae_biduiid &&
+	    !(aip->auctionError == ae_mustsignin && forceEbayLogin(aip))) {
+		sendPrebid(rp);
+		return;
+	}
+	(void)endEventRequest(rp);
+	if (aip->auctionError != ae_none &&
+	    aip->auctionError != ae_highbidder) {
+		printLog(stderr, "Cannot get bid key\n");
+		auctionFailed(aip);
+		return;
+	}
+	journalAuction(aip);
+	scheduleFire(aip);
+}
+
+/*
+ * Schedule the bid of an auction at the exact bid time.
+ */
+static void
+scheduleFire(auctionInfo *aip)
+{
+	double fireWall = (double)(aip->endTime - options.bidtime) - aip->latency -
+		getClockOffset(getHost(options.historyHost), NULL);
+
+	aip->fireTime = wallToMonotonic(fireWall);
+	addEvent(aip->fireTime, EVENT_FIRE, aip);
+}
+
+/*
+ * resultTime(): when to get the result of a bid.  If we bid close to the
+ * end, the first check is right after the auction is over, on eBay's
+ * clock.  Checks that didn't show the winner are repeated with
+ * exponential backoff.
+ */
+static double
+resultTime(const auctionInfo *aip)
+{
+	double now = getMonotonicTime();
+	double delay;
+
+	if (options.bidtime <= 0 || options.bidtime >= 60)
+		return now;
+	if (aip->resultPolls == 0) {
+		delay = (double)aip->endTime - getHostTime(getHost(options.historyHost)) + RESULT_DELAY;
+		if (delay < 0)
+			delay = 0;
+		printLog(stdout, "Auction %s: Waiting %.1f seconds for auction to complete...\n", aip->auction, delay);
+	} else {
+		int i;
+
+		for (delay = RESULT_BACKOFF, i = 1; i < aip->resultPolls && delay < RESULT_MAX_BACKOFF; ++i)
+			delay *= 2;
+		if (delay > RESULT_MAX_BACKOFF)
+			delay = RESULT_MAX_BACKOFF;
+		log(("result of auction %s not final, checking again in %.1f seconds", aip->auction, delay));
+	}
+	return now + delay;
+}
+
+/*
+ * Release quantity committed to a bid.
+ */
+static void
+releaseQuantity(auctionInfo *aip)
+{
+	if (aip->committed > 0)
+		aip->group->committed -= aip->committed;
+	aip->committed = 0;
+}
+
+/*
+ * auctionDone(): auction has been won, lost, or failed.
+ */
+static void
+auctionDone(auctionInfo *aip)
+{
+	auctionGroup_t *gp = aip->group;
+
+	cancelRequest(&aip->limit);
+	if (--gp->active > 0 && gp->quantity > 0)
+		printRemain(gp->quantity, gp->active);
+	else if (gp->name && gp->active == 0)
+		printLog(stdout, "\n%s: done, won %d item(s)\n", gp->name, gp->won);
+}
+
+/*
+ * auctionFailed(): auction has failed, the error is printed.
+ */
+static void
+auctionFailed(auctionInfo *aip)
+{
+	printAuctionError(aip, stderr);
+	auctionDone(aip);
+}
+
+/*
+ * prepareBid(): check auction and set quantity before bidding.  Bids
+ * without a result yet count as won, so that we don't win more than we
+ * want.
+ *
+ * returns:
+ *	0 send bid
+ *	1 don't send bid (error, or we are already the high bidder)
+ */
+static int
+prepareBid(auctionInfo *aip)
+{
+	auctionGroup_t *gp = aip->group;
+	int want = gp->quantity - gp->committed;
+
+	/* ran out of time! */
+	if (aip->endTime <= historyTime()) {
+		(void)auctionError(aip, ae_ended, NULL);
+		printAuctionError(aip, stderr);
+		auctionDone(aip);
+		return 1;
+	}
+	if (want <= 0) {
+		printLog(stdout, "\nAuction %s: Not bidding, waiting for result of bids on %d item(s)\n", aip->auction, gp->committed);
+		auctionDone(aip);
+		return 1;
+	}
+	aip->committed = getQuantity(want, aip->quantity);
+	if (aip->committed > 0)
+		gp->committed += aip->committed;
+	if (aip->auctionError == ae_highbidder) {
+		addEvent(resultTime(aip), EVENT_RESULT, aip);
+		return 1;
+	}
+	if (!aip->biduiid || ebayLogin(aip, 0)) {
+		if (!aip->biduiid)
+			(void)auctionError(aip, ae_biduiid, NULL);
+		printAuctionError(aip, stderr);
+		releaseQuantity(aip);
+		auctionDone(aip);
+		return 1;
+	}
+	return 0;
+}
+
+static void
+bidDone(memBuf_t *mp, void *data)
+{
+	bidRequest_t *rp = (bidRequest_t *)data;
+
+	useLog(rp->aip);
+	if (!mp) {
+		rp->ret = auctionError(rp->aip, ae_curlerror, rp->logUrl);
+		return;
+	}
+	bidSent(rp->aip, mp->sent, mp->written);
+	rp->ret = parseBid(mp, rp->aip);
+	/* the other copy of a hedged bid may have got there first */
+	if (rp->ret && rp->hedged && rp->aip->auctionError == ae_highbidder) {
+		log(("bidDone(): high bidder, hedged bid already accepted"));
+		resetAuctionError(rp->aip);
+		rp->ret = rp->aip->bidResult = 0;
+	}
+}
+
+/* a rehearsal bid, see rehearsal.h */
+typedef struct {
+	auctionInfo *aip;
+	double planned;	/* planned send time, monotonic clock */
+} rehearsalBid_t;
+
+static void
+rehearsalDone(memBuf_t *mp, void *data)
+{
+	rehearsalBid_t *rp = (rehearsalBid_t *)data;
+
+	useLog(rp->aip);
+	if (mp) {
+		log(("rehearsal bid sent %.3f ms after planned time", (mp->sent - rp->planned) * 1e3));
+	}
+	addRehearsal(rp->planned, mp);
+}
+
+/*
+ * rehearseBids(): send prepared bids to the rehearsal host like real
+ * ones, REHEARSAL_BIDS times each starting at bid time.
+ */
+static void
+rehearseBids(bidRequest_t *bids, int numBids)
+{
+	httpBatch_t *bp = newHttpBatch(numBids);
+	rehearsalBid_t *rbids = (rehearsalBid_t *)myMalloc((size_t)(numBids * REHEARSAL_BIDS) * sizeof(rehearsalBid_t));
+	size_t urlLen = sizeof(BID_HOST_URL) + strlen(options.rehearsalHost) - (1*2);
+	char *url = (char *)myMalloc(urlLen);
+	int i, j;
+
+	httpBatchClass(bp, REQUEST_BID);
+	sprintf(url, BID_HOST_URL, options.rehearsalHost);
+	for (i = 0; i < numBids; ++i) {
+		useLog(bids[i].aip);
+		httpBatchConnect(bp, url, NULL, bids[0].aip->fireTime - CONNECT_LEAD);
+	}
+	free(url);
+	for (i = 0; i < numBids; ++i) {
+		useLog(bids[i].aip);
+		printLog(stdout, "\nAuction %s: Rehearsing bid on %s...\n", bids[i].aip->auction, options.rehearsalHost);
+		for (j = 0; j < REHEARSAL_BIDS; ++j) {
+			rehearsalBid_t *rp = &rbids[i * REHEARSAL_BIDS + j];
+
+			rp->aip = bids[i].aip;
+			rp->planned = bids[i].aip->fireTime + j * REHEARSAL_INTERVAL;
+			httpBatchGetAt(bp, bids[i].url, rp->planned, NULL, rehearsalDone, rp);
+		}
+		bids[i].aip->fireTime = 0;
+		bids[i].ret = 0;
+	}
+	runHttpBatch(bp);
+	freeHttpBatch(bp);
+	free(rbids);
+}
+
+/*
+ * fireEvents(): place all bids due within FIRE_GUARD seconds of the
+ * first one.  Each bid is sent at its own time on its own connection, so
+ * a slow response doesn't hold up the next bid.  Other events due in
+ * that time are postponed until the bids are done.
+ *
+ * Bids are prepared well before bid time: quantity, login and url are
+ * checked and created, and the transfers set up.  Connections are opened
+ * CONNECT_LEAD seconds before the first bid, so at bid time only the
+ * request itself is sent.
+ *
+ * With the hedge option, a second connection is opened for each bid,
+ * through another address of the bid host if it has one.  If no
+ * response has started after the 99% latency quantile, the bid is sent
+ * again on it.
+ *
+ * In rehearsal mode bids go to the rehearsal host instead.
+ */
+static void
+fireEvents(const event_t *first)
+{
+	bidRequest_t *bids = NULL;
+	event_t *others = NULL;
+	int numBids = 0, numOthers = 0, i;
+	event_t ev = *first;
+
 	for (;;) {
-		if (options.bidtime > 0 && options.bidtime < 60) {
-			time_t seconds = aip->endTime - time(NULL);
-
-			if (seconds < 0)
-				seconds = 0;
-			/* extra 2 seconds to make sure auction is over */
-			seconds += 2;
-			printLog(stdout, "Auction %s: Waiting %d seconds for auction to complete...\n", aip->auction, seconds);
-			sleep((unsigned int)seconds);
+		useLog(ev.aip);
+		if (ev.type != EVENT_FIRE) {
+			others = (event_t *)myRealloc(others, (size_t)(numOthers + 1) * sizeof(event_t));
+			others[numOthers++] = ev;
+		} else if (!prepareBid(ev.aip)) {
+			bidRequest_t *rp;
+
+			/* bids never wait, only counted */
+			(void)admitRequest(getHost(options.rehearsalHost ? options.rehearsalHost : options.bidHost), REQUEST_BID, &ev.aip->limit);
+			bids = (bidRequest_t *)myRealloc(bids, (size_t)(numBids + 1) * sizeof(bidRequest_t));
+			rp = &bids[numBids++];
+			rp->aip = ev.aip;
+			rp->url = bidUrl(ev.aip, options.rehearsalHost ? options.rehearsalHost : options.bidHost, &rp->logUrl);
+			rp->ret = -1;
+			rp->hedged = options.hedge && options.bid && !options.rehearsalHost;
+		}
+		if (!peekEvent() ||
+		    peekEvent()->time - first->time >= FIRE_GUARD ||
+		    !nextEvent(&ev))
+			break;
+	}
+
+	if (numBids > 0) {
+		double now = getMonotonicTime();
+
+		if (bids[0].aip->fireTime > now)
+			printLog(stdout, "%s: Sleeping for %.3f seconds until bid time\n",
+				 timestamp(), bids[0].aip->fireTime - now);
+		if (options.rehearsalHost)
+			rehearseBids(bids, numBids);
+		else if (options.bid) {
+			httpBatch_t *bp = newHttpBatch(options.hedge ? 2 * numBids : numBids);
+			size_t urlLen = sizeof(BID_HOST_URL) + strlen(options.bidHost) - (1*2);
+			char *url = (char *)myMalloc(urlLen);
+			char *connectTo = NULL;
+			double hedgeDelay = 0;
+
+			if (options.hedge) {
+				const host_t *hp = getHost(options.bidHost);
+
+				if (hp->latencySamples < MIN_LATENCY_SAMPLES)
+					hp = getHost(options.historyHost);
+				hedgeDelay = getLatency(hp, LATENCY_P99);
+				if (hedgeDelay < MIN_HEDGE_DELAY)
+					hedgeDelay = MIN_HEDGE_DELAY;
+				connectTo = getConnectTo(options.bidHost);
+			}
+
+			/* one warm connection for each bid, two if hedged */
+			httpBatchClass(bp, REQUEST_BID);
+			sprintf(url, BID_HOST_URL, options.bidHost);
+			for (i = 0; i < numBids; ++i) {
+				useLog(bids[i].aip);
+				httpBatchConnect(bp, url, NULL, bids[0].aip->fireTime - CONNECT_LEAD);
+				if (options.hedge)
+					httpBatchConnect(bp, url, connectTo, bids[0].aip->fireTime - CONNECT_LEAD);
+			}
+			free(url);
+			for (i = 0; i < numBids; ++i) {
+				useLog(bids[i].aip);
+				printLog(stdout, "\nAuction %s: Bidding...\n", bids[i].aip->auction);
+				if (options.hedge)
+					httpBatchGetHedged(bp, bids[i].url, bids[i].aip->fireTime,
+							   hedgeDelay, connectTo, bidDone, &bids[i]);
+				else
+					httpBatchGetAt(bp, bids[i].url, bids[i].aip->fireTime,
+						       NULL, bidDone, &bids[i]);
+			}
+			free(connectTo);
+			runHttpBatch(bp);
+			freeHttpBatch(bp);
+		} else {
+			for (i = 0; i < numBids; ++i) {
+				auctionInfo *aip = bids[i].aip;
+
+				useLog(aip);
+				bidSent(aip, fireAt(aip->fireTime), 0);
+				printLog(stdout, "\nAuction %s: Bidding disabled\n", aip->auction);
+				log(("\n\nbid(): query url:\n%s\n", bids[i].logUrl));
+				bids[i].ret = aip->bidResult = 0;
+			}
 		}
+	}
 
-		printLog(stdout, "\nAuction %s: Post-bid info:\n",
-			 aip->auction);
-		if (getInfo(aip))
+	for (i = 0; i < numBids; ++i) {
+		auctionInfo *aip = bids[i].aip;
+		int ret = bids[i].ret;
+
+		useLog(aip);
+		/* failed bid, the login cookies are sent along, the url stays */
+		while (ret && aip->auctionError == ae_mustsignin &&
+		       !forceEbayLogin(aip))
+			ret = bid(aip, bids[i].url, bids[i].logUrl);
+		if (options.rehearsalHost) {
+			printLog(stdout, "Auction %s: Rehearsal done, no bid placed\n", aip->auction);
+			releaseQuantity(aip);
+			auctionDone(aip);
+		} else if (ret) {
 			printAuctionError(aip, stderr);
-		if (aip->remain > 0 && aip->remain < 60 &&
-		    options.bidtime > 0 && options.bidtime < 60)
-			continue;
-		break;
+			releaseQuantity(aip);
+			auctionDone(aip);
+		} else
+			addEvent(resultTime(aip), EVENT_RESULT, aip);
+		free(bids[i].url);
+		free(bids[i].logUrl);
 	}
+	free(bids);
+
+	for (i = 0; i < numOthers; ++i)
+		addEvent(others[i].time, others[i].type, others[i].aip);
+	free(others);
+}
+
+/*
+ * resultDone(): bid history after bid is done, ret is as getInfo()'s.
+ * Once the winner is known, the quantity bid on is released and data
+ * only needed for bidding is freed.
+ *
+ * returns number of items won, -1 if the page doesn't show the winner
+ * yet (auction not ended, or eBay not up to date) and the result was
+ * rescheduled.
+ */
+static int
+resultDone(auctionInfo *aip, int ret)
+{
+	int won;
+
+	if (ret)
+		printAuctionError(aip, stderr);
+	++aip->resultPolls;
+	if ((aip->remain > 0 || aip->won == -1) &&
+	    aip->resultPolls < RESULT_POLLS &&
+	    options.bidtime > 0 && options.bidtime < 60) {
+		addEvent(resultTime(aip), EVENT_RESULT, aip);
+		return -1;
+	}
+	releaseQuantity(aip);
+	free(aip->biduiid);
+	aip->biduiid = NULL;
+	free(aip->query);
+	aip->query = NULL;
+	journalAuction(aip);
 
 	if (aip->won == -1) {
-		won = options.quantity < aip->quantity ?
-			options.quantity : aip->quantity;
+		won = aip->group->quantity < aip->quantity ?
+			aip->group->quantity : aip->quantity;
 		printLog(stdout, "\nunknown outcome, assume that you have won %d items\n", won);
 	} else {
 		won = aip->won;
 		printLog(stdout, "\nwon %d item(s)\n", won);
 	}
-	options.quantity -= won;
+	aip->group->quantity -= won;
+	aip->group->won += won;
+	return won;
+}
+
+auctionGroup_t *
+newAuctionGroup(const char *name, auctionInfo **auctions, int numAuctions, int quantity)
+{
+	auctionGroup_t *gp = (auctionGroup_t *)myMalloc(sizeof(auctionGroup_t));
+	int i;
+
+	gp->name = name ? myStrdup(name) : NULL;
+	gp->auctions = auctions;
+	gp->numAuctions = numAuctions;
+	gp->quantity = quantity;
+	gp->committed = 0;
+	gp->active = 0;
+	gp->won = 0;
+	gp->account = currentAccount();
+	gp->next = NULL;
+	for (i = 0; i < numAuctions; ++i)
+		auctions[i]->group = gp;
+	return gp;
+}
+
+void
+freeAuctionGroup(auctionGroup_t *gp)
+{
+	int i;
+
+	if (!gp)
+		return;
+	for (i = 0; i < gp->numAuctions; ++i) {
+		if (gp->auctions[i] == logAuction)
+			logAuction = NULL;
+		freeAuction(gp->auctions[i]);
+	}
+	free(gp->auctions);
+	free(gp->name);
+	free(gp);
+}
+
+/*
+ * Log in and schedule the first event of an auction.
+ *
+ * returns 0 if the auction is watched, else 1.
+ */
+static int
+watchAuction(auctionInfo *aip)
+{
+	auctionGroup_t *gp = aip->group;
+	char *tmpUsername;
+
+	useLog(aip);
+	tmpUsername = stars(strlen(options.username));
+	log(("auction %s price %s quantity %d user %s bidtime %ld\n",
+	     aip->auction, aip->bidPriceStr,
+	     gp->quantity, tmpUsername, options.bidtime));
+	free(tmpUsername);
+
+	if (ebayLogin(aip, 0)) {
+		printAuctionError(aip, stderr);
+		return 1;
+	}
+	log(("*** WATCHING auction %s price-each %s quantity %d bidtime %ld\n", aip->auction, aip->bidPriceStr, gp->quantity, options.bidtime));
+	if (options.bidtime == 0)
+		addEvent(getMonotonicTime(), EVENT_PREBID, aip);
+	else {
+		/* restored from journal? */
+		double now = getMonotonicTime();
+
+		addEvent(aip->nextPoll > now ? aip->nextPoll : now, EVENT_POLL, aip);
+		aip->nextPoll = 0;
+	}
+	++gp->active;
+	return 0;
+}
+
+/*
+ * Start watching the auctions of a group: log in and schedule the first
+ * event of each auction.  Auctions must be sorted by end time, so that
+ * auctions ending at the same time are bid on in order.
+ */
+void
+watchAuctionGroup(auctionGroup_t *gp)
+{
+	int i;
+
+	for (i = 0; i < gp->numAuctions; ++i)
+		(void)watchAuction(gp->auctions[i]);
+	if (gp->numAuctions > 1)
+		printRemain(gp->quantity, gp->active);
+	if (gp->name)
+		(void)addFileWatch(gp->name, groupFileChanged, gp);
+}
+
+/*
+ * Stop watching the auctions of a group.
+ */
+void
+unwatchAuctionGroup(auctionGroup_t *gp)
+{
+	int i;
+
+	if (gp->name)
+		removeFileWatch(gp->name);
+	for (i = 0; i < gp->numAuctions; ++i)
+		dropEvents(gp->auctions[i]);
+	gp->active = 0;
+}
+
+/*
+ * Print state of the auctions of a group.
+ */
+void
+printAuctionGroup(const auctionGroup_t *gp, FILE *fp)
+{
+	double now = getMonotonicTime();
+	int i;
+
+	fprintf(fp, "%s: %d item(s) wanted, %d won, %d bid on, %d of %d auction(s) active\n",
+		gp->name ? gp->name : "(command line)", gp->quantity, gp->won,
+		gp->committed, gp->active, gp->numAuctions);
+	for (i = 0; i < gp->numAuctions; ++i) {
+		const auctionInfo *aip = gp->auctions[i];
+		const event_t *ev = auctionEvent(aip);
+
+		fprintf(fp, "  %s %s", aip->auction, aip->bidPriceStr);
+		if (aip->title)
+			fprintf(fp, " \"%s\"", aip->title);
+		if (ev)
+			fprintf(fp, ", next %s in %.0f seconds", eventName(ev->type), ev->time > now ? ev->time - now : 0);
+		else if (aip->won > 0)
+			fprintf(fp, ", won %d", aip->won);
+		else
+			fprintf(fp, ", done");
+		fprintf(fp, "\n");
+	}
+}
+
+/*
+ * Stop watching an auction no longer listed in its auction file, and
+ * remove it from the group.  An auction already bid on is kept until
+ * its result is known.
+ *
+ * returns 1 if the auction was removed, else 0.
+ */
+static int
+retireAuction(auctionGroup_t *gp, int i)
+{
+	auctionInfo *aip = gp->auctions[i];
+	const event_t *ev = auctionEvent(aip);
+
+	if (ev && ev->type == EVENT_RESULT) {
+		printLog(stdout, "Auction %s: already bid on, kept until the result is known\n", aip->auction);
+		return 0;
+	}
+	printLog(stdout, "Auction %s: removed\n", aip->auction);
+	if (ev) {
+		dropEvents(aip);
+		--gp->active;
+	}
+	releaseQuantity(aip);
+	if (aip == logAuction)
+		logAuction = NULL;
+	freeAuction(aip);
+	memmove(&gp->auctions[i], &gp->auctions[i + 1],
+		(size_t)(gp->numAuctions - i - 1) * sizeof(auctionInfo *));
+	--gp->numAuctions;
+	return 1;
+}
+
+/*
+ * Change the bid price of an auction.  A bid key fetched or being
+ * fetched is for the old price, so it is fetched again.  An auction
+ * given up on (e.g. because the price was too low) is watched again if
+ * it hasn't ended.
+ */
+static void
+repriceAuction(auctionInfo *aip, const char *bidPriceStr)
+{
+	auctionGroup_t *gp = aip->group;
+	const event_t *ev = auctionEvent(aip);
+
+	if (ev && ev->type == EVENT_RESULT) {
+		printLog(stdout, "Auction %s: already bid on, new price %s ignored\n", aip->auction, bidPriceStr);
+		return;
+	}
+	if (!ev && (aip->won > 0 || gp->quantity <= 0 ||
+		    (aip->endTime > 0 && aip->endTime <= historyTime()))) {
+		printLog(stdout, "Auction %s: done, new price %s ignored\n", aip->auction, bidPriceStr);
+		return;
+	}
+	printLog(stdout, "Auction %s: new price %s (was %s)\n", aip->auction, bidPriceStr, aip->bidPriceStr);
+	free(aip->bidPriceStr);
+	aip->bidPriceStr = myStrdup(bidPriceStr);
+	aip->bidPrice = atof(aip->bidPriceStr);
+	if (!ev) {
+		resetAuctionError(aip);
+		(void)watchAuction(aip);
+	} else if (aip->biduiid || ev->type == EVENT_FIRE || ev->type == EVENT_PREBID) {
+		dropEvents(aip);
+		free(aip->biduiid);
+		aip->biduiid = NULL;
+		resetAuctionError(aip);
+		addEvent(getMonotonicTime(), EVENT_PREBID, aip);
+	}
+}
+
+/*
+ * Compare a group with its auction file: watch new auctions, change the
+ * price of auctions whose price changed, and stop watching auctions no
+ * longer listed.  Other auctions are not touched.
+ *
+ * returns 0 on success, 1 if the auction file cannot be read.
+ */
+int
+reloadAuctionGroup(auctionGroup_t *gp)
+{
+	auctionInfo **auctions = NULL;
+	int numAuctions, i, j, changes = 0;
+
+	printLog(stdout, "\n%s: Reloading %s\n", timestamp(), gp->name);
+	numAuctions = readAuctionFile(gp->name, &auctions);
+	for (i = 0; i < numAuctions; ++i) {
+		if (!auctions[i]->bidPriceStr) {
+			printLog(stderr, "Auction %s: invalid price\n", auctions[i]->auction);
+			break;
+		}
+	}
+	if (numAuctions <= 0 || i < numAuctions) {
+		printLog(stderr, "Cannot read %s, auctions not changed\n", gp->name);
+		for (i = 0; i < numAuctions; ++i)
+			freeAuction(auctions[i]);
+		free(auctions);
+		return 1;
+	}
+
+	/* removed auctions */
+	for (i = gp->numAuctions - 1; i >= 0; --i) {
+		for (j = 0; j < numAuctions; ++j) {
+			if (!strcmp(gp->auctions[i]->auction, auctions[j]->auction))
+				break;
+		}
+		if (j == numAuctions)
+			changes += retireAuction(gp, i);
+	}
+
+	/* new and repriced auctions */
+	for (j = 0; j < numAuctions; ++j) {
+		auctionInfo *aip = auctions[j];
+
+		for (i = 0; i < gp->numAuctions; ++i) {
+			if (!strcmp(gp->auctions[i]->auction, aip->auction))
+				break;
+		}
+		if (i < gp->numAuctions) {
+			if (strcmp(gp->auctions[i]->bidPriceStr, aip->bidPriceStr)) {
+				repriceAuction(gp->auctions[i], aip->bidPriceStr);
+				++changes;
+			}
+			continue;
+		}
+		printLog(stdout, "Auction %s: added, price %s\n", aip->auction, aip->bidPriceStr);
+		gp->auctions = (auctionInfo **)myRealloc(gp->auctions, (size_t)(gp->numAuctions + 1) * sizeof(auctionInfo *));
+		gp->auctions[gp->numAuctions++] = aip;
+		aip->group = gp;
+		auctions[j] = NULL;
+		(void)watchAuction(aip);
+		++changes;
+	}
+	for (j = 0; j < numAuctions; ++j) {
+		if (auctions[j])
+			freeAuction(auctions[j]);
+	}
+	free(auctions);
+
+	if (changes == 0)
+		printLog(stdout, "No changes\n");
+	else if (gp->active > 0 && gp->quantity > 0)
+		printRemain(gp->quantity, gp->active);
+	return 0;
+}
+
+/*
+ * fileChangedFunc of a group's auction file.  path is the group's
+ * name, which reloadAuctionGroup() reads the file from.
+ */
+static void
+groupFileChanged(const char *path, void *data)
+{
+	(void)reloadAuctionGroup((auctionGroup_t *)data);
+}
+
+/*
+ * Handle events until there are none left.  Each auction has one pending
+ * event (see scheduler.h), which is handled when it is due.
+ *
+ * Polls, bid keys and result checks send their request on eventBatch
+ * and go on in its done function, so that many of them are in flight
+ * at once, and a bid key or result check may preempt a poll (see
+ * runHttpBatch()).  Requests in flight are run until the next event is
+ * due, and are given until CONNECT_LEAD + 1 seconds before a bid to
+ * finish; those still running then wait until the bids are sent.
+ *
+ * idle (may be NULL) is called while waiting for the next event, with
+ * the time it is due (monotonic clock, 0 if there is none), or every
+ * BATCH_SLICE seconds with the current time while requests are in
+ * flight.  It is not called within FIRE_GUARD seconds of a bid.  idle
+ * returns 1 to stop, 0 to go on, and may add or remove events.
+ */
+void
+runAuctionEvents(int (*idle)(double until))
+{
+	event_t ev;
+	unsigned long announced = ULONG_MAX;
+	eventRequest_t *rp;
+
+	/* load schemas here, parser threads only read them */
+	(void)getSchema("ViewBids");
+	eventBatch = newHttpBatch(options.fetchConnections);
+	for (;;) {
+		const event_t *next;
+		auctionInfo *aip;
+		double now, until, fire;
+		int ret = 0;
+
+		scheduleSession();
+		now = getMonotonicTime();
+		next = peekEvent();
+		until = next ? next->time : 0;
+		fire = getNextEventTime(EVENT_FIRE);
+		if (fire > 0 && fire - FIRE_GUARD < until)
+			until = fire - FIRE_GUARD;
+		if (httpBatchBusy(eventBatch) && (!next || until > now)) {
+			double slice = now + BATCH_SLICE;
+
+			(void)runHttpBatchUntil(eventBatch, next && until < slice ? until : slice);
+			now = getMonotonicTime();
+			if (idle && (fire <= 0 || now < fire - FIRE_GUARD) &&
+			    (*idle)(now))
+				break;
+			continue;
+		}
+		if (idle) {
+			if (!next || until > now) {
+				/* announce each wait for an event once */
+				if (next && next->seq != announced &&
+				    next->type != EVENT_FIRE &&
+				    next->type != EVENT_SESSION &&
+				    next->aip->limit.since <= 0 && next->time - now >= 1) {
+					announced = next->seq;
+					useLog(next->aip);
+					log(("next event: %s of auction %s in %.3f seconds, %d event(s) pending\n", eventName(next->type), next->aip->auction, next->time - now, eventCount()));
+					printSleep(next->time - now);
+				}
+				if ((*idle)(until))
+					break;
+				continue;
+			}
+		}
+		if (!nextEvent(&ev))
+			break;
+		aip = ev.aip;
+
+		/* not within SESSION_GUARD of a bid, see sessionDue() */
+		if (ev.type == EVENT_SESSION) {
+			account_t *ap = sessionAccount(aip);
+
+			if (ev.time > now) {
+				if (ev.time - now >= 1)
+					printSleep(ev.time - now);
+				fireAt(ev.time);
+			}
+			useAccount(ap);
+			if (!limitEvent(&ev, &ap->sessionLimit))
+				sessionEvent();
+			continue;
+		}
+
+		/* enough won, only wait for results of bids placed */
+		if (aip->group->quantity <= 0 && ev.type != EVENT_RESULT) {
+			auctionDone(aip);
+			continue;
+		}
+
+		/*
+		 * Requests compete with bids, don't start one when a bid
+		 * is due.
+		 */
+		if (ev.type != EVENT_FIRE) {
+			double fire = getNextEventTime(EVENT_FIRE);
+
+			if (fire > 0 && fire >= ev.time &&
+			    fire - (ev.time > now ? ev.time : now) < FIRE_GUARD) {
+				log(("postponing %s of auction %s until after bid", eventName(ev.type), aip->auction));
+				addEvent(fire, ev.type, aip);
+				continue;
+			}
+		}
+
+		useLog(aip);
+		if (ev.type == EVENT_FIRE) {
+			/* let requests in flight finish, see above */
+			if (httpBatchBusy(eventBatch))
+				(void)runHttpBatchUntil(eventBatch, ev.time - CONNECT_LEAD - 1);
+			fireEvents(&ev);
+			continue;
+		}
+		if (ev.time > now) {
+			log(("next event: %s of auction %s in %.3f seconds, %d event(s) pending\n", eventName(ev.type), aip->auction, ev.time - now, eventCount() + 1));
+			if (ev.time - now >= 1)
+				printSleep(ev.time - now);
+			fireAt(ev.time);
+		}
+		if (limitEvent(&ev, &aip->limit))
+			continue;
+
+		switch (ev.type) {
+		case EVENT_POLL:
+		case EVENT_RESULT:
+			infoEvent(&ev);
+			break;
+		case EVENT_LOGIN:
+			ret = loginEvent(aip);
+			break;
+		case EVENT_PREBID:
+			prebidEvent(&ev);
+			break;
+		case EVENT_FIRE:
+		case EVENT_SESSION:
+			break;
+		}
+		if (ret)
+			auctionFailed(aip);
+	}
+	/* results of requests still in flight are not needed */
+	for (rp = eventRequests; rp; rp = rp->next)
+		rp->ev.aip = NULL;
+	(void)runHttpBatch(eventBatch);
+	freeHttpBatch(eventBatch);
+	eventBatch = NULL;
+	if (options.rehearsalHost)
+		printRehearsal(stdout);
+	if (requestsDelayed())
+		printRequestStats(stdout);
+}
+
+/*
+ * Host and class of the request an event makes, NULL if it doesn't
+ * wait for the request limit (see ratelimit.h).  Logins before bidding
+ * are rare, sessions are renewed ahead (see sessionEvent()).
+ */
+static host_t *
+eventHost(eventType_t type, requestClass_t *rcp)
+{
+	switch (type) {
+	case EVENT_POLL:
+		*rcp = REQUEST_POLL;
+		return getHost(options.historyHost);
+	case EVENT_RESULT:
+		*rcp = REQUEST_CONFIRM;
+		return getHost(options.historyHost);
+	case EVENT_PREBID:
+		*rcp = REQUEST_BIDKEY;
+		return getHost(options.prebidHost);
+	case EVENT_SESSION:
+		*rcp = REQUEST_BIDKEY;
+		return getHost(options.loginHost);
+	default:
+		return NULL;
+	}
+}
+
+/*
+ * limitEvent(): put event back if its request has to wait for the
+ * request limit.
+ *
+ * returns 1 if it was put back, 0 if it may run now.
+ */
+static int
+limitEvent(const event_t *ev, requestWait_t *wp)
+{
+	requestClass_t rc;
+	host_t *hp = eventHost(ev->type, &rc);
+	double wait;
+
+	if (!hp || (wait = admitRequest(hp, rc, wp)) <= 0)
+		return 0;
+	log(("request limit: %s of auction %s waits %.1f seconds, %d request(s) of its class waiting", eventName(ev->type), ev->aip ? ev->aip->auction : "-", wait, requestsWaiting(rc)));
+	addEvent(getMonotonicTime() + wait, ev->type, ev->aip);
+	return 1;
+}
+
+/*
+ * Idle function of snipeAuctions(): wait for the next event, reloading
+ * the auction file when it changes.
+ */
+static int
+reloadWait(double until)
+{
+	if (!peekEvent() && !eventRequests)
+		return 1;
+	(void)waitFileWatch(until, -1);
+	return 0;
+}
+
+/*
+ * Watch all auctions at once and bid on them.
+ *
+ * parameters:
+ * auctfilename	auction file, reloaded when it changes, NULL if none
+ * auctions	auctions to bid on, sorted by end time, freed
+ * numAuctions	number of auctions
+ *
+ * return number of items won
+ */
+int
+snipeAuctions(const char *auctfilename, auctionInfo **auctions, int numAuctions)
+{
+	auctionGroup_t *gp = newAuctionGroup(auctfilename, auctions, numAuctions, options.quantity);
+	int won;
+
+	watchAuctionGroup(gp);
+	runAuctionEvents(auctfilename ? reloadWait : NULL);
+	unwatchAuctionGroup(gp);
+	clearEvents();
+	won = gp->won;
+	options.quantity = gp->quantity;
+	freeAuctionGroup(gp);
 	return won;
 }
 
@@ -898,9 +2439,11 @@ snipeAuction(auctionInfo *aip)
 /*
  * On first call, use printNewline to 0.  On subsequent calls, use return
  * value from previous call.
+ *
+ * If fp is not NULL, the item is also written to it as an auction file entry.
  */
 static int
-printMyItemsRow(char **row, int printNewline)
+printMyItemsRow(char **row, int printNewline, FILE *fp)
 {
 	const char *myitems_description[MAX_TDS][MAX_TDS_LENGTH] = {
 		{0, 0, 0, 0, 0, 0, 0, 0},
@@ -915,6 +2458,7 @@ printMyItemsRow(char **row, int printNewline)
 	int column = 0;
 	int ret = printNewline;
 	int item_nr=0;	/* count no_tag item */
+	char *itemNr = NULL, *description = NULL, *timeLeft = NULL, *price = NULL;
 
 	for (; row[column]; ++column) {
 		memBuf_t buf;
@@ -932,9 +2476,8 @@ printMyItemsRow(char **row, int printNewline)
 					;
 				for (i = 1; isdigit(tmp[i]); ++i)
 					;
-				value = myStrndup(tmp, (size_t)(i));
-				printLog(stdout, "ItemNr:\t\t%s\n", value);
-				free(value);
+				itemNr = myStrndup(tmp, (size_t)(i));
+				printLog(stdout, "ItemNr:\t\t%s\n", itemNr);
 			}
 		}
 		strToMemBuf(row[column], &buf); /* load new row */
@@ -947,67 +2490,251 @@ printMyItemsRow(char **row, int printNewline)
 			/* when nothing interesting in row */
 			if (column >= MAX_TDS || !myitems_description[column][item_nr])
 				continue;
+			/* remember what goes into the auction file */
+			if (item_nr == 0 && value) {
+				if (column == 2 && !description)
+					description = myStrdup(value);
+				else if (column == 3 && !timeLeft)
+					timeLeft = myStrdup(value);
+				else if (column == 4 && !price)
+					price = myStrdup(value);
+			}
 			/* print the entry */
 			printLog(stdout, myitems_description[column][item_nr], value ? value : "");
 		}
+		free(buf.memory);
 	}
 	printf("\n");	/* for spacing */
+
+	if (fp && itemNr) {
+		fprintf(fp, "# %s (time left: %s)\n", nullStr(description),
+			nullStr(timeLeft));
+		if (price && *priceFixup(price, NULL))
+			fprintf(fp, "%s %s\n", itemNr, price);
+		else
+			fprintf(fp, "#%s (price not found)\n", itemNr);
+	}
+	free(itemNr);
+	free(description);
+	free(timeLeft);
+	free(price);
 	return ret;
 }
 
 static const char MYITEMS_URL[] = "http://%s/ws/eBayISAPI.dll?MyeBay&CurrentPage=MyeBayWatching";
+static const char MYITEMS_PAGE_URL[] = "http://%s/ws/eBayISAPI.dll?MyeBay&CurrentPage=MyeBayWatching&pageNumber=%d";
+
+/* number of watch list pages fetched in parallel */
+#define MYITEMS_CONNECTIONS 4
+/* sanity limit on number of watch list pages */
+#define MYITEMS_MAX_PAGES 100
+
+typedef struct myItemsPage myItemsPage_t;
+
+/* state shared by all watch list pages */
+typedef struct {
+	httpBatch_t *batch;
+	FILE *fp;		/* auction file, or NULL */
+	int printNewline;
+	int items;
+	int nextPage;		/* page printed now, later ones wait */
+	myItemsPage_t *pages[MYITEMS_MAX_PAGES + 1];
+} myItems_t;
+
+/* state of a single watch list page */
+struct myItemsPage {
+	myItems_t *myItems;
+	int page;
+	tableStream_t table;
+	char ***rows;		/* rows waiting for earlier pages */
+	int nrows;
+	int done;
+};
+
+/* search for table containing my items, skip descriptive row */
+static void
+initMyItemsTable(myItemsPage_t *pp)
+{
+	initTableStream(&pp->table, "class=\"my_itl-iT\"", 1);
+}
+
+static void
+queueMyItemsPage(myItems_t *mip, int page)
+{
+	myItemsPage_t *pp = (myItemsPage_t *)myMalloc(sizeof(myItemsPage_t));
+	size_t urlLen = sizeof(MYITEMS_PAGE_URL) + strlen(options.myeBayHost) + 12 - (2*2);
+	char *url = (char *)myMalloc(urlLen);
+
+	if (page == 1)
+		sprintf(url, MYITEMS_URL, options.myeBayHost);
+	else
+		sprintf(url, MYITEMS_PAGE_URL, options.myeBayHost, page);
+	pp->myItems = mip;
+	pp->page = page;
+	pp->rows = NULL;
+	pp->nrows = 0;
+	pp->done = 0;
+	mip->pages[page] = pp;
+	initMyItemsTable(pp);
+	httpBatchGet(mip->batch, url, myItemsData, myItemsDone, pp);
+	free(url);
+}
+
+static void
+printMyItemsPageRow(myItems_t *mip, char **row)
+{
+	mip->printNewline = printMyItemsRow(row, mip->printNewline, mip->fp);
+	++mip->items;
+	freeTableRow(row);
+}
+
+/*
+ * Print the rows that waited, and go on with the next page while pages
+ * are complete.
+ */
+static void
+flushMyItemsPages(myItems_t *mip)
+{
+	myItemsPage_t *pp;
+	int i;
+
+	while (mip->nextPage <= MYITEMS_MAX_PAGES &&
+	       (pp = mip->pages[mip->nextPage])) {
+		for (i = 0; i < pp->nrows; ++i)
+			printMyItemsPageRow(mip, pp->rows[i]);
+		free(pp->rows);
+		pp->rows = NULL;
+		pp->nrows = 0;
+		if (!pp->done)
+			break;
+		mip->pages[mip->nextPage++] = NULL;
+		free(pp);
+	}
+}
+
+/*
+ * Print rows of a watch list page as soon as they arrive, if all earlier
+ * pages are printed.  Otherwise they wait, so that the output keeps
+ * watch list order.
+ */
+static void
+myItemsData(memBuf_t *mp, void *data)
+{
+	myItemsPage_t *pp = (myItemsPage_t *)data;
+	myItems_t *mip = pp->myItems;
+	char **row;
+
+	/* redirected, the new page starts over */
+	if (!mp) {
+		initMyItemsTable(pp);
+		return;
+	}
+	while ((row = getStreamTableRow(&pp->table, mp))) {
+		if (pp->page == mip->nextPage)
+			printMyItemsPageRow(mip, row);
+		else {
+			pp->rows = (char ***)myRealloc(pp->rows, (size_t)(pp->nrows + 1) * sizeof(char **));
+			pp->rows[pp->nrows++] = row;
+		}
+	}
+}
+
+/*
+ * Watch list page complete.  The first page tells us how many
+ * more pages there are, fetch them all at once.
+ */
+static void
+myItemsDone(memBuf_t *mp, void *data)
+{
+	myItemsPage_t *pp = (myItemsPage_t *)data;
+
+	if (mp) {
+		myItemsData(mp, data);
+		if (pp->page == 1) {
+			int page, pages = getMyItemsPageCount(mp);
+
+			log(("printMyItems(): %d page(s)\n", pages));
+			for (page = 2; page <= pages; ++page)
+				queueMyItemsPage(pp->myItems, page);
+		}
+	} else
+		printLog(stderr, "Cannot get page %d of watch list\n", pp->page);
+	pp->done = 1;
+	flushMyItemsPages(pp->myItems);
+}
+
+/*
+ * Get number of pages from "Page 1 of N" text, 1 if not found.
+ */
+static int
+getMyItemsPageCount(memBuf_t *mp)
+{
+	char *line;
+	int page, pages = 1;
+
+	memReset(mp);
+	while ((line = getNonTag(mp))) {
+		if (sscanf(line, "Page %d of %d", &page, &pages) == 2)
+			break;
+	}
+	memReset(mp);
+	if (pages < 1)
+		pages = 1;
+	else if (pages > MYITEMS_MAX_PAGES)
+		pages = MYITEMS_MAX_PAGES;
+	return pages;
+}
 
 /*
+ * Print all items on watch list, optionally writing them to
+ * auction file options.myitemsFile.
+ *
  * TODO: allow user configuration of myItems.
  */
 int
 printMyItems(void)
 {
-	memBuf_t *mp = NULL;
-	const char *table;
-	char **row;
+	myItems_t myItems;
 	auctionInfo *dummy = newAuctionInfo("0", "0");
-	char *url;
-	size_t urlLen;
+	int ret = 0;
 
 	if (ebayLogin(dummy, 0)) {
 		printAuctionError(dummy, stderr);
 		freeAuction(dummy);
 		return 1;
 	}
-	urlLen = sizeof(MYITEMS_URL) + strlen(options.myeBayHost) - (1*2);
-	url = (char *)myMalloc(urlLen);
-	sprintf(url, MYITEMS_URL, options.myeBayHost);
-	mp = httpGet(url, NULL);
-	free(url);
-	if (!mp) {
-		httpError(dummy);
-		printAuctionError(dummy, stderr);
-		freeAuction(dummy);
-		freeMembuf(mp);
-		return 1;
-	}
-	while ((table = getTableStart(mp))) {
-		int printNewline = 0;
-
-		/* search for table containing my itmes */
-		if (!strstr(table, "class=\"my_itl-iT\""))
-			continue;
-		/* skip first descriptive table row */
-		if ((row = getTableRow(mp)))
-			freeTableRow(row);
-		else {
+	myItems.fp = NULL;
+	myItems.printNewline = 0;
+	myItems.items = 0;
+	myItems.nextPage = 1;
+	memset(myItems.pages, 0, sizeof(myItems.pages));
+	if (options.myitemsFile) {
+		if (!(myItems.fp = fopen(options.myitemsFile, "w"))) {
+			printLog(stderr, "Cannot create auction file %s: %s\n",
+				 options.myitemsFile, strerror(errno));
 			freeAuction(dummy);
-			return 0; /* error? */
-		}
-		while ((row = getTableRow(mp))) {
-			printNewline = printMyItemsRow(row, printNewline);
-			freeTableRow(row);
+			return 1;
 		}
+		fprintf(myItems.fp,
+			"# Watch list of %s, %s\n"
+			"# Prices are current prices, change them to your maximum bids.\n",
+			options.username, timestamp());
+	}
+
+	myItems.batch = newHttpBatch(MYITEMS_CONNECTIONS);
+	httpBatchClass(myItems.batch, REQUEST_MYITEMS);
+	queueMyItemsPage(&myItems, 1);
+	if (runHttpBatch(myItems.batch))
+		ret = 1;
+	freeHttpBatch(myItems.batch);
+
+	if (myItems.fp) {
+		fclose(myItems.fp);
+		printLog(stdout, "%d item(s) written to %s\n", myItems.items,
+			 options.myitemsFile);
 	}
 	freeAuction(dummy);
-	freeMembuf(mp);
-	return 0;
+	return ret;
 }
 
 /* secret option - test parser */
@@ -1106,5 +2833,9 @@ testParser(int flag)
 		printAuctionError(aip, stdout);
 		break;
 		}
+	case 6:
+		/* mailbox benchmark, input is ignored */
+		benchMailbox();
+		break;
 	}
 }
@@ -31,8 +31,39 @@
 #include "esniper.h"
 #include "http.h"
 
+/*
+ * Auctions bid on together: those of one auction file, or of the command
+ * line.  quantity items are wanted from all of them.
+ */
+typedef struct auctionGroup {
+	char *name;		/* auction file, NULL for the command line */
+	auctionInfo **auctions;
+	int numAuctions;
+	int quantity;		/* items still wanted */
+	int committed;		/* items bid on, result not known yet */
+	int active;		/* auctions not done yet */
+	int won;		/* items won */
+	struct account *account;/* bid for this account (see account.h) */
+	struct auctionGroup *next;
+} auctionGroup_t;
+
 extern int getInfo(auctionInfo *aip);
-extern int snipeAuction(auctionInfo *aip);
+/*
+ * Get info on several auctions at once, ret[i] is getInfo()'s result
+ * for auctions[i], or -1 if it wasn't fetched.
+ */
+extern void getInfoParallel(auctionInfo **auctions, int numAuctions, int *ret);
+extern int snipeAuctions(const char *auctfilename, auctionInfo **auctions, int numAuctions);
+
+/* group takes over auctions, bids for the current account */
+extern auctionGroup_t *newAuctionGroup(const char *name, auctionInfo **auctions, int numAuctions, int quantity);
+extern void freeAuctionGroup(auctionGroup_t *gp);
+extern void watchAuctionGroup(auctionGroup_t *gp);
+extern void unwatchAuctionGroup(auctionGroup_t *gp);
+/* apply changes of a group's auction file, returns 0 on success */
+extern int reloadAuctionGroup(auctionGroup_t *gp);
+extern void printAuctionGroup(const auctionGroup_t *gp, FILE *fp);
+extern void runAuctionEvents(int (*idle)(double until));
 extern int printMyItems(void);
 
 typedef struct {
@@ -27,6 +27,8 @@
 #include "auctioninfo.h"
 #include "esniper.h"
 #include "auction.h"
+#include "host.h"
+#include "journal.h"
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
@@ -268,12 +270,24 @@ newAuctionInfo(const char *auction, const char *bidPriceStr)
 	aip->remainRaw = NULL;
 	aip->endTime = 0;
 	aip->latency = 0;
+	aip->fireTime = 0;
 	aip->query = NULL;
 	aip->biduiid = NULL;
 	aip->quantity = 0;
 	aip->quantityBid = 0;
 	aip->bids = 0;
 	aip->price = 0;
+	aip->lastBids = -1;
+	aip->lastPrice = 0;
+	aip->lastPollTime = 0;
+	aip->nextPoll = 0;
+	aip->limit.since = 0;
+	aip->limit.rc = REQUEST_POLL;
+	aip->activity = 0;
+	aip->pollErrors = 0;
+	aip->committed = 0;
+	aip->resultPolls = 0;
+	aip->group = NULL;
 	aip->shipping = NULL;
 	aip->currency = NULL;
 	aip->bidResult = -1;
@@ -290,6 +304,7 @@ freeAuction(auctionInfo *aip)
 {
 	if (!aip)
 		return;
+	cancelRequest(&aip->limit);
 	free(aip->auction);
 	free(aip->title);
 	free(aip->bidPriceStr);
@@ -462,36 +477,73 @@ getIncrements(const auctionInfo *aip)
  *
  * 1. current status (i.e. you already placed a bid and are winning)
  * 2. end time.
+ *
+ * Auctions with recent state in the journal (see journal.h) are not
+ * fetched.  The others are fetched in parallel (see getInfoParallel()),
+ * unless fetchConnections is 1, then one by one, options.delay seconds
+ * apart.  Failed ones are retried one by one.
  */
 int
 sortAuctions(auctionInfo **auctions, int numAuctions, int *quantity)
 {
-	int i, sawError = 0;
+	auctionInfo **fetch = (auctionInfo **)myMalloc((size_t)(numAuctions + 1) * sizeof(auctionInfo *));
+	int *fetched = (int *)myMalloc((size_t)(numAuctions + 1) * sizeof(int));
+	int i, numFetch = 0, sawError = 0;
 
 	for (i = 0; i < numAuctions; ++i) {
+		if (options.debug)
+			logOpen(auctions[i], options.logdir);
+		if (!options.info && restoreAuction(auctions[i])) {
+			printLog(stdout, "Auction %s: %s, saved state\n",
+				 auctions[i]->auction, nullStr(auctions[i]->title));
+			continue;
+		}
+		fetched[numFetch] = -1;
+		fetch[numFetch++] = auctions[i];
+	}
+	if (options.fetchConnections > 1 && numFetch > 1)
+		getInfoParallel(fetch, numFetch, fetched);
+
+	for (i = 0; i < numFetch; ++i) {
+		auctionInfo *aip = fetch[i];
 		int j;
 
+		if (fetched[i] == 0) {
+			journalAuction(aip);
+			continue;
+		}
 		if (options.debug)
-			logOpen(auctions[i], options.logdir);
+			logOpen(aip, options.logdir);
 		for (j = 0; j < 3; ++j) {
-			if (j > 0)
-				printLog(stderr, "Retrying...\n");
-			/* delay to avoid ebay's "security measure" */
-			if(options.delay > 0)
-				sleep(options.delay);
-			if (!getInfo(auctions[i]))
-				break;
-			printAuctionError(auctions[i], stderr);
-			if (auctions[i]->auctionError == ae_unavailable) {
+			/* a failed parallel fetch counts as an attempt */
+			if (j > 0 || fetched[i] < 0) {
+				if (j > 0)
+					printLog(stderr, "Retrying...\n");
+				/* delay to avoid ebay's "security measure" */
+				if(options.delay > 0)
+					sleep(options.delay);
+				if (!getInfo(aip)) {
+					journalAuction(aip);
+					break;
+				}
+			}
+			printAuctionError(aip, stderr);
+			if (aip->auctionError == ae_unavailable) {
 				--j;	/* doesn't count as an attempt */
+				fetched[i] = -1;
 				printLog(stderr, "%s: Will retry, sleeping for an hour\n", timestamp());
 				sleep(3600);
-			} else if (auctions[i]->auctionError == ae_login ||
-				   auctions[i]->auctionError == ae_captcha)
+			} else if (aip->auctionError == ae_login ||
+				   aip->auctionError == ae_captcha) {
+				free(fetch);
+				free(fetched);
 				return 0;
+			}
 		}
 		printLog(stdout, "\n");
 	}
+	free(fetch);
+	free(fetched);
 	if (numAuctions > 1) {
 		printLog(stdout, "Sorting auctions...\n");
 		/* sort by status and end time */
@@ -509,7 +561,7 @@ sortAuctions(auctionInfo **auctions, int numAuctions, int *quantity)
 		else if (aip->won > 0)
 			*quantity -= aip->won;
 		else if (aip->auctionError != ae_none ||
-			 aip->endTime <= time(NULL))
+			 aip->endTime <= historyTime())
 			;
 		else if (!isValidBidPrice(aip))
 			(void)auctionError(aip, ae_bidprice, NULL);
@@ -533,3 +585,49 @@ sortAuctions(auctionInfo **auctions, int numAuctions, int *quantity)
 	}
 	return numAuctions;
 } /* sortAuctions() */
+
+/*
+ * Like sortAuctions(), but nothing is fetched, for auctions added while
+ * others are watched.  Only state from the journal is restored, the
+ * other auctions are fetched by their first poll event, which waits for
+ * the request limit like any other.  Auctions are sorted as by
+ * sortAuctions(), those not fetched yet count as ending now.
+ */
+int
+prepareAuctions(auctionInfo **auctions, int numAuctions, int *quantity)
+{
+	int i, j, n = 0;
+
+	for (i = 0; i < numAuctions; ++i) {
+		auctionInfo *aip = auctions[i];
+
+		if (options.debug)
+			logOpen(aip, options.logdir);
+		for (j = 0; j < n; ++j) {
+			if (!strcmp(auctions[j]->auction, aip->auction))
+				break;
+		}
+		if (j < n)
+			(void)auctionError(aip, ae_duplicate, NULL);
+		else if (!aip->bidPriceStr)
+			(void)auctionError(aip, ae_bidprice, NULL);
+		else if (!restoreAuction(aip)) {
+			auctions[n++] = aip;
+			continue;
+		} else {
+			printLog(stdout, "Auction %s: %s, saved state\n",
+				 aip->auction, nullStr(aip->title));
+			if (aip->won > 0)
+				*quantity -= aip->won;
+			else if (aip->endTime > historyTime()) {
+				auctions[n++] = aip;
+				continue;
+			}
+		}
+		printAuctionError(aip, stderr);
+		freeAuction(aip);
+	}
+	if (n > 1)
+		qsort(auctions, (size_t)n, sizeof(auctionInfo *), compareAuctionInfo);
+	return n;
+}
@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <time.h>
+#include "ratelimit.h"
 
 /*
  * errors from parseError(), getAuctionInfo(), watchAuction()
@@ -72,6 +73,8 @@ enum auctionErrorCode {
 	ae_unknown
 };
 
+struct auctionGroup;
+
 /*
  * All information associated with an auction
  */
@@ -83,13 +86,24 @@ typedef struct {
 	time_t remain;	/* remaining seconds */
 	char *remainRaw;/* remaining time string, from ebay */
 	time_t endTime;	/* end time as calculated from remaining seconds */
-	time_t latency; /* latency from HTTP request to first page data */
+	double latency; /* bid lead time, seconds (see host.h) */
+	double fireTime;/* planned time of bid (monotonic clock), 0 if none */
 	char *query;	/* bid history query */
 	char *biduiid;	/* bid uiid */
 	int quantity;	/* number of items available */
 	int quantityBid;/* number of items currently bid on */
 	int bids;	/* number of bids made */
 	double price;	/* current price */
+	int lastBids;	/* number of bids at last poll, -1 if not polled */
+	double lastPrice;/* price at last poll */
+	double lastPollTime;/* time of last poll (monotonic clock), 0 if none */
+	double nextPoll;/* first poll after restart (monotonic clock), 0 = now */
+	requestWait_t limit;/* waiting for request limit (see ratelimit.h) */
+	double activity;/* bids per hour, average (see polling.h) */
+	int pollErrors;	/* failed polls */
+	int committed;	/* quantity bid on, result not known yet */
+	int resultPolls;/* checks for the result of a bid */
+	struct auctionGroup *group;/* auctions bid on together (see auction.h) */
 	char *shipping;	/* shipping cost */
 	char *currency;	/* currency used in auction */
 	int bidResult;	/* result code from bid (-1=no bid yet, 0=success, 1 = error) */
@@ -109,5 +123,6 @@ extern int auctionError(auctionInfo *aip, enum auctionErrorCode pe,
 			const char *details);
 extern int isValidBidPrice(const auctionInfo *aip);
 extern int sortAuctions(auctionInfo **auctions, int numAuctions, int *quantity);
+extern int prepareAuctions(auctionInfo **auctions, int numAuctions, int *quantity);
 
 #endif /* AUCTIONINFO_H_INCLUDED */
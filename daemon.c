@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "daemon.h"
+#include "account.h"
+#include "auction.h"
+#include "auctionfile.h"
+#include "esniper.h"
+#include "filewatch.h"
+#include "options.h"
+#include "ratelimit.h"
+#include "util.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(WIN32)
+
+int
+runDaemon(const char *path)
+{
+	printLog(stderr, "Daemon mode is not supported on this platform.\n");
+	return 1;
+}
+
+int
+controlClient(const char *path, int argc, char *argv[])
+{
+	return runDaemon(path);
+}
+
+#else
+
+#include <limits.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* longest command line, and time to wait for it, seconds */
+#define MAX_COMMAND 4096
+#define COMMAND_TIMEOUT 5
+
+static int listenFd = -1;
+static auctionGroup_t *groups = NULL;
+
+static int controlWait(double until);
+static int handleCommand(int fd);
+static int readCommand(int fd, char *buf, size_t size);
+static void addGroup(FILE *fp, const char *name);
+static void removeGroup(FILE *fp, const char *name);
+static auctionGroup_t **findGroup(const char *name);
+static int IgnoreValue(const void *valueptr, const optionTable_t *tableptr,
+		       const char *filename, const char *line);
+
+static int
+setAddress(struct sockaddr_un *sa, const char *path)
+{
+	if (strlen(path) >= sizeof(sa->sun_path)) {
+		printLog(stderr, "Socket name too long: %s\n", path);
+		return 1;
+	}
+	memset(sa, 0, sizeof(*sa));
+	sa->sun_family = AF_UNIX;
+	strcpy(sa->sun_path, path);
+	return 0;
+}
+
+int
+runDaemon(const char *path)
+{
+	struct sockaddr_un sa;
+	mode_t mask;
+	int fd;
+
+	if (setAddress(&sa, path))
+		return 1;
+	/* another daemon running? */
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		printLog(stderr, "Cannot create socket: %s\n", strerror(errno));
+		return 1;
+	}
+	if (!connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		printLog(stderr, "Daemon already running on %s\n", path);
+		close(fd);
+		return 1;
+	}
+	(void)unlink(path);
+	mask = umask(077);
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, 5)) {
+		printLog(stderr, "Cannot listen on %s: %s\n", path, strerror(errno));
+		umask(mask);
+		close(fd);
+		return 1;
+	}
+	umask(mask);
+	listenFd = fd;
+	printLog(stdout, "%s: Daemon listening on %s\n", timestamp(), path);
+
+	runAuctionEvents(controlWait);
+
+	while (groups) {
+		auctionGroup_t *gp = groups;
+
+		groups = gp->next;
+		unwatchAuctionGroup(gp);
+		freeAuctionGroup(gp);
+	}
+	close(listenFd);
+	listenFd = -1;
+	(void)unlink(path);
+	printLog(stdout, "%s: Daemon stopped\n", timestamp());
+	return 0;
+}
+
+/*
+ * Wait for control commands until monotonic time until (0 = forever).
+ * Handles at most one command, since it may change the events.  Changed
+ * auction files are reloaded meanwhile.
+ *
+ * returns 1 if daemon should stop, else 0.
+ */
+static int
+controlWait(double until)
+{
+	for (;;) {
+		int fd, ret = waitFileWatch(until, listenFd);
+
+		if (ret <= 0)
+			return ret < 0;
+		if ((fd = accept(listenFd, NULL, NULL)) < 0)
+			continue;
+		ret = handleCommand(fd);
+		close(fd);
+		return ret;
+	}
+}
+
+/*
+ * Read command line from fd.
+ *
+ * returns 0 on success, 1 on failure.
+ */
+static int
+readCommand(int fd, char *buf, size_t size)
+{
+	struct timeval tv;
+	size_t count = 0;
+
+	tv.tv_sec = COMMAND_TIMEOUT;
+	tv.tv_usec = 0;
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	while (count < size - 1) {
+		ssize_t n = read(fd, &buf[count], 1);
+
+		if (n <= 0)
+			return 1;
+		if (buf[count] == '\n')
+			break;
+		++count;
+	}
+	buf[count] = '\0';
+	return 0;
+}
+
+/*
+ * Handle a command, write reply to fd.
+ *
+ * returns 1 if daemon should stop, else 0.
+ */
+static int
+handleCommand(int fd)
+{
+	char buf[MAX_COMMAND];
+	char *arg;
+	FILE *fp;
+	int ret = 0;
+
+	if (readCommand(fd, buf, sizeof(buf)) || !(fp = fdopen(dup(fd), "w")))
+		return 0;
+	if ((arg = strchr(buf, ' ')))
+		*arg++ = '\0';
+	log(("control command: %s %s", buf, nullStr(arg)));
+
+	if (!strcmp(buf, "add") && arg)
+		addGroup(fp, arg);
+	else if (!strcmp(buf, "remove") && arg)
+		removeGroup(fp, arg);
+	else if (!strcmp(buf, "status")) {
+		auctionGroup_t **gpp = arg ? findGroup(arg) : NULL;
+
+		if (arg && !*gpp)
+			fprintf(fp, "ERROR: %s not found\n", arg);
+		else {
+			auctionGroup_t *gp;
+
+			fprintf(fp, "OK\n");
+			for (gp = arg ? *gpp : groups; gp; gp = arg ? NULL : gp->next)
+				printAuctionGroup(gp, fp);
+			if (!arg)
+				printRequestStats(fp);
+		}
+	} else if (!strcmp(buf, "kill")) {
+		fprintf(fp, "OK: stopping\n");
+		ret = 1;
+	} else
+		fprintf(fp, "ERROR: unknown command \"%s\"\n", buf);
+	fclose(fp);
+	return ret;
+}
+
+static auctionGroup_t **
+findGroup(const char *name)
+{
+	auctionGroup_t **gpp;
+
+	for (gpp = &groups; *gpp; gpp = &(*gpp)->next) {
+		if (!strcmp((*gpp)->name, name))
+			break;
+	}
+	return gpp;
+}
+
+/* check function for "*" in groupOptions, other options are ignored */
+static int
+IgnoreValue(const void *valueptr, const optionTable_t *tableptr,
+	    const char *filename, const char *line)
+{
+	return 0;
+}
+
+/* check function for "password" in groupOptions, keeps it out of the log */
+static int
+GroupPassword(const void *valueptr, const optionTable_t *tableptr,
+	      const char *filename, const char *line)
+{
+	char **pw = (char **)tableptr->value;
+
+	if (!valueptr)
+		return 1;
+	free(*pw);
+	*pw = myStrdup((const char *)valueptr);
+	return 0;
+}
+
+/*
+ * Read auction file and start watching its auctions, bidding for the
+ * account of its username option, or the first account.
+ */
+static void
+addGroup(FILE *fp, const char *name)
+{
+	auctionInfo **auctions = NULL;
+	auctionGroup_t *gp;
+	int numAuctions, quantity = options.quantity, wanted, ok;
+	char *ignored = NULL, *username = NULL, *password = NULL;
+	account_t *ap = NULL;
+	optionTable_t groupOptions[] = {
+		{"quantity", NULL, (void*)&quantity, OPTION_INT, LOG_NORMAL, NULL, 0},
+		{"username", NULL, (void*)&username, OPTION_STRING, LOG_NORMAL, NULL, 0},
+		{"password", NULL, (void*)&password, OPTION_SPECSTR, LOG_CONFID, &GroupPassword, 0},
+		{"*",        NULL, (void*)&ignored,  OPTION_STRING, LOG_NORMAL, &IgnoreValue, 0},
+		{NULL, NULL, NULL, 0, 0, NULL, 0}
+	};
+
+	if (*findGroup(name)) {
+		fprintf(fp, "ERROR: %s already added\n", name);
+		return;
+	}
+	ok = (numAuctions = readAuctionFile(name, &auctions)) > 0 &&
+	     readConfigFile(name, groupOptions) <= 1 && quantity >= 1;
+	if (ok && username && !(ap = getAccount(username, password))) {
+		fprintf(fp, "ERROR: %s: no password for %s\n", name, username);
+		ok = 0;
+	} else if (!ok)
+		fprintf(fp, "ERROR: cannot read %s\n", name);
+	free(username);
+	if (password) {
+		memset(password, '\0', strlen(password));
+		free(password);
+	}
+	if (!ok) {
+		if (numAuctions > 0) {
+			int i;
+
+			for (i = 0; i < numAuctions; ++i)
+				freeAuction(auctions[i]);
+			free(auctions);
+		}
+		return;
+	}
+	useAccount(ap);
+	printLog(stdout, "\n%s: Adding %s\n", timestamp(), name);
+	wanted = quantity;
+	/* other groups' bids may be due soon, nothing is fetched here */
+	numAuctions = prepareAuctions(auctions, numAuctions, &quantity);
+	if (quantity < wanted) {
+		printLog(stdout, "\nYou have already won %d item(s).\n", wanted - quantity);
+		if (!options.reduce)
+			quantity = wanted;
+	}
+	gp = newAuctionGroup(name, auctions, numAuctions, quantity);
+	gp->next = groups;
+	groups = gp;
+	watchAuctionGroup(gp);
+	useAccount(NULL);
+	fprintf(fp, "OK: %s: %d auction(s), %d item(s) wanted\n", name, gp->active, gp->quantity);
+}
+
+/*
+ * Stop watching the auctions of an auction file.
+ */
+static void
+removeGroup(FILE *fp, const char *name)
+{
+	auctionGroup_t **gpp = findGroup(name), *gp = *gpp;
+
+	if (!gp) {
+		fprintf(fp, "ERROR: %s not found\n", name);
+		return;
+	}
+	*gpp = gp->next;
+	unwatchAuctionGroup(gp);
+	freeAuctionGroup(gp);
+	printLog(stdout, "\n%s: Removed %s\n", timestamp(), name);
+	fprintf(fp, "OK: %s removed\n", name);
+}
+
+int
+controlClient(const char *path, int argc, char *argv[])
+{
+	struct sockaddr_un sa;
+	char buf[MAX_COMMAND];
+	size_t len = 0;
+	ssize_t n;
+	int fd, i, ret = 1, first = 1;
+
+	if (setAddress(&sa, path))
+		return 1;
+	buf[0] = '\0';
+	for (i = 0; i < argc; ++i) {
+		char resolved[PATH_MAX];
+		const char *arg = argv[i];
+
+		/* auction files are named by absolute path */
+		if (i > 0 && realpath(arg, resolved))
+			arg = resolved;
+		if (len + strlen(arg) + 2 >= sizeof(buf)) {
+			printLog(stderr, "Command too long\n");
+			return 1;
+		}
+		if (i > 0)
+			buf[len++] = ' ';
+		strcpy(&buf[len], arg);
+		len += strlen(arg);
+	}
+	buf[len++] = '\n';
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		printLog(stderr, "Cannot connect to daemon on %s: %s\n", path, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return 1;
+	}
+	if (write(fd, buf, len) != (ssize_t)len) {
+		printLog(stderr, "Cannot send command: %s\n", strerror(errno));
+		close(fd);
+		return 1;
+	}
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		if (first)
+			ret = strncmp(buf, "OK", 2) != 0;
+		first = 0;
+		fwrite(buf, 1, (size_t)n, stdout);
+	}
+	close(fd);
+	return ret;
+}
+
+#endif
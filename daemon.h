@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DAEMON_H_INCLUDED
+#define DAEMON_H_INCLUDED
+
+/*
+ * Daemon mode: one esniper process watches the auctions of many auction
+ * files, sharing login, connections and the event queue.  It is
+ * controlled through a UNIX domain socket, one command per connection:
+ *
+ *	add <auction file>	read auction file and start watching it
+ *	remove <auction file>	stop watching auction file
+ *	status [<auction file>]	print state of all or one auction file
+ *	kill			stop daemon
+ *
+ * The reply starts with "OK" or "ERROR".  Only the quantity option is
+ * taken from an auction file, other options are those of the daemon.
+ * Auction files are reloaded when they change (see filewatch.h).
+ */
+
+/* run daemon listening on socket path, returns exit code */
+extern int runDaemon(const char *path);
+
+/* send command to daemon on socket path and print reply, returns exit code */
+extern int controlClient(const char *path, int argc, char *argv[]);
+
+#endif /* DAEMON_H_INCLUDED */
@@ -32,10 +32,14 @@
  */
 
 #include "esniper.h"
+#include "account.h"
 #include "auction.h"
 #include "auctionfile.h"
 #include "auctioninfo.h"
+#include "daemon.h"
+#include "journal.h"
 #include "options.h"
+#include "schema.h"
 #include "util.h"
 
 static const char *progname = NULL;
@@ -84,6 +88,7 @@ option_t options = {
 	0,		/* usage */
 	0,		/* info on given auctions only */
 	0,		/* get my eBay items */
+	NULL,		/* my eBay items auction file */
 	0,		/* batch */
 	0,		/* password encrypted? */
 	NULL,		/* proxy */
@@ -93,8 +98,20 @@ option_t options = {
 	NULL,		/* bidHost */
 	NULL,		/* loginHost */
 	NULL,		/* bidHost */
+	NULL,		/* schemaFile */
 	0,		/* curldebug */
-	2      /* delay */
+	2,     /* delay */
+	95,    /* latencyQuantile */
+	60,    /* pollBudget */
+	0,     /* hedge */
+	NULL,  /* rehearsalHost */
+	NULL,  /* controlSocket */
+	1,     /* journal */
+	1,     /* session */
+	4,     /* fetchConnections */
+	120,   /* fetchRate */
+	30,    /* requestRate */
+	2      /* parseThreads */
 };
 
 /* used for option table */
@@ -104,6 +121,14 @@ static int CheckSecs(const void *valueptr, const optionTable_t *tableptr,
 		     const char *filename, const char *line);
 static int CheckQuantity(const void *valueptr, const optionTable_t *tableptr,
 			 const char *filename, const char *line);
+static int CheckLatencyQuantile(const void *valueptr, const optionTable_t *tableptr,
+				const char *filename, const char *line);
+static int CheckPollBudget(const void *valueptr, const optionTable_t *tableptr,
+			   const char *filename, const char *line);
+static int CheckPositive(const void *valueptr, const optionTable_t *tableptr,
+			 const char *filename, const char *line);
+static int CheckNotNegative(const void *valueptr, const optionTable_t *tableptr,
+			    const char *filename, const char *line);
 static int ReadUser(const void *valueptr, const optionTable_t *tableptr,
 		    const char *filename, const char *line);
 static int ReadPass(const void *valueptr, const optionTable_t *tableptr,
@@ -112,6 +137,8 @@ static int CheckAuctionFile(const void *valueptr, const optionTable_t *tableptr,
 			    const char *filename, const char *line);
 static int CheckConfigFile(const void *valueptr, const optionTable_t *tableptr,
 			   const char *filename, const char *line);
+static int CheckMyItemsFile(const void *valueptr, const optionTable_t *tableptr,
+			    const char *filename, const char *line);
 static int SetLongHelp(const void *valueptr, const optionTable_t *tableptr,
 		       const char *filename, const char *line);
 static int SetConfigHelp(const void *valueptr, const optionTable_t *tableptr,
@@ -141,6 +168,7 @@ optionTable_t optiontab[] = {
    {"bid",     NULL, (void*)&options.bid,          OPTION_BOOL,    LOG_NORMAL, NULL, 0},
    {NULL,       "n", (void*)&options.bid,          OPTION_BOOL_NEG,LOG_NORMAL, NULL, 0},
    {NULL,       "m", (void*)&options.myitems,      OPTION_BOOL,    LOG_NORMAL, NULL, 0},
+   {NULL,       "M", (void*)&options.myitemsFile,  OPTION_STRING,  LOG_NORMAL, &CheckMyItemsFile, 0},
    {NULL,       "i", (void*)&options.info,         OPTION_BOOL,    LOG_NORMAL, NULL, 0},
    {"debug",    "d", (void*)&options.debug,        OPTION_BOOL,    LOG_NORMAL, CheckDebug, 0},
    {"curldebug","C", (void*)&options.curldebug,    OPTION_BOOL,    LOG_NORMAL, NULL, 0},
@@ -151,7 +179,19 @@ optionTable_t optiontab[] = {
    {"bidHost", NULL, (void*)&options.bidHost,      OPTION_STRING,  LOG_NORMAL, NULL, 0},
    {"loginHost",NULL,(void*)&options.loginHost,    OPTION_STRING,  LOG_NORMAL, NULL, 0},
    {"myeBayHost",NULL,(void*)&options.myeBayHost,  OPTION_STRING,  LOG_NORMAL, NULL, 0},
+   {"schemaFile",NULL,(void*)&options.schemaFile,  OPTION_STRING,  LOG_NORMAL, NULL, 0},
    {"delay",    "D", (void*)&options.delay,        OPTION_INT,     LOG_NORMAL, NULL, 0},
+   {"latencyQuantile",NULL,(void*)&options.latencyQuantile,OPTION_INT,LOG_NORMAL, &CheckLatencyQuantile, 0},
+   {"pollBudget",NULL,(void*)&options.pollBudget,OPTION_INT,LOG_NORMAL, &CheckPollBudget, 0},
+   {"fetchConnections",NULL,(void*)&options.fetchConnections,OPTION_INT,LOG_NORMAL, &CheckPositive, 0},
+   {"fetchRate",NULL,(void*)&options.fetchRate,    OPTION_INT,     LOG_NORMAL, &CheckPositive, 0},
+   {"requestRate",NULL,(void*)&options.requestRate,OPTION_INT,    LOG_NORMAL, &CheckPositive, 0},
+   {"parseThreads",NULL,(void*)&options.parseThreads,OPTION_INT,  LOG_NORMAL, &CheckNotNegative, 0},
+   {"hedge",   NULL, (void*)&options.hedge,        OPTION_BOOL,    LOG_NORMAL, NULL, 0},
+   {"journal", NULL, (void*)&options.journal,      OPTION_BOOL,    LOG_NORMAL, NULL, 0},
+   {"session", NULL, (void*)&options.session,      OPTION_BOOL,    LOG_NORMAL, NULL, 0},
+   {"rehearsalHost","R",(void*)&options.rehearsalHost,OPTION_STRING,LOG_NORMAL, NULL, 0},
+   {NULL,       "S", (void*)&options.controlSocket,OPTION_STRING,  LOG_NORMAL, NULL, 0},
    {NULL,       "?", (void*)&options.usage,        OPTION_BOOL,    LOG_NORMAL, NULL, 0},
    {NULL,       "h", (void*)&options.usage,        OPTION_BOOL,    LOG_NORMAL, SetLongHelp, 0},
    {NULL,       "H", (void*)&options.usage,        OPTION_BOOL,    LOG_NORMAL, SetConfigHelp, 0},
@@ -165,7 +205,6 @@ static void sigAlarm(int sig);
 static void sigTerm(int sig);
 static void cleanup(void);
 static int usage(int helptype);
-static void printRemain(int remain);
 static void printVersion(void);
 #define USAGE_SUMMARY	0x01
 #define USAGE_LONG	0x02
@@ -211,6 +250,7 @@ sigTerm(int sig)
 static void
 cleanup()
 {
+	closeJournal();
 	logClose();
 }
 
@@ -334,6 +374,102 @@ CheckQuantity(const void *valueptr, const optionTable_t *tableptr,
 	return 0;
 }
 
+/*
+ * CheckLatencyQuantile(): percentile of latency used for bid time
+ *
+ * returns: 0 = OK, else error
+ */
+static int
+CheckLatencyQuantile(const void *valueptr, const optionTable_t *tableptr,
+		     const char *filename, const char *line)
+{
+	int value = *(const int*)valueptr;
+
+	if (value < 1 || value > 99) {
+		if (filename)
+			printLog(stderr, "Latency quantile must be between 1 and 99 at \"%s\" in file %s\n", line, filename);
+		else
+			printLog(stderr, "Latency quantile must be between 1 and 99\n");
+		return 1;
+	}
+	/* copy value to target option */
+	*(int *)(tableptr->value) = value;
+	log(("latency quantile is %d\n", value));
+	return 0;
+}
+
+/*
+ * CheckPollBudget(): bid history polls per hour, all auctions
+ *
+ * returns: 0 = OK, else error
+ */
+static int
+CheckPollBudget(const void *valueptr, const optionTable_t *tableptr,
+		const char *filename, const char *line)
+{
+	int value = *(const int*)valueptr;
+
+	if (value < 1) {
+		if (filename)
+			printLog(stderr, "Poll budget must be positive at \"%s\" in file %s\n", line, filename);
+		else
+			printLog(stderr, "Poll budget must be positive\n");
+		return 1;
+	}
+	/* copy value to target option */
+	*(int *)(tableptr->value) = value;
+	log(("poll budget is %d\n", value));
+	return 0;
+}
+
+/*
+ * CheckPositive(): numeric configuration option that must be positive
+ *
+ * returns: 0 = OK, else error
+ */
+static int
+CheckPositive(const void *valueptr, const optionTable_t *tableptr,
+	      const char *filename, const char *line)
+{
+	int value = *(const int*)valueptr;
+
+	if (value < 1) {
+		if (filename)
+			printLog(stderr, "%s must be positive at \"%s\" in file %s\n", tableptr->configname, line, filename);
+		else
+			printLog(stderr, "%s must be positive\n", tableptr->configname);
+		return 1;
+	}
+	/* copy value to target option */
+	*(int *)(tableptr->value) = value;
+	log(("%s is %d\n", tableptr->configname, value));
+	return 0;
+}
+
+/*
+ * CheckNotNegative(): numeric configuration option that may be 0
+ *
+ * returns: 0 = OK, else error
+ */
+static int
+CheckNotNegative(const void *valueptr, const optionTable_t *tableptr,
+		 const char *filename, const char *line)
+{
+	int value = *(const int*)valueptr;
+
+	if (value < 0) {
+		if (filename)
+			printLog(stderr, "%s must not be negative at \"%s\" in file %s\n", tableptr->configname, line, filename);
+		else
+			printLog(stderr, "%s must not be negative\n", tableptr->configname);
+		return 1;
+	}
+	/* copy value to target option */
+	*(int *)(tableptr->value) = value;
+	log(("%s is %d\n", tableptr->configname, value));
+	return 0;
+}
+
 /*
  * CheckUser(): set user
  *
@@ -424,6 +560,24 @@ static int CheckConfigFile(const void *valueptr, const optionTable_t *tableptr,
 	return CheckFile(valueptr, tableptr, filename, line, "Config");
 }
 
+/*
+ * CheckMyItemsFile(): set auction file for watch list, implies -m
+ *
+ * returns: 0 = OK, else error
+ */
+static int CheckMyItemsFile(const void *valueptr, const optionTable_t *tableptr,
+			    const char *filename, const char *line)
+{
+	if (!valueptr) {
+		printLog(stderr, "Option -%s needs a file name\n", line);
+		return 1;
+	}
+	free(*(char **)(tableptr->value));
+	*(char **)(tableptr->value) = myStrdup(valueptr);
+	options.myitems = 1;
+	return 0;
+}
+
 /*
  * CheckFile(): accept accessible files only
  *
@@ -473,11 +627,11 @@ static int SetConfigHelp(const void *valueptr, const optionTable_t *tableptr,
 /*
  * Print number of auctions remaining.
  */
-static void
-printRemain(int remain)
+void
+printRemain(int quantity, int remain)
 {
 	printLog(stdout, "\nNeed to win %d item(s), %d auction(s) remain\n\n",
-		options.quantity, remain);
+		quantity, remain);
 }
 
 static void
@@ -496,8 +650,10 @@ printVersion(void)
 }
 
 static const char usageSummary[] =
- "usage: %s [-bdhHnmPrUv] [-c conf_file] [-l logdir] [-p proxy] [-q quantity]\n"
- "       [-s secs|now] [-u user] [-D delay] (auction_file | [auction price ...])\n"
+ "usage: %s [-bdhHnmPrUv] [-c conf_file] [-l logdir] [-M auction_file]\n"
+ "       [-p proxy] [-q quantity] [-R host] [-s secs|now] [-u user]\n"
+ "       [-D delay] [-S socket [command ...]]\n"
+ "       (auction_file | [auction price ...])\n"
  "\n";
 
 /* split in two to prevent gcc portability warning.  maximum length is 509 */
@@ -516,19 +672,22 @@ static const char usageLong1[] =
  "-H: configuration and auction file help\n"
  "-i: get info on auctions and exit\n"
  "-l: log directory (default: ., or directory of auction file, if specified)\n"
- "-m: get my ebay watched items and exit\n"
- "-n: do not place bid\n";
+ "-m: get my ebay watched items and exit\n";
 static const char usageLong2[] =
+ "-M: like -m, also write watched items to auction file\n"
+ "-n: do not place bid\n"
  "-p: http proxy (default: http_proxy environment variable, format is\n"
  "    http://host:port/)\n"
  "-P: prompt for password\n"
  "-q: quantity to buy (default is 1)\n"
  "-r: do not reduce quantity on startup if already won item(s)\n"
+ "-R: rehearsal, send bids to host[:port] instead of eBay and report timing\n"
  "-s: time to place bid which may be \"now\" or seconds before end of auction\n"
- "    (default is %d seconds before end of auction)\n"
- "-u: ebay username\n"
- "-U: prompt for ebay username\n";
+ "    (default is %d seconds before end of auction)\n";
 static const char usageLong3[] =
+ "-S: run as daemon controlled through socket, or send command to daemon\n"
+ "-u: ebay username\n"
+ "-U: prompt for ebay username\n"
  "-v: print version and exit\n"
  "\n"
  "You must specify an auction file or <auction> <price> pair[s].  Options\n"
@@ -541,7 +700,10 @@ static const char usageConfig1[] =
  "    batch = false\n"
  "    bid = true\n"
  "    debug = false\n"
+ "    hedge = false\n"
+ "    journal = true\n"
  "    reduce = true\n"
+ "    session = true\n"
  "  String:\n"
  "    logdir = .\n"
  "    password =\n"
@@ -552,9 +714,17 @@ static const char usageConfig1[] =
  "    bidHost = %s\n"
  "    loginHost = %s\n"
  "    myeBayHost = %s\n"
+ "    rehearsalHost =\n"
+ "    schemaFile =\n"
  "  Numeric: (seconds may also be \"now\")\n"
  "    delay = 2\n"
+ "    fetchConnections = 4\n"
+ "    fetchRate = 120\n"
+ "    latencyQuantile = 95\n"
+ "    parseThreads = 2\n"
+ "    pollBudget = 60\n"
  "    quantity = 1\n"
+ "    requestRate = 30\n"
  "    seconds = %d\n"
  "\n";
 static const char usageConfig2[] =
@@ -595,7 +765,7 @@ main(int argc, char *argv[])
 	int XFlag = 0;
 
 	/* all known options */
-	static const char optionstring[]="bc:dhHil:mnp:Pq:rs:u:UvX";
+	static const char optionstring[]="bc:dhHil:mM:np:Pq:rR:s:S:u:UvX";
 
 	atexit(cleanup);
 	progname = basename(argv[0]);
@@ -627,6 +797,7 @@ main(int argc, char *argv[])
 			break;
 		case 'c': /* configuration file */
 		case 'l': /* log directory */
+		case 'S': /* daemon control socket */
 			if (parseGetoptValue(c, optarg, optiontab))
 				options.usage |= USAGE_SUMMARY;
 			break;
@@ -648,6 +819,10 @@ main(int argc, char *argv[])
 	if (options.usage)
 		exit(usage(options.usage));
 
+	/* Arguments after -S are a command for the daemon */
+	if (options.controlSocket && optind < argc)
+		exit(controlClient(options.controlSocket, argc - optind, &argv[optind]));
+
 	/* One argument after options?  Must be an auction file. */
 	if ((argc - optind) == 1) {
 		if (parseGetoptValue('f', argv[optind], optiontab)) {
@@ -738,8 +913,10 @@ main(int argc, char *argv[])
 	while ((c = getopt(argc, argv, optionstring)) != EOF) {
 		switch (c) {
 		case 'l': /* log directory */
+		case 'M': /* my ebay items auction file */
 		case 'p': /* proxy */
 		case 'q': /* quantity */
+		case 'R': /* rehearsal host */
 		case 's': /* seconds */
 		case 'u': /* user */
 			if (parseGetoptValue(c, optarg, optiontab))
@@ -785,6 +962,11 @@ main(int argc, char *argv[])
 	log(("options.usage=%d\n", options.usage));
 	log(("options.info=%d\n", options.info));
 	log(("options.myitems=%d\n", options.myitems));
+	log(("options.schemaFile=%s\n", nullStr(options.schemaFile)));
+
+	/* page schemas are needed by -X as well */
+	if (options.schemaFile && loadSchemaFile(options.schemaFile))
+		options.usage |= USAGE_SUMMARY;
 
 	if (!options.usage) {
 		if (!XFlag) {
@@ -799,6 +981,8 @@ main(int argc, char *argv[])
 					printLog(stderr, "Error: auctions specified with -m option.\n");
 					options.usage |= USAGE_SUMMARY;
 				}
+			} else if (options.controlSocket) {
+				/* daemon, auction files are added later */
 			} else if (argc < 2) {
 				printLog(stderr, "Error: no auctions specified.\n");
 				options.usage |= USAGE_SUMMARY;
@@ -836,7 +1020,9 @@ main(int argc, char *argv[])
 		exit(usage(options.usage));
 
 	/* init variables */
-	if (options.auctfilename) {
+	if (options.controlSocket) {
+		numAuctions = 0;
+	} else if (options.auctfilename) {
 		numAuctions = readAuctionFile(options.auctfilename, &auctions);
 	} else {
 		numAuctions = argc / 2;
@@ -847,7 +1033,7 @@ main(int argc, char *argv[])
 
  	if (options.myitems)
 		exit(printMyItems());
-	if (numAuctions <= 0)
+	if (numAuctions <= 0 && !options.controlSocket)
 		exit(usage(USAGE_SUMMARY));
 
 #if !defined(WIN32)
@@ -857,6 +1043,18 @@ main(int argc, char *argv[])
 #endif
 	signal(SIGTERM, sigTerm);
 
+	if (options.journal && !options.info)
+		(void)openJournal(options.logdir);
+
+	if (options.controlSocket) {
+		int ret = runDaemon(options.controlSocket);
+
+		closeJournal();
+		cleanupAccounts();
+		cleanupCurlStuff();
+		return ret;
+	}
+
 	numAuctionsOrig = numAuctions;
 	{
 		int quantity = options.quantity;
@@ -876,18 +1074,12 @@ main(int argc, char *argv[])
 
 	if (options.info) {
 		if (numAuctionsOrig > 1)
-			printRemain(numAuctions);
+			printRemain(options.quantity, numAuctions);
 		exit(0);
 	}
 
-	for (i = 0; i < numAuctions && options.quantity > 0; ++i) {
-		if (numAuctionsOrig > 1)
-			printRemain(numAuctions - i);
-		won += snipeAuction(auctions[i]);
-	}
-	for (i = 0; i < numAuctions && options.quantity > 0; ++i)
-		freeAuction(auctions[i]);
-	free(auctions);
+	won = snipeAuctions(options.auctfilename, auctions, numAuctions);
+	closeJournal();
 
 	cleanupCurlStuff();
 
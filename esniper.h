@@ -45,6 +45,7 @@ typedef struct {
 	int usage;
 	int info;
 	int myitems;
+	char *myitemsFile;
 	int batch;
 	int encrypted;
 	char *proxy;
@@ -54,8 +55,20 @@ typedef struct {
 	char *bidHost;
 	char *loginHost;
 	char *myeBayHost;
+	char *schemaFile;
 	int curldebug;
 	int delay;
+	int latencyQuantile;
+	int pollBudget;
+	int hedge;
+	char *rehearsalHost;
+	char *controlSocket;
+	int journal;
+	int session;
+	int fetchConnections;
+	int fetchRate;
+	int requestRate;
+	int parseThreads;
 } option_t;
 
 extern option_t options;
@@ -63,6 +76,7 @@ extern optionTable_t optiontab[];
 
 extern const char *getVersion(void);
 extern const char *getProgname(void);
+extern void printRemain(int quantity, int remain);
 
 #ifdef __lint
 #define log(x) if (!options.debug) 0; else dlog x
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "filewatch.h"
+#include "esniper.h"
+#include "mailbox.h"
+#include "timer.h"
+#include "util.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(WIN32)
+#	include <windows.h>
+#else
+#	include <sys/select.h>
+#	include <sys/time.h>
+#	include <unistd.h>
+#endif
+#if defined(__linux__)
+#	include <limits.h>
+#	include <sys/inotify.h>
+#	define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+#endif
+
+typedef struct fileWatch {
+	char *path;
+	const char *name;	/* last component of path */
+	int wd;			/* inotify watch of directory, -1 if none */
+	time_t mtime;		/* modification time when last checked */
+	int changed;
+	fileChangedFunc func;
+	void *data;
+	struct fileWatch *next;
+} fileWatch_t;
+
+static fileWatch_t *watches = NULL;
+static int inotifyFd = -1;
+
+static time_t getMtime(const char *path);
+static void checkMtimes(void);
+static void readNotifications(void);
+static void callChanged(void);
+
+static time_t
+getMtime(const char *path)
+{
+	struct stat sb;
+
+	return stat(path, &sb) ? 0 : sb.st_mtime;
+}
+
+int
+addFileWatch(const char *path, fileChangedFunc func, void *data)
+{
+	fileWatch_t *wp = (fileWatch_t *)myMalloc(sizeof(fileWatch_t));
+	const char *slash = strrchr(path, '/');
+
+	wp->path = myStrdup(path);
+	wp->name = slash ? &wp->path[slash - path + 1] : wp->path;
+	wp->wd = -1;
+	wp->mtime = getMtime(path);
+	wp->changed = 0;
+	wp->func = func;
+	wp->data = data;
+#if defined(__linux__)
+	if (inotifyFd < 0)
+		inotifyFd = inotify_init();
+	if (inotifyFd >= 0) {
+		/* watch the directory, so that renames are seen */
+		char *dir = slash ? myStrndup(path, slash == path ? 1 : (size_t)(slash - path)) : myStrdup(".");
+
+		wp->wd = inotify_add_watch(inotifyFd, dir, WATCH_EVENTS);
+		if (wp->wd < 0) {
+			log(("cannot watch %s: %s, checking every %d seconds", dir, strerror(errno), FILE_POLL_INTERVAL));
+		}
+		free(dir);
+	}
+#endif
+	wp->next = watches;
+	watches = wp;
+	log(("watching %s", path));
+	return 0;
+}
+
+void
+removeFileWatch(const char *path)
+{
+	fileWatch_t **wpp, *wp;
+
+	for (wpp = &watches; *wpp; wpp = &(*wpp)->next) {
+		if (!strcmp((*wpp)->path, path))
+			break;
+	}
+	if (!(wp = *wpp))
+		return;
+	*wpp = wp->next;
+#if defined(__linux__)
+	if (wp->wd >= 0) {
+		fileWatch_t *other;
+
+		/* directory watches are shared */
+		for (other = watches; other && other->wd != wp->wd; other = other->next)
+			;
+		if (!other)
+			(void)inotify_rm_watch(inotifyFd, wp->wd);
+	}
+	if (!watches && inotifyFd >= 0) {
+		close(inotifyFd);
+		inotifyFd = -1;
+	}
+#endif
+	log(("stopped watching %s", path));
+	free(wp->path);
+	free(wp);
+}
+
+/*
+ * Mark files without inotify watch whose modification time changed.
+ */
+static void
+checkMtimes(void)
+{
+	fileWatch_t *wp;
+
+	for (wp = watches; wp; wp = wp->next) {
+		time_t mtime;
+
+		if (wp->wd >= 0)
+			continue;
+		mtime = getMtime(wp->path);
+		if (mtime != wp->mtime) {
+			wp->mtime = mtime;
+			wp->changed = 1;
+		}
+	}
+}
+
+/*
+ * Read pending inotify events, mark watched files that were written or
+ * renamed into place.
+ */
+static void
+readNotifications(void)
+{
+#if defined(__linux__)
+	char buf[4096 + sizeof(struct inotify_event) + NAME_MAX + 1];
+	ssize_t len;
+
+	while ((len = read(inotifyFd, buf, sizeof(buf))) < 0 && errno == EINTR)
+		;
+	if (len > 0) {
+		ssize_t i = 0;
+
+		while (i < len) {
+			const struct inotify_event *ie = (const struct inotify_event *)&buf[i];
+			fileWatch_t *wp;
+
+			for (wp = watches; wp; wp = wp->next) {
+				if (wp->wd == ie->wd && ie->len > 0 &&
+				    !strcmp(wp->name, ie->name))
+					wp->changed = 1;
+			}
+			i += (ssize_t)(sizeof(struct inotify_event) + ie->len);
+		}
+	}
+#endif
+}
+
+/*
+ * Call function of changed files.  Several events for one file (an
+ * editor writing it in pieces) result in one call.
+ */
+static void
+callChanged(void)
+{
+	fileWatch_t *wp;
+
+	for (wp = watches; wp; wp = wp->next) {
+		if (wp->changed) {
+			wp->changed = 0;
+			wp->mtime = getMtime(wp->path);
+			log(("%s changed", wp->path));
+			(*wp->func)(wp->path, wp->data);
+		}
+	}
+}
+
+#if defined(WIN32)
+
+int
+waitFileWatch(double until, int fd)
+{
+	double wait = until - getMonotonicTime();
+
+	if (watches && (until == 0 || wait > FILE_POLL_INTERVAL))
+		wait = FILE_POLL_INTERVAL;
+	if (wait > 0)
+		Sleep((DWORD)(wait * 1000));
+	checkMtimes();
+	callChanged();
+	return 0;
+}
+
+#else
+
+int
+waitFileWatch(double until, int fd)
+{
+	int looked = 0;
+
+	for (;;) {
+		struct timeval tv, *tvp = NULL;
+		fd_set fds;
+		int maxFd = fd, polling = 0, mailFd = mailboxFd(), mail = 0, ret;
+		fileWatch_t *wp;
+		double wait = 0;
+
+		for (wp = watches; wp; wp = wp->next) {
+			if (wp->wd < 0)
+				polling = 1;
+		}
+		if (until > 0) {
+			wait = until - getMonotonicTime();
+			/* time is up: look once more, without waiting */
+			if (wait <= 0 && looked)
+				return 0;
+			if (wait < 0)
+				wait = 0;
+		}
+		looked = 1;
+		if (polling && (until == 0 || wait > FILE_POLL_INTERVAL))
+			wait = FILE_POLL_INTERVAL;
+		if (until > 0 || polling) {
+			tv.tv_sec = (long)wait;
+			tv.tv_usec = (long)((wait - (double)tv.tv_sec) * 1e6);
+			tvp = &tv;
+		}
+		FD_ZERO(&fds);
+		if (fd >= 0)
+			FD_SET(fd, &fds);
+		if (inotifyFd >= 0) {
+			FD_SET(inotifyFd, &fds);
+			if (inotifyFd > maxFd)
+				maxFd = inotifyFd;
+		}
+		if (mailFd >= 0) {
+			FD_SET(mailFd, &fds);
+			if (mailFd > maxFd)
+				maxFd = mailFd;
+		}
+		ret = select(maxFd + 1, &fds, NULL, NULL, tvp);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			printLog(stderr, "Cannot wait: %s\n", strerror(errno));
+			return -1;
+		}
+		if (mailFd >= 0 && FD_ISSET(mailFd, &fds))
+			mail = readMailbox();
+		if (fd >= 0 && FD_ISSET(fd, &fds))
+			return 1;
+		if (inotifyFd >= 0 && FD_ISSET(inotifyFd, &fds))
+			readNotifications();
+		if (polling)
+			checkMtimes();
+		for (wp = watches; wp && !wp->changed; wp = wp->next)
+			;
+		if (wp) {
+			callChanged();
+			return 0;
+		}
+		if (mail || (ret == 0 && !polling))
+			return 0;
+	}
+}
+
+#endif
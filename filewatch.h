@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FILEWATCH_H_INCLUDED
+#define FILEWATCH_H_INCLUDED
+
+/*
+ * Watch files for changes.  On Linux, inotify reports files written or
+ * replaced (editors often write a new file and rename it).  Elsewhere,
+ * or if inotify is not available, the modification time is checked
+ * every FILE_POLL_INTERVAL seconds.
+ */
+
+#define FILE_POLL_INTERVAL 10
+
+/*
+ * Called with path and data of a changed file.  Must not add or remove
+ * file watches.
+ */
+typedef void (*fileChangedFunc)(const char *path, void *data);
+
+/* start watching path, returns 0 on success, 1 on failure */
+extern int addFileWatch(const char *path, fileChangedFunc func, void *data);
+
+/* stop watching path */
+extern void removeFileWatch(const char *path);
+
+/*
+ * Wait until monotonic time until (0 = forever) or until fd (-1 = none)
+ * is readable.  Changes of watched files and mail of the main thread
+ * (see mailbox.h) are handled meanwhile.  If until has passed, fd and
+ * the watched files are looked at once without waiting.
+ *
+ * returns 1 if fd is readable, 0 on timeout or after changes or mail
+ * were handled, -1 on error.
+ */
+extern int waitFileWatch(double until, int fd);
+
+#endif /* FILEWATCH_H_INCLUDED */
@@ -32,11 +32,13 @@
 #include "auction.h"
 #include "auctioninfo.h"
 #include "history.h"
+#include "host.h"
+#include "schema.h"
 #include "esniper.h"
 
 static long getSeconds(char *timestr);
 static int checkPageType(auctionInfo *aip, int pageType, int auctionState, int auctionResult);
-static int parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t start, int debugMode);
+static int parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, const schema_t *sp, const schemaResult_t *rp, auctionInfo *aip, time_t start, int debugMode);
 
 static const char PRIVATE[] = "private auction - bidders' identities protected";
 
@@ -53,12 +55,6 @@ static const char PRIVATE[] = "private auction - bidders' identities protected";
 #define RESULT_NONE 2
 #define RESULT_OUTBID 3
 
-#define NOTHING 0
-#define PRICE 1
-#define QUANTITY 2
-#define SHIPPING 4
-#define EVERYTHING (PRICE | QUANTITY | SHIPPING)
-
 /*
  * parseBidHistory(): parses bid history page (pageName: PageViewBids)
  *
@@ -69,7 +65,29 @@ static const char PRIVATE[] = "private auction - bidders' identities protected";
 int
 parseBidHistory(memBuf_t *mp, auctionInfo *aip, time_t start, time_t *timeToFirstByte, int debugMode)
 {
-	pageInfo_t *pp;
+	return parseBidHistoryPage(prepareBidHistory(mp), mp, aip, start, timeToFirstByte, debugMode);
+}
+
+struct bidHistoryPage {
+	pageInfo_t *pp;		/* NULL if not found */
+	const schema_t *sp;	/* NULL if there is none */
+	schemaResult_t *rp;
+};
+
+bidHistoryPage_t *
+prepareBidHistory(memBuf_t *mp)
+{
+	bidHistoryPage_t *hp = (bidHistoryPage_t *)myMalloc(sizeof(bidHistoryPage_t));
+
+	hp->pp = getPageInfo(mp);
+	hp->sp = hp->pp ? getSchema("ViewBids") : NULL;
+	hp->rp = hp->sp ? evalSchema(hp->sp, mp) : NULL;
+	return hp;
+}
+
+int
+parseBidHistoryPage(bidHistoryPage_t *hp, memBuf_t *mp, auctionInfo *aip, time_t start, time_t *timeToFirstByte, int debugMode)
+{
 	int ret = 0;
 
 	resetAuctionError(aip);
@@ -77,20 +95,38 @@ parseBidHistory(memBuf_t *mp, auctionInfo *aip, time_t start, time_t *timeToFirs
 	if (timeToFirstByte)
 		*timeToFirstByte = getTimeToFirstByte(mp);
 
-	if ((pp = getPageInfo(mp))) {
-		ret = parseBidHistoryInternal(pp, mp, aip, start, debugMode);
-		freePageInfo(pp);
+	if (hp->pp) {
+		if (hp->sp)
+			ret = parseBidHistoryInternal(hp->pp, mp, hp->sp, hp->rp, aip, start, debugMode);
+		else {
+			log(("parseBidHistory(): no ViewBids schema\n"));
+			ret = auctionError(aip, ae_notitle, NULL);
+		}
+		freeSchemaResult(hp->rp);
+		freePageInfo(hp->pp);
 	} else {
 		log(("parseBidHistory(): pageinfo is NULL\n"));
 		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "pageInfo is NULL");
 		ret = auctionError(aip, ae_notitle, NULL);
 	}
+	free(hp);
 	return ret;
 }
 
+void
+freeBidHistoryPage(bidHistoryPage_t *hp)
+{
+	if (hp) {
+		freeSchemaResult(hp->rp);
+		freePageInfo(hp->pp);
+		free(hp);
+	}
+}
+
 int
-parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t start, int debugMode)
+parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, const schema_t *sp, const schemaResult_t *rp, auctionInfo *aip, time_t start, int debugMode)
 {
+	const schemaValue_t *vp;
 	char *line;
 	char **row = NULL;
 	int ret = 0;		/* 0 = OK, 1 = failed */
@@ -98,11 +134,11 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 	int pageType = 0;
 	int auctionState = 0;
 	int auctionResult = 0;
-	int got;
+	int bidderColumn = getSchemaColumn(sp, "bids", "bidder");
+	int amountColumn = getSchemaColumn(sp, "bids", "amount");
+	int quantityColumn = getSchemaColumn(sp, "bids", "quantity");
 	const char *delim = "_";
 
-
-
 	if ((pp->srcId && !strcmp(pp->srcId, "Captcha.xsl")) ||
 		(pp->pageName && !strncmp(pp->pageName, "Security Measure", 16)))
 		return auctionError(aip, ae_captcha, NULL);
@@ -128,12 +164,11 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		free(tmpPagename);
 
 		/* bid history or expired/bad auction number */
-		while ((line = getNonTag(mp))) {
-			if (!strcmp(line, "Bid History")) {
-				log(("parseBidHistory(): got \"Bid History\"\n"));
-				break;
-			}
-			if (!strcmp(line, "Unknown Item")) {
+		vp = getSchemaValue(rp, "unknownItem");
+		if (vp->found) {
+			const schemaValue_t *historyp = getSchemaValue(rp, "bidHistory");
+
+			if (!historyp->found || vp->pos < historyp->pos) {
 				log(("parseBidHistory(): got \"Unknown Item\"\n"));
 				return auctionError(aip, ae_baditem, NULL);
 			}
@@ -149,24 +184,17 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 	}
 
 	/* Auction number */
-	memReset(mp);
-	if (memStr(mp, "\"BHCtBidLabel\"") ||
-		memStr(mp, "\"vizItemNum\"") ||
-		memStr(mp, "\"BHitemNo\"")) { /* obsolete as of 2.22 */
-		memChr(mp, '>');
-		memSkip(mp, 1);
-		line = getNonTag(mp);	/* Item number: */
-		line = getNonTag(mp);	/* number */
-		if (!line) {
-			log(("parseBidHistory(): No item number"));
-			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
-			return auctionError(aip, ae_baditem, NULL);
-		}
-	} else {
+	vp = getSchemaValue(rp, "item");
+	if (!vp->found) {
 		log(("parseBidHistory(): BHitemNo not found"));
 		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
 		return auctionError(aip, ae_baditem, NULL);
 	}
+	if (!(line = vp->text)) {
+		log(("parseBidHistory(): No item number"));
+		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "no item number");
+		return auctionError(aip, ae_baditem, NULL);
+	}
 	if (debugMode) {
 		free(aip->auction);
 		aip->auction = myStrdup(line);
@@ -179,104 +207,80 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 	}
 
 	/* Auction title */
-	memReset(mp);
-	if (memStr(mp, "\"itemTitle\"") ||
-		memStr(mp, "\"BHitemTitle\"") || /* obsolete as of 2.22 */
-		memStr(mp, "\"BHitemDesc\"")) {	/* obsolete before 2.22 */
-		memChr(mp, '>');
-		memSkip(mp, 1);
-		line = getNonTag(mp);	/* Item title: */
-		line = getNonTag(mp);	/* title */
-		if (!line) {
-			log(("parseBidHistory(): No item title"));
-			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title not found");
-			return auctionError(aip, ae_baditem, NULL);
-		}
-	} else {
+	vp = getSchemaValue(rp, "title");
+	if (!vp->found) {
 		log(("parseBidHistory(): BHitemTitle not found"));
 		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title or description not found");
 		return auctionError(aip, ae_baditem, NULL);
 	}
+	if (!vp->text) {
+		log(("parseBidHistory(): No item title"));
+		bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item title not found");
+		return auctionError(aip, ae_baditem, NULL);
+	}
 	free(aip->title);
-	aip->title = myStrdup(line);
+	aip->title = myStrdup(vp->text);
 	printLog(stdout, "Auction %s: %s\n", aip->auction, aip->title);
 
 	/* price, shipping, quantity */
-	memReset(mp);
+	/* Can sometimes get starting bid, but that's not the price
+	 * we are looking for, the schema only matches the price labels.
+	 */
+	vp = getSchemaValue(rp, "price");
+	if (vp->found) {
+		char *price;
+
+		if (!vp->text) {
+			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item price not found");
+			return auctionError(aip, ae_noprice, NULL);
+		}
+		log(("Currently: %s\n", vp->text));
+		price = myStrdup(vp->text);
+		aip->price = atof(priceFixup(price, aip));
+		if (aip->price < 0.01) {
+			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item price could not be converted");
+			ret = auctionError(aip, ae_convprice, price);
+			free(price);
+			return ret;
+		}
+		free(price);
+
+		/* reserve not met? */
+		vp = getSchemaValue(rp, "reserve");
+		aip->reserve = vp->text && !strcasecmp(vp->text, "Reserve not met");
+	}
 	aip->quantity = 1;	/* If quantity not found, assume 1 */
-	got = NOTHING;
-	while (got != EVERYTHING && memStr(mp, "\"BHCtBid\"")) {
-		memChr(mp, '>');
-		memSkip(mp, 1);
-		line = getNonTag(mp);
-
-		/* Can sometimes get starting bid, but that's not the price
-		 * we are looking for.
-		 */
-		if (!strcasecmp(line, "Current bid:") ||
-		    !strcasecmp(line, "Winning bid:") ||
-		    !strcasecmp(line, "Your maximum bid:") ||
-		    !strcasecmp(line, "price:")) {
-			char *saveptr;
-
-			line = getNonTag(mp);
-			if (!line) {
-				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item price not found");
-				return auctionError(aip, ae_noprice, NULL);
-			}
-			log(("Currently: %s\n", line));
-			aip->price = atof(priceFixup(line, aip));
-			if (aip->price < 0.01) {
-				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item price could not be converted");
-				return auctionError(aip, ae_convprice, line);
-			}
-			got |= PRICE;
-
-			/* reserve not met? */
-			saveptr = mp->readptr;
-			line = getNonTag(mp);
-			aip->reserve = !strcasecmp(line, "Reserve not met");
-			if (!aip->reserve)
-				mp->readptr = saveptr;
-		} else if (!strcasecmp(line, "Quantity:")) {
-			line = getNonTag(mp);
-			if (!line) {
-				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item quantity not found");
+	vp = getSchemaValue(rp, "quantity");
+	if (vp->found) {
+		if (!vp->text) {
+			bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item quantity not found");
+			return auctionError(aip, ae_noquantity, NULL);
+		}
+		if (isdigit(*vp->text)) {
+			aip->quantity = (int)vp->number;
+			if (aip->quantity < 0) {
+				bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item quantity could not be converted");
 				return auctionError(aip, ae_noquantity, NULL);
 			}
-			errno = 0;
-			if (isdigit(*line)) {
-				aip->quantity = (int)strtol(line, NULL, 10);
-				if (aip->quantity < 0 || (aip->quantity == 0 && errno == EINVAL)) {
-					bugReport("parseBidHistory", __FILE__, __LINE__, aip, mp, optiontab, "item quantity could not be converted");
-					return auctionError(aip, ae_noquantity, NULL);
-				}
-			} else
-				aip->quantity = 1;
-			log(("quantity: %d", aip->quantity));
-			got |= QUANTITY;
-		} else if (!strcasecmp(line, "Shipping:")) {
-			line = getNonTag(mp);
-			if (line) {
-				free(aip->shipping);
-				aip->shipping = myStrdup(line);
-			}
-			got |= SHIPPING;
 		}
+		log(("quantity: %d", aip->quantity));
+	}
+	vp = getSchemaValue(rp, "shipping");
+	if (vp->text) {
+		free(aip->shipping);
+		aip->shipping = myStrdup(vp->text);
 	}
 
 	/* Time Left */
-	memReset(mp);
-	if (aip->quantity == 0 || memStr(mp, "Time Ended:")) {
+	vp = getSchemaValue(rp, "timeLeft");
+	if (aip->quantity == 0 || getSchemaValue(rp, "ended")->found) {
 		free(aip->remainRaw);
 		aip->remainRaw = myStrdup("--");
 		aip->remain = 0;
-	} else if (memStr(mp, "timeLeft")) {
-		memChr(mp, '>');
-		memSkip(mp, 1);
+	} else if (vp->found) {
 		free(aip->remainRaw);
-		aip->remainRaw = myStrdup(getNonTag(mp));
-		if (!strcasecmp(aip->remainRaw, "Duration:")) {
+		aip->remainRaw = myStrdup(vp->text);
+		if (!aip->remainRaw || !strcasecmp(aip->remainRaw, "Duration:")) {
 			/* Duration may follow Time left.  If we
 			 * see this, time left must be empty.  Assume 1 second.
 			 */
@@ -322,29 +326,24 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		aip->endTime = aip->remain;
 
 	/* bid history */
-	memReset(mp);
+	vp = getSchemaValue(rp, "bids");
 	aip->bids = -1;
-	if (memStr(mp, "Total Bids:")) {
-		line = getNonTag(mp);	/* Total Bids: */
-		line = getNonTag(mp);	/* number */
-		log(("bids: %d", line));
-		if (line) {
-			errno = 0;
-			aip->bids = (int)strtol(line, NULL, 10);
-			if (aip->bids < 0 || (aip->bids == 0 && errno == EINVAL))
-				aip->bids = -1;
-			else if (aip->bids == 0) {
-				aip->quantityBid = 0;
-				aip->price = 0;
-				printf("# of bids: %d\n"
-					"Currently: --  (your maximum bid: %s)\n",
-					aip->bids, aip->bidPriceStr);
-				if (*options.username)
-					printf("High bidder: -- (NOT %s)\n", options.username);
-				else
-					printf("High bidder: --\n");
-				return 0;
-			}
+	if (vp->text) {
+		log(("bids: %s", vp->text));
+		aip->bids = (int)vp->number;
+		if (aip->bids < 0)
+			aip->bids = -1;
+		else if (aip->bids == 0) {
+			aip->quantityBid = 0;
+			aip->price = 0;
+			printf("# of bids: %d\n"
+				"Currently: --  (your maximum bid: %s)\n",
+				aip->bids, aip->bidPriceStr);
+			if (*options.username)
+				printf("High bidder: -- (NOT %s)\n", options.username);
+			else
+				printf("High bidder: --\n");
+			return 0;
 		}
 	}
 
@@ -407,23 +406,21 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 	 *	not be counted.
 	 */
 
+	/* bid rows have at least 5 columns */
+	if (bidderColumn < 0 || bidderColumn >= 5 ||
+	    amountColumn < 0 || amountColumn >= 5 ||
+	    quantityColumn < 0 || quantityColumn >= 5) {
+		printLog(stderr, "Bid table columns missing from schema\n");
+		return auctionError(aip, ae_nohighbid, NULL);
+	}
+
 	/* find bid history table */
 	memReset(mp);
 	while (!foundHeader && getTableStart(mp)) {
-		int ncolumns;
 		char *saveptr = mp->readptr;
 
 		row = getTableRow(mp);
-		ncolumns = numColumns(row);
-		if (ncolumns >= 5) {
-			char *rawHeader = row[1];
-			char *header = getNonTagFromString(rawHeader);
-
-			foundHeader = header &&
-					(!strncmp(header, "Bidder", 6) ||
-					 !strncmp(header, "User ID", 7));
-			free(header);
-		}
+		foundHeader = isSchemaTableHeader(sp, "bids", row);
 		if (!foundHeader)
 			mp->readptr = saveptr;
 		freeTableRow(row);
@@ -477,7 +474,7 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 		 */
 	    if(pageType != VIEWBIDS)
 	    {
-			char *currently = getNonTagFromString(row[2]);
+			char *currently = getNonTagFromString(row[amountColumn]);
 
 			aip->bids = 0;
 			aip->quantityBid = 0;
@@ -487,12 +484,12 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 			/* blank, user, price, quantity, date, blank */
 			for (; row; row = getTableRow(mp)) {
 				if (numColumns(row) == 6) {
-					int quantity = getIntFromString(row[3]);
+					int quantity = getIntFromString(row[quantityColumn]);
 					char *bidder;
 
 					++aip->bids;
 					aip->quantityBid += quantity;
-					bidder = getNonTagFromString(row[1]);
+					bidder = getNonTagFromString(row[bidderColumn]);
 					if (!strcasecmp(bidder, options.username))
 						aip->won = aip->winning = quantity;
 					free(bidder);
@@ -523,14 +520,14 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 	case 5: /* single auction with bids */
 	    {
 		/* blank, user, price, date, blank */
-		char *winner = getNonTagFromString(row[1]);
-		char *currently = getNonTagFromString(row[2]);
+		char *winner = getNonTagFromString(row[bidderColumn]);
+		char *currently = getNonTagFromString(row[amountColumn]);
 
 		if (!strcasecmp(winner, "Member Id:"))
-		   winner = getNthNonTagFromString(row[1], 2);
+		   winner = getNthNonTagFromString(row[bidderColumn], 2);
 
 		if (!strcasecmp(winner, "EUR"))
-		   currently = getNthNonTagFromString(row[2], 2);
+		   currently = getNthNonTagFromString(row[amountColumn], 2);
 		
         aip->quantityBid = 1;
 
@@ -556,7 +553,7 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 			free(winner);
 			winner = myStrdup((aip->price <= aip->bidPrice &&
 					    (aip->bidResult == 0 ||
-					     (aip->bidResult == -1 && aip->endTime - time(NULL) < options.bidtime))) ?  options.username : "[private]");
+					     (aip->bidResult == -1 && aip->endTime - historyTime() < options.bidtime))) ?  options.username : "[private]");
 		}
 		freeTableRow(row);
 
@@ -565,7 +562,7 @@ parseBidHistoryInternal(pageInfo_t *pp, memBuf_t *mp, auctionInfo *aip, time_t s
 			int foundStartPrice = 0;
 			for (aip->bids = 1; !foundStartPrice && (row = getTableRow(mp)); ) {
 				if (numColumns(row) == 5) {
-					char *bidder = getNonTagFromString(row[1]);
+					char *bidder = getNonTagFromString(row[bidderColumn]);
 
 					foundStartPrice = !strcmp(bidder, "Starting Price");
 					if (!foundStartPrice)
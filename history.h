@@ -40,4 +40,18 @@
 extern int
 parseBidHistory(memBuf_t *mp, auctionInfo *aip, time_t start, time_t *timeToFirstByte, int debugMode);
 
+/*
+ * parseBidHistory() in two steps.  prepareBidHistory() reads the page
+ * info and schema values of the page, and may run on a parser thread
+ * (see parser.h).  parseBidHistoryPage() does the rest, and frees the
+ * prepared page.
+ */
+typedef struct bidHistoryPage bidHistoryPage_t;
+
+extern bidHistoryPage_t *prepareBidHistory(memBuf_t *mp);
+extern int
+parseBidHistoryPage(bidHistoryPage_t *hp, memBuf_t *mp, auctionInfo *aip, time_t start, time_t *timeToFirstByte, int debugMode);
+/* free a prepared page that won't be parsed */
+extern void freeBidHistoryPage(bidHistoryPage_t *hp);
+
 #endif /*HISTORY_H_*/
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "host.h"
+#include "timer.h"
+#include "esniper.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* maximum clock drift between us and a server, seconds per second */
+#define MAX_DRIFT 0.0001
+
+/* weight of new sample in latency moving average */
+#define LATENCY_WEIGHT 0.125
+
+static host_t *hosts = NULL;
+
+static void initQuantile(quantile_t *qp, double p);
+static void addQuantileSample(quantile_t *qp, double x);
+static double getQuantile(const quantile_t *qp);
+
+host_t *
+getHost(const char *name)
+{
+	host_t *hp;
+
+	for (hp = hosts; hp; hp = hp->next)
+		if (!strcasecmp(hp->name, name))
+			return hp;
+	hp = (host_t *)myMalloc(sizeof(host_t));
+	hp->name = myStrdup(name);
+	hp->clockSamples = 0;
+	hp->offsetLow = hp->offsetHigh = 0;
+	hp->offsetTime = 0;
+	hp->latencySamples = 0;
+	hp->latencyAverage = 0;
+	initQuantile(&hp->latency[LATENCY_P50], 0.50);
+	initQuantile(&hp->latency[LATENCY_P95], 0.95);
+	initQuantile(&hp->latency[LATENCY_P99], 0.99);
+	initQuantile(&hp->latency[LATENCY_BID], options.latencyQuantile / 100.0);
+	hp->next = hosts;
+	hosts = hp;
+	return hp;
+}
+
+host_t *
+firstHost(void)
+{
+	return hosts;
+}
+
+host_t *
+getUrlHost(const char *url)
+{
+	const char *start = strstr(url, "://");
+	size_t len;
+	char *name;
+	host_t *hp;
+
+	if (!start)
+		return NULL;
+	start += 3;
+	len = strcspn(start, "/?#");
+	if (!len)
+		return NULL;
+	name = myStrndup(start, len);
+	hp = getHost(name);
+	free(name);
+	return hp;
+}
+
+void
+addClockSample(host_t *hp, double sent, double received, time_t date)
+{
+	double low = (double)date - received;
+	double high = (double)date + 1 - sent;
+	double now = getMonotonicTime();
+
+	if (!hp || high < low)
+		return;
+	if (hp->clockSamples) {
+		double drift = (now - hp->offsetTime) * MAX_DRIFT;
+		double oldLow = hp->offsetLow - drift;
+		double oldHigh = hp->offsetHigh + drift;
+
+		if (low > oldHigh || high < oldLow) {
+			log(("clock offset %s: [%.3f, %.3f] outside of [%.3f, %.3f], starting over",
+			     hp->name, low, high, oldLow, oldHigh));
+			hp->clockSamples = 0;
+		} else {
+			if (low < oldLow)
+				low = oldLow;
+			if (high > oldHigh)
+				high = oldHigh;
+		}
+	}
+	hp->offsetLow = low;
+	hp->offsetHigh = high;
+	hp->offsetTime = now;
+	++hp->clockSamples;
+	log(("clock offset %s: %.3f +/- %.3f seconds (%d samples)", hp->name,
+	     (low + high) / 2, (high - low) / 2, hp->clockSamples));
+}
+
+double
+getClockOffset(const host_t *hp, double *uncertainty)
+{
+	if (!hp || !hp->clockSamples) {
+		if (uncertainty)
+			*uncertainty = 0;
+		return 0;
+	}
+	if (uncertainty)
+		*uncertainty = (hp->offsetHigh - hp->offsetLow) / 2 +
+			(getMonotonicTime() - hp->offsetTime) * MAX_DRIFT;
+	return (hp->offsetLow + hp->offsetHigh) / 2;
+}
+
+void
+addLatencySample(host_t *hp, double latency)
+{
+	int i;
+
+	if (!hp || latency < 0)
+		return;
+	if (hp->latencySamples++)
+		hp->latencyAverage += LATENCY_WEIGHT * (latency - hp->latencyAverage);
+	else
+		hp->latencyAverage = latency;
+	for (i = 0; i < LATENCY_QUANTILES; ++i)
+		addQuantileSample(&hp->latency[i], latency);
+	log(("latency %s: %.3f, average %.3f p50 %.3f p95 %.3f p99 %.3f p%d %.3f (%d samples)",
+	     hp->name, latency, hp->latencyAverage,
+	     getQuantile(&hp->latency[LATENCY_P50]),
+	     getQuantile(&hp->latency[LATENCY_P95]),
+	     getQuantile(&hp->latency[LATENCY_P99]),
+	     (int)(hp->latency[LATENCY_BID].p * 100 + 0.5),
+	     getQuantile(&hp->latency[LATENCY_BID]), hp->latencySamples));
+}
+
+double
+getLatency(const host_t *hp, int which)
+{
+	if (!hp || which < 0 || which >= LATENCY_QUANTILES)
+		return 0;
+	return getQuantile(&hp->latency[which]);
+}
+
+static void
+initQuantile(quantile_t *qp, double p)
+{
+	qp->p = p;
+	qp->count = 0;
+}
+
+static void
+addQuantileSample(quantile_t *qp, double x)
+{
+	int i, k;
+
+	/* first five samples are kept sorted */
+	if (qp->count < 5) {
+		for (i = qp->count++; i > 0 && qp->q[i-1] > x; --i)
+			qp->q[i] = qp->q[i-1];
+		qp->q[i] = x;
+		if (qp->count == 5) {
+			for (i = 0; i < 5; ++i)
+				qp->n[i] = i;
+			qp->np[0] = 0;
+			qp->np[1] = 2 * qp->p;
+			qp->np[2] = 4 * qp->p;
+			qp->np[3] = 2 + 2 * qp->p;
+			qp->np[4] = 4;
+		}
+		return;
+	}
+	++qp->count;
+
+	/* find cell k with q[k] <= x < q[k+1], adjusting extremes */
+	if (x < qp->q[0]) {
+		qp->q[0] = x;
+		k = 0;
+	} else if (x >= qp->q[4]) {
+		qp->q[4] = x;
+		k = 3;
+	} else {
+		for (k = 0; k < 3 && x >= qp->q[k+1]; ++k)
+			;
+	}
+	for (i = k + 1; i < 5; ++i)
+		++qp->n[i];
+	qp->np[1] += qp->p / 2;
+	qp->np[2] += qp->p;
+	qp->np[3] += (1 + qp->p) / 2;
+	qp->np[4] += 1;
+
+	/* move middle markers towards their desired positions */
+	for (i = 1; i < 4; ++i) {
+		double d = qp->np[i] - qp->n[i];
+
+		if ((d >= 1 && qp->n[i+1] - qp->n[i] > 1) ||
+		    (d <= -1 && qp->n[i-1] - qp->n[i] < -1)) {
+			int s = d >= 0 ? 1 : -1;
+			double q;
+
+			/* piecewise parabolic prediction */
+			q = qp->q[i] + (double)s / (qp->n[i+1] - qp->n[i-1]) *
+				((qp->n[i] - qp->n[i-1] + s) * (qp->q[i+1] - qp->q[i]) / (qp->n[i+1] - qp->n[i]) +
+				 (qp->n[i+1] - qp->n[i] - s) * (qp->q[i] - qp->q[i-1]) / (qp->n[i] - qp->n[i-1]));
+			/* not monotonic?  use linear prediction */
+			if (q <= qp->q[i-1] || q >= qp->q[i+1])
+				q = qp->q[i] + s * (qp->q[i+s] - qp->q[i]) / (qp->n[i+s] - qp->n[i]);
+			qp->q[i] = q;
+			qp->n[i] += s;
+		}
+	}
+}
+
+static double
+getQuantile(const quantile_t *qp)
+{
+	if (qp->count == 0)
+		return 0;
+	if (qp->count < 5)
+		return qp->q[(int)(qp->p * (qp->count - 1) + 0.5)];
+	return qp->q[2];
+}
+
+double
+getHostTime(const host_t *hp)
+{
+	return getWallTime() + getClockOffset(hp, NULL);
+}
+
+time_t
+historyTime(void)
+{
+	return (time_t)getHostTime(getHost(options.historyHost));
+}
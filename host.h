@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HOST_H_INCLUDED
+#define HOST_H_INCLUDED
+
+#include <time.h>
+
+/*
+ * Per host information.
+ *
+ * Clock offset: the Date header of a response is the server's time
+ * (truncated to seconds) sometime between sending the request and
+ * receiving the header, so each response bounds the offset between the
+ * server clock and ours.  Bounds from all responses are intersected,
+ * widened by the maximum clock drift since they were measured.  If the
+ * intersection is empty one of the clocks was set, and the estimate
+ * starts over.
+ */
+/*
+ * Streaming quantile estimate, P-square algorithm (Jain and Chlamtac,
+ * 1985).  Five markers track the minimum, the p/2, p and (1+p)/2
+ * quantiles and the maximum, without storing the samples.
+ */
+typedef struct {
+	double p;		/* quantile, 0 < p < 1 */
+	int count;		/* samples */
+	double q[5];		/* marker heights */
+	int n[5];		/* marker positions */
+	double np[5];		/* desired marker positions */
+} quantile_t;
+
+/* latency quantiles kept for each host, the last one is configurable */
+#define LATENCY_P50 0
+#define LATENCY_P95 1
+#define LATENCY_P99 2
+#define LATENCY_BID 3
+#define LATENCY_QUANTILES 4
+
+/*
+ * Latency: time from starting a request to the first byte of the
+ * response.  An exponentially weighted moving average and quantile
+ * estimates are kept, the bid lead time uses the quantile set by the
+ * latencyQuantile option.
+ */
+typedef struct host {
+	char *name;		/* host name, including port if any */
+	int latencySamples;	/* requests timed */
+	double latencyAverage;	/* moving average */
+	quantile_t latency[LATENCY_QUANTILES];
+	int clockSamples;	/* Date headers seen, 0 = no offset known */
+	double offsetLow;	/* server clock - our clock, lower bound */
+	double offsetHigh;	/* server clock - our clock, upper bound */
+	double offsetTime;	/* monotonic time bounds were last updated */
+	struct host *next;
+} host_t;
+
+/* get host, creating it if necessary */
+extern host_t *getHost(const char *name);
+
+/* first of all hosts, the others follow through next */
+extern host_t *firstHost(void);
+
+/* get host of URL, NULL if there is no host in it */
+extern host_t *getUrlHost(const char *url);
+
+/*
+ * Add Date header to clock offset estimate.  sent and received are
+ * system times (see getWallTime()) the request was sent and the header
+ * was received.
+ */
+extern void addClockSample(host_t *hp, double sent, double received, time_t date);
+
+/* clock offset estimate and its uncertainty, both 0 if unknown */
+extern double getClockOffset(const host_t *hp, double *uncertainty);
+
+/* add time to first byte of a request, seconds */
+extern void addLatencySample(host_t *hp, double latency);
+
+/* latency quantile (one of LATENCY_xxx), 0 if unknown */
+extern double getLatency(const host_t *hp, int which);
+
+/* current time on the host's clock */
+extern double getHostTime(const host_t *hp);
+
+/* current time on the history host's clock, auction end times use it */
+extern time_t historyTime(void);
+
+#endif /* HOST_H_INCLUDED */
@@ -30,6 +30,7 @@
 #include "http.h"
 #include "html.h"
 #include "esniper.h"
+#include "parser.h"
 
 /*
  * rudimentary HTML parser, maybe, we should use libxml2 instead?
@@ -43,8 +44,8 @@
 const char *
 getTag(memBuf_t *mp)
 {
-	static char *buf = NULL;
-	static size_t bufsize = 0;
+	static THREAD_LOCAL char *buf = NULL;
+	static THREAD_LOCAL size_t bufsize = 0;
 	size_t count = 0;
 	int inStr = 0, comment = 0, c;
 
@@ -154,8 +155,8 @@ getTag(memBuf_t *mp)
 char *
 getNonTag(memBuf_t *mp)
 {
-	static char *buf = NULL;
-	static size_t bufsize = 0;
+	static THREAD_LOCAL char *buf = NULL;
+	static THREAD_LOCAL size_t bufsize = 0;
 	size_t count = 0, amp = 0;
 	int c;
 
@@ -335,8 +336,8 @@ getTableCell(memBuf_t *mp)
 {
 	int nesting = 1;
 	const char *cp, *start = mp->readptr, *end = NULL;
-	static char *buf = NULL;
-	static size_t bufsize = 0;
+	static THREAD_LOCAL char *buf = NULL;
+	static THREAD_LOCAL size_t bufsize = 0;
 	size_t count = 0;
 
 	while ((cp = getTag(mp))) {
@@ -439,3 +440,123 @@ getTableStart(memBuf_t *mp)
 	}
 	return NULL;
 }
+
+void
+initTableStream(tableStream_t *tsp, const char *match, int skipRows)
+{
+	tsp->match = match;
+	tsp->skipRows = skipRows;
+	tsp->offset = 0;
+	tsp->rowStart = 0;
+	tsp->nesting = 0;
+	tsp->inRow = 0;
+	tsp->rows = 0;
+}
+
+/*
+ * Check tag name, ignoring case.  Tag points to character after '<'.
+ */
+static int
+isTagName(const char *tag, size_t len, const char *name)
+{
+	size_t namelen = strlen(name);
+
+	return len >= namelen && !strncasecmp(tag, name, namelen) &&
+		(len == namelen || isspace((int)tag[namelen]) ||
+		 tag[namelen] == '>');
+}
+
+/*
+ * Convert a complete row, from <tr> up to (but not including) end, into
+ * a row.  Returns NULL if row has no cells or is skipped.
+ */
+static char **
+getStreamRow(tableStream_t *tsp, memBuf_t *mp, size_t end)
+{
+	memBuf_t buf;
+	char *s, **row;
+
+	tsp->inRow = 0;
+	if (++tsp->rows <= tsp->skipRows)
+		return NULL;
+	s = myStrndup(mp->memory + tsp->rowStart, end - tsp->rowStart);
+	strToMemBuf(s, &buf);
+	free(s);
+	row = getTableRow(&buf);
+	free(buf.memory);
+	return row;
+}
+
+char **
+getStreamTableRow(tableStream_t *tsp, memBuf_t *mp)
+{
+	const char *buf = mp->memory;
+	size_t size = mp->size;
+
+	while (tsp->offset < size) {
+		const char *lt, *gt, *tag;
+		size_t taglen, start;
+		char **row = NULL;
+
+		if (!(lt = memchr(buf + tsp->offset, '<', size - tsp->offset))) {
+			tsp->offset = size;
+			break;
+		}
+		start = (size_t)(lt - buf);
+		tag = lt + 1;
+		if (size - start >= 4 && !strncmp(tag, "!--", 3)) {
+			const char *end = strstr(tag + 3, "-->");
+
+			if (!end)
+				break;	/* incomplete comment, wait for more */
+			tsp->offset = (size_t)(end - buf) + 3;
+			continue;
+		}
+		if (!(gt = memchr(tag, '>', size - start - 1)))
+			break;		/* incomplete tag, wait for more */
+		taglen = (size_t)(gt - tag);
+
+		if (tsp->nesting == 0) {
+			if (isTagName(tag, taglen, "table")) {
+				char *tmp = myStrndup(tag, taglen);
+
+				if (strstr(tmp, tsp->match)) {
+					tsp->nesting = 1;
+					tsp->inRow = 0;
+					tsp->rows = 0;
+				}
+				free(tmp);
+			}
+		} else if (isTagName(tag, taglen, "table")) {
+			++tsp->nesting;
+		} else if (isTagName(tag, taglen, "/table")) {
+			if (tsp->nesting == 1 && tsp->inRow) {
+				/* row ended by end of table, look at tag again */
+				tsp->offset = start;
+				if ((row = getStreamRow(tsp, mp, start)))
+					return row;
+				continue;
+			}
+			--tsp->nesting;
+		} else if (tsp->nesting == 1 && isTagName(tag, taglen, "tr")) {
+			if (tsp->inRow) {
+				/* row ended by start of next row */
+				tsp->offset = start;
+				if ((row = getStreamRow(tsp, mp, start)))
+					return row;
+				continue;
+			}
+			tsp->inRow = 1;
+			tsp->rowStart = start;
+		} else if (tsp->nesting == 1 && isTagName(tag, taglen, "/tr")) {
+			if (tsp->inRow) {
+				tsp->offset = (size_t)(gt - buf) + 1;
+				if ((row = getStreamRow(tsp, mp, tsp->offset)))
+					return row;
+				continue;
+			}
+		}
+		tsp->offset = (size_t)(gt - buf) + 1;
+	}
+	return NULL;
+}
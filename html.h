@@ -85,5 +85,28 @@ extern char *getTableCell(memBuf_t *mp);
  */
 extern const char *getTableEnd(memBuf_t *mp);
 
+/*
+ * Streaming table parser, for pages that are still being received.
+ * Rows of all tables whose start tag contains match are returned as soon
+ * as they are complete, skipping the first skipRows rows of each table.
+ */
+typedef struct {
+	const char *match;	/* text identifying table start tag */
+	int skipRows;		/* leading rows to skip in each table */
+	size_t offset;		/* parsed up to here */
+	size_t rowStart;	/* start of current row */
+	int nesting;		/* table nesting, 0 = outside of table */
+	int inRow;		/* inside a row of the matching table */
+	int rows;		/* rows seen in current table */
+} tableStream_t;
+
+extern void initTableStream(tableStream_t *tsp, const char *match, int skipRows);
+
+/*
+ * Return next complete table row received so far, or NULL if there is
+ * none (yet).  Row is the same as one returned by getTableRow().
+ */
+extern char **getStreamTableRow(tableStream_t *tsp, memBuf_t *mp);
+
 
 #endif /*HTML_H_*/
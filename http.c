@@ -25,12 +25,25 @@
  */
 
 #include "http.h"
+#include "buffer.h"
+#include "host.h"
+#include "html.h"
+#include "mailbox.h"
+#include "parser.h"
+#include "ratelimit.h"
+#include "timer.h"
 #include "esniper.h"
 #include <ctype.h>
 #include <curl/curl.h>
 #include <curl/easy.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if !defined(WIN32)
+#	include <netdb.h>
+#	include <sys/socket.h>
+#endif
 #if defined(WIN32)
 #	define DEVNULL "nul"
 #else
@@ -39,16 +52,93 @@
 
 enum requestType {GET, POST};
 
-static CURL *easyhandle = NULL;
+/* maximum number of META Refresh redirections followed */
+#define MAX_REDIRECTS 5
+
+/* batch transfers: stop waiting for other transfers this long before a
+ * start time, seconds */
+#define START_SPIN 0.005
+
+/* seconds a learned redirection is used before it is checked again */
+#define REDIRECT_TTL (30 * 60)
+
+/* query values longer than this are replaced by a placeholder in
+ * redirect cache keys, shorter values are part of the key.
+ */
+#define MIN_URL_VALUE 4
+#define MAX_URL_VALUES 9
+#define URL_VALUE_MARK '\001'
+
+typedef struct {
+	int n;
+	char *value[MAX_URL_VALUES];
+} urlValues_t;
+
+/* learned META Refresh redirections */
+typedef struct redirect {
+	char *pattern;		/* request URL, query values templated */
+	char *target;		/* final URL, templated the same way */
+	char *pageName;		/* of the final page, NULL if none */
+	time_t learned;
+	struct redirect *next;
+} redirect_t;
+
+static redirect_t *redirects = NULL;
+static char *redirectURL = NULL;	/* last redirection target */
+
+/* curl state of an account, see useHttpState() */
+struct httpState {
+	CURL *easyhandle;
+	CURLSH *sharehandle;
+	int curlInitDone;
+	char *cookieFile;
+};
+
+static httpState_t defaultState = { NULL, NULL, 0, NULL };
+static httpState_t *state = &defaultState;
 static CURLcode curlrc = CURLE_OK;
 static const char *lastURL = NULL;
-static int curlInitDone = 0;
 static char globalErrorbuf[CURL_ERROR_SIZE];
 
-static memBuf_t *httpRequest(const char *url, const char *logUrl, const char *data, const char *logData, enum requestType);
+static memBuf_t *httpRequest(const char *url, const char *logUrl, const char *data, const char *logData, enum requestType, int useCache);
+static memBuf_t *httpTransfer(const char *url, const char *logUrl, const char *data, const char *logData, enum requestType);
 static memBuf_t *httpRequestFailed(memBuf_t *mp);
+static char *getUrlPattern(const char *url, urlValues_t *vp);
+static char *templateUrl(const char *url, const urlValues_t *vp);
+static char *expandUrl(const char *template, const urlValues_t *vp);
+static void freeUrlValues(urlValues_t *vp);
+static redirect_t *findRedirect(const char *pattern);
+static void removeRedirect(redirect_t *rdp);
+static void addRedirect(const char *pattern, const char *target, const urlValues_t *vp, memBuf_t *mp);
+static char *pageNameOf(memBuf_t *mp);
+static int isSamePage(const redirect_t *rdp, memBuf_t *mp);
+static void scanMetaRefresh(memBuf_t *mp);
+static void initMembuf(memBuf_t *mp);
+static size_t HeaderCallback(void *ptr, size_t size, size_t nmemb, void *data);
+static void requestWritten(CURL *eh, memBuf_t *mp);
+static void hostSample(CURL *eh, const char *url, double start, const memBuf_t *mp);
 static size_t WriteMemoryCallback(void *ptr, size_t size, size_t nmemb, void *data);
 static int initCurlStuffFailed(void);
+typedef struct httpBatchRequest httpBatchRequest_t;
+static size_t WriteBatchCallback(void *ptr, size_t size, size_t nmemb, void *data);
+static int setupBatchRequest(httpBatchRequest_t *rp);
+static void startBatchRequest(httpBatch_t *bp, httpBatchRequest_t *rp);
+static httpBatchRequest_t *readyBatchRequest(httpBatch_t *bp);
+static int preemptBatchRequest(httpBatch_t *bp, requestClass_t rc);
+static void resumeBatchRequests(httpBatch_t *bp);
+static void insertPending(httpBatch_t *bp, httpBatchRequest_t *rp);
+static void unlinkPending(httpBatch_t *bp, httpBatchRequest_t *rp);
+static void unlinkRunning(httpBatch_t *bp, httpBatchRequest_t *rp);
+static void finishBatchRequest(httpBatch_t *bp, CURL *eh, CURLcode rc);
+static int stepHttpBatch(httpBatch_t *bp, double until);
+static httpBatchRequest_t *requeueBatchRequest(httpBatch_t *bp, httpBatchRequest_t *rp, const char *url, int redirects);
+static httpBatchRequest_t *queueBatchRequest(httpBatch_t *bp, const char *url, double startTime, httpDataFunc dataFunc, httpDoneFunc doneFunc, void *data, int redirects);
+static void removeBatchRequest(httpBatch_t *bp, httpBatchRequest_t *rp);
+static void freeBatchRequest(httpBatchRequest_t *rp);
+static int responseStarted(const httpBatchRequest_t *rp);
+static const void *requestKey(const httpState_t *hs);
+static void parseWork(void *data);
+static void parseDone(void *data);
 
 #ifdef NEED_CURL_EASY_STRERROR
 static const char *curl_easy_strerror(CURLcode error);
@@ -75,14 +165,21 @@ httpError(auctionInfo *aip)
 memBuf_t *
 httpGet(const char *url, const char *logUrl)
 {
-	return httpRequest(url, logUrl, "", NULL, GET);
+	return httpRequest(url, logUrl, "", NULL, GET, 0);
+}
+
+/* returns open socket, or NULL on error */
+memBuf_t *
+httpGetCached(const char *url, const char *logUrl)
+{
+	return httpRequest(url, logUrl, "", NULL, GET, 1);
 }
 
 /* returns open socket, or NULL on error */
 memBuf_t *
 httpPost(const char *url, const char *data, const char *logData)
 {
-	return httpRequest(url, NULL, data, logData, POST);
+	return httpRequest(url, NULL, data, logData, POST, 0);
 }
 
 /*
@@ -91,6 +188,7 @@ httpPost(const char *url, const char *data, const char *logData)
 memBuf_t *
 strToMemBuf(const char *s, memBuf_t *mp)
 {
+	initMembuf(mp);
 	mp->timeToFirstByte = time(NULL);
 	mp->memory = myStrdup(s);
 	mp->readptr = mp->memory;
@@ -98,6 +196,24 @@ strToMemBuf(const char *s, memBuf_t *mp)
 	return mp;
 }
 
+static void
+initMembuf(memBuf_t *mp)
+{
+	mp->memory = mp->readptr = NULL;
+	mp->size = 0;
+	mp->timeToFirstByte = 0;
+	mp->headScanned = 0;
+	mp->headDone = 0;
+	mp->metaRefresh = NULL;
+	mp->date = 0;
+	mp->dateReceived = 0;
+	mp->sent = 0;
+	mp->written = 0;
+	mp->connected = 0;
+	mp->firstByte = 0;
+	mp->total = 0;
+}
+
 /*
  * Free membuf.
  */
@@ -106,6 +222,7 @@ freeMembuf(memBuf_t *mp)
 {
 	if (mp) {
 		free(mp->memory);
+		free(mp->metaRefresh);
 		free(mp);
 	}
 }
@@ -116,13 +233,14 @@ freeMembuf(memBuf_t *mp)
 memBuf_t *
 readFile(FILE *fp)
 {
-	static memBuf_t membuf = { NULL, 0, NULL, 0 };
+	static memBuf_t membuf = { NULL, 0, NULL, 0, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0 };
 	static const size_t BUFINC = 20 * 1024;
 	size_t i = 0;
 	int c;
 
-	if (membuf.memory)
-		free(membuf.memory);
+	free(membuf.memory);
+	free(membuf.metaRefresh);
+	initMembuf(&membuf);
 	membuf.size = BUFINC;
 	membuf.memory = (char *)myMalloc(membuf.size);
 	while ((c = getc(fp)) != EOF) {
@@ -137,52 +255,188 @@ readFile(FILE *fp)
 	return &membuf;
 }
 
+/*
+ * Do request and follow META Refresh redirections.
+ *
+ * If useCache is set, a redirection learned from an earlier request for
+ * the same URL pattern is used to go straight to the final URL.  If that
+ * URL fails, redirects again or returns another kind of page (sign in,
+ * captcha), the redirection is forgotten and the request is done the
+ * normal way.
+ */
+static memBuf_t *
+httpRequest(const char *url, const char *logUrl, const char *data, const char *logData, enum requestType rt, int useCache)
+{
+	memBuf_t *mp;
+	char *metaRefresh, *pattern = NULL;
+	urlValues_t values;
+	int i;
+
+	free(redirectURL);
+	redirectURL = NULL;
+	values.n = 0;
+
+	if (useCache && rt == GET) {
+		redirect_t *rdp;
+
+		pattern = getUrlPattern(url, &values);
+		if ((rdp = findRedirect(pattern))) {
+			long code = 0;
+
+			redirectURL = expandUrl(rdp->target, &values);
+			log(("redirect cache: using %s", redirectURL));
+			mp = httpTransfer(redirectURL, NULL, "", NULL, GET);
+			if (mp)
+				curl_easy_getinfo(state->easyhandle, CURLINFO_RESPONSE_CODE, &code);
+			if (mp && code < 400 && !memGetMetaRefresh(mp) &&
+			    isSamePage(rdp, mp)) {
+				memReset(mp);
+				free(pattern);
+				freeUrlValues(&values);
+				return mp;
+			}
+			log(("redirect cache: %s no longer valid", redirectURL));
+			freeMembuf(mp);
+			removeRedirect(rdp);
+			free(redirectURL);
+			redirectURL = NULL;
+		}
+	}
+
+	mp = httpTransfer(url, logUrl, data, logData, rt);
+	log(("checking for META Refresh"));
+	for (i = 0; mp && (metaRefresh = memGetMetaRefresh(mp)) != NULL; ++i) {
+		if (i == MAX_REDIRECTS) {
+			log(("too many META Refresh redirections"));
+			curlrc = CURLE_TOO_MANY_REDIRECTS;
+			freeMembuf(mp);
+			mp = NULL;
+			break;
+		}
+		log(("page redirection by META Refresh: %s\n", metaRefresh));
+		free(redirectURL);
+		redirectURL = myStrdup(metaRefresh);
+		freeMembuf(mp);
+		mp = httpTransfer(redirectURL, NULL, "", NULL, GET);
+	}
+	if (mp) {
+		log(("META Refresh scan: %lu of %lu bytes, %lu skipped",
+		     (unsigned long)mp->headScanned, (unsigned long)mp->size,
+		     (unsigned long)(mp->size - mp->headScanned)));
+		memReset(mp);
+		if (pattern && redirectURL)
+			addRedirect(pattern, redirectURL, &values, mp);
+	}
+	free(pattern);
+	freeUrlValues(&values);
+	return mp;
+}
+
+/*
+ * Do a single request.
+ */
 static memBuf_t *
-httpRequest(const char *url, const char *logUrl, const char *data, const char *logData, enum requestType rt)
+httpTransfer(const char *url, const char *logUrl, const char *data, const char *logData, enum requestType rt)
 {
 	const char *nonNullData = data ? data : "";
 	memBuf_t *mp = (memBuf_t *)myMalloc(sizeof(memBuf_t));
-	char *metaRefresh;
-
-	mp->memory = mp->readptr = NULL;
-	mp->size = 0;
-	mp->timeToFirstByte = 0;
+	double start;
 
+	initMembuf(mp);
 	lastURL = url;
 
-	if (!curlInitDone && initCurlStuff())
+	if (!state->curlInitDone && initCurlStuff())
 		return NULL;
 
 	/* Note: was CURLOPT_WRITEDATA, which is the same as CURLOPT_FILE.
 	 * Some older versions of libcurl don't have CURLOPT_WRITEDATA.
 	 */
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_FILE, (void *)mp)))
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_FILE, (void *)mp)))
+		return httpRequestFailed(mp);
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_WRITEHEADER, (void *)mp)))
 		return httpRequestFailed(mp);
 
 	if (rt == GET) {
-		if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_HTTPGET, 1)))
+		if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_HTTPGET, 1)))
 			return httpRequestFailed(mp);
 	} else {
 		log(("%s", logData ? logData : nonNullData));
-		if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_POSTFIELDS, nonNullData)))
+		if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_POSTFIELDS, nonNullData)))
 			return httpRequestFailed(mp);
 	}
 
 	log(("%s", logUrl ? logUrl : url));
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_URL, url)))
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_URL, url)))
 		return httpRequestFailed(mp);
 
-	if ((curlrc = curl_easy_perform(easyhandle)))
+	start = getWallTime();
+	mp->sent = getMonotonicTime();
+	takeRequest(getUrlHost(url), requestKey(state));
+	if ((curlrc = curl_easy_perform(state->easyhandle)))
 		return httpRequestFailed(mp);
+	hostSample(state->easyhandle, url, start, mp);
+	requestWritten(state->easyhandle, mp);
 
-	log(("checking for META Refresh"));
-	if ((metaRefresh = memGetMetaRefresh(mp)) != NULL) {
-		log(("page redirection by META Refresh: %s\n", metaRefresh));
-		freeMembuf(mp);
-		return httpGet(metaRefresh, NULL);
+	return mp;
+}
+
+/*
+ * Save Date header for server clock offset estimate.
+ */
+static size_t
+HeaderCallback(void *ptr, size_t size, size_t nmemb, void *data)
+{
+	size_t len = size * nmemb;
+	memBuf_t *mp = (memBuf_t *)data;
+
+	if (len > 5 && !strncasecmp((char *)ptr, "Date:", 5)) {
+		char *date = myStrndup((char *)ptr + 5, len - 5);
+
+		mp->dateReceived = getWallTime();
+		mp->date = curl_getdate(date, NULL);
+		if (mp->date < 0)
+			mp->date = 0;
+		free(date);
 	}
+	return len;
+}
 
-	return mp;
+/*
+ * Add latency and Date header of finished transfer to its host.  The
+ * request was sent after connecting, start is when the transfer was
+ * started.
+ */
+static void
+hostSample(CURL *eh, const char *url, double start, const memBuf_t *mp)
+{
+	host_t *hp = getUrlHost(url);
+	double pretransfer = 0, starttransfer = 0;
+
+	if (!hp)
+		return;
+	if (!curl_easy_getinfo(eh, CURLINFO_STARTTRANSFER_TIME, &starttransfer) &&
+	    starttransfer > 0)
+		addLatencySample(hp, starttransfer);
+	if (mp->date) {
+		curl_easy_getinfo(eh, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+		addClockSample(hp, start + pretransfer, mp->dateReceived, mp->date);
+	}
+}
+
+/*
+ * Record when the request of a finished transfer was written, and the
+ * times of its other phases.
+ */
+static void
+requestWritten(CURL *eh, memBuf_t *mp)
+{
+	double pretransfer = 0;
+
+	if (!curl_easy_getinfo(eh, CURLINFO_PRETRANSFER_TIME, &pretransfer))
+		mp->written = mp->sent + pretransfer;
+	(void)curl_easy_getinfo(eh, CURLINFO_CONNECT_TIME, &mp->connected);
+	(void)curl_easy_getinfo(eh, CURLINFO_STARTTRANSFER_TIME, &mp->firstByte);
+	(void)curl_easy_getinfo(eh, CURLINFO_TOTAL_TIME, &mp->total);
 }
 
 static memBuf_t *
@@ -194,6 +448,207 @@ httpRequestFailed(memBuf_t *mp)
 	return NULL;
 }
 
+/*
+ * Redirect cache key: URL with long query values replaced by numbered
+ * placeholders.  The values are saved in vp.
+ */
+static char *
+getUrlPattern(const char *url, urlValues_t *vp)
+{
+	const char *cp = strchr(url, '?');
+	char *buf = NULL;
+	size_t bufsize = 0, count = 0;
+
+	vp->n = 0;
+	if (!cp)
+		return myStrdup(url);
+	for (; url <= cp; ++url)
+		addchar(buf, bufsize, count, *url);
+	while (*url) {
+		const char *end = url + strcspn(url, "&");
+		const char *eq = memchr(url, '=', (size_t)(end - url));
+
+		if (eq && end - eq - 1 >= MIN_URL_VALUE && vp->n < MAX_URL_VALUES) {
+			for (; url <= eq; ++url)
+				addchar(buf, bufsize, count, *url);
+			addchar(buf, bufsize, count, URL_VALUE_MARK);
+			addchar(buf, bufsize, count, (char)('0' + vp->n));
+			vp->value[vp->n++] = myStrndup(eq + 1, (size_t)(end - eq - 1));
+		} else {
+			for (; url < end; ++url)
+				addchar(buf, bufsize, count, *url);
+		}
+		if (*end)
+			addchar(buf, bufsize, count, *end++);
+		url = end;
+	}
+	term(buf, bufsize, count);
+	return buf;
+}
+
+/*
+ * Replace values of the request URL that show up in url by placeholders.
+ */
+static char *
+templateUrl(const char *url, const urlValues_t *vp)
+{
+	char *buf = NULL;
+	size_t bufsize = 0, count = 0;
+
+	while (*url) {
+		int i;
+
+		for (i = 0; i < vp->n; ++i) {
+			size_t len = strlen(vp->value[i]);
+
+			if (!strncmp(url, vp->value[i], len)) {
+				addchar(buf, bufsize, count, URL_VALUE_MARK);
+				addchar(buf, bufsize, count, (char)('0' + i));
+				url += len;
+				break;
+			}
+		}
+		if (i == vp->n)
+			addchar(buf, bufsize, count, *url++);
+	}
+	term(buf, bufsize, count);
+	return buf;
+}
+
+/*
+ * Replace placeholders by values of the request URL.
+ */
+static char *
+expandUrl(const char *template, const urlValues_t *vp)
+{
+	char *buf = NULL;
+	size_t bufsize = 0, count = 0;
+
+	for (; *template; ++template) {
+		if (*template == URL_VALUE_MARK && template[1] >= '0' &&
+		    template[1] < '0' + vp->n) {
+			const char *cp = vp->value[*++template - '0'];
+
+			while (*cp)
+				addchar(buf, bufsize, count, *cp++);
+		} else
+			addchar(buf, bufsize, count, *template);
+	}
+	term(buf, bufsize, count);
+	return buf;
+}
+
+static void
+freeUrlValues(urlValues_t *vp)
+{
+	while (vp->n > 0)
+		free(vp->value[--vp->n]);
+}
+
+/*
+ * Find learned redirection, expired redirections are forgotten.
+ */
+static redirect_t *
+findRedirect(const char *pattern)
+{
+	redirect_t *rdp;
+
+	for (rdp = redirects; rdp; rdp = rdp->next) {
+		if (strcmp(rdp->pattern, pattern))
+			continue;
+		if (time(NULL) - rdp->learned > REDIRECT_TTL) {
+			log(("redirect cache: %s expired", rdp->target));
+			removeRedirect(rdp);
+			return NULL;
+		}
+		return rdp;
+	}
+	return NULL;
+}
+
+static void
+removeRedirect(redirect_t *rdp)
+{
+	redirect_t **rdpp;
+
+	for (rdpp = &redirects; *rdpp; rdpp = &(*rdpp)->next) {
+		if (*rdpp == rdp) {
+			*rdpp = rdp->next;
+			free(rdp->pattern);
+			free(rdp->target);
+			free(rdp->pageName);
+			free(rdp);
+			return;
+		}
+	}
+}
+
+/*
+ * Learn redirection to target, whose page is mp.  Only targets that
+ * contain all values of the request URL are learned: a fixed target (a
+ * sign in page, or a URL keyed by something else) would serve the same
+ * page for every request with this pattern.
+ */
+static void
+addRedirect(const char *pattern, const char *target, const urlValues_t *vp, memBuf_t *mp)
+{
+	redirect_t *rdp = findRedirect(pattern);
+	char *template;
+	int i;
+
+	if (rdp)
+		removeRedirect(rdp);
+	template = templateUrl(target, vp);
+	for (i = 0; i < vp->n; ++i) {
+		char mark[3];
+
+		mark[0] = URL_VALUE_MARK;
+		mark[1] = (char)('0' + i);
+		mark[2] = '\0';
+		if (!strstr(template, mark)) {
+			log(("redirect cache: %s lacks request value %d, not learned", target, i));
+			free(template);
+			return;
+		}
+	}
+	rdp = (redirect_t *)myMalloc(sizeof(redirect_t));
+	rdp->pattern = myStrdup(pattern);
+	rdp->target = template;
+	rdp->pageName = pageNameOf(mp);
+	rdp->learned = time(NULL);
+	rdp->next = redirects;
+	redirects = rdp;
+	log(("redirect cache: learned %s", target));
+}
+
+/* page name of mp, NULL if none */
+static char *
+pageNameOf(memBuf_t *mp)
+{
+	char *pageName;
+
+	memReset(mp);
+	pageName = getPageName(mp);
+	pageName = pageName ? myStrdup(pageName) : NULL;
+	memReset(mp);
+	return pageName;
+}
+
+/* is mp the same kind of page the redirection was learned with? */
+static int
+isSamePage(const redirect_t *rdp, memBuf_t *mp)
+{
+	char *pageName = pageNameOf(mp);
+	int ret = pageName && rdp->pageName ? !strcmp(pageName, rdp->pageName) :
+					      pageName == rdp->pageName;
+
+	if (!ret) {
+		log(("redirect cache: page %s, learned with %s", nullStr(pageName), nullStr(rdp->pageName)));
+	}
+	free(pageName);
+	return ret;
+}
+
 /*
  * Returns 0 on success, non-0 otherwise.
  */
@@ -206,52 +661,72 @@ initCurlStuff(void)
 	curl_global_init(CURL_GLOBAL_ALL);
 
 	/* init the curl session */
-	if (!(easyhandle = curl_easy_init()))
+	if (!(state->easyhandle = curl_easy_init()))
+		return -1;
+
+	/* cookies, DNS and SSL sessions are shared with batch transfers */
+	if (!(state->sharehandle = curl_share_init()))
 		return -1;
+	curl_share_setopt(state->sharehandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
+	curl_share_setopt(state->sharehandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(state->sharehandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+	curl_share_setopt(state->sharehandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_SHARE, state->sharehandle)))
+		return initCurlStuffFailed();
 
 	/* buffer for error messages */
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_ERRORBUFFER, globalErrorbuf)))
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_ERRORBUFFER, globalErrorbuf)))
 		return initCurlStuffFailed();
 
 	/* debug output, show what libcurl does */
 	if (options.curldebug &&
-		 (curlrc = curl_easy_setopt(easyhandle, CURLOPT_VERBOSE, 1)))
+		 (curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_VERBOSE, 1)))
 		return initCurlStuffFailed();
 
 	/* follow all redirects */
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_FOLLOWLOCATION, 1)))
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_FOLLOWLOCATION, 1)))
 		return initCurlStuffFailed();
 
 	/* use proxy */
 	if (options.proxy &&
-		 (curlrc = curl_easy_setopt(easyhandle, CURLOPT_PROXY, options.proxy)))
+		 (curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_PROXY, options.proxy)))
 		return initCurlStuffFailed();
 
 	/* send all data to this function */
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback)))
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_WRITEFUNCTION, WriteMemoryCallback)))
+		return initCurlStuffFailed();
+
+	/* Date headers, for server clock offset */
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_HEADERFUNCTION, HeaderCallback)))
 		return initCurlStuffFailed();
 
 	/* some servers don't like requests that are made without a user-agent
 	 * field, so we provide one */
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_USERAGENT, "Mozilla/4.7 [en] (X11; U; Linux 2.2.12 i686)")))
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_USERAGENT, "Mozilla/4.7 [en] (X11; U; Linux 2.2.12 i686)")))
 		return initCurlStuffFailed();
 
 	/* some servers don't like requests that are made without a user-agent
 	 * field, so we provide one */
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_COOKIEFILE, "")))
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_COOKIEFILE, "")))
 		return initCurlStuffFailed();
 
 	slist = curl_slist_append(slist, "Accept: text/*");
 	slist = curl_slist_append(slist, "Accept-Language: en");
 	slist = curl_slist_append(slist, "Accept-Charset: iso-8859-1,*,utf-8");
 	slist = curl_slist_append(slist, "Cache-Control: no-cache");
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_HTTPHEADER, slist)))
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_HTTPHEADER, slist)))
 		return initCurlStuffFailed();
 
-	if ((curlrc = curl_easy_setopt(easyhandle, CURLOPT_COOKIEFILE, DEVNULL)))
+	/* cookies kept from an earlier run, or just enable cookies */
+	if ((curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_COOKIEFILE, state->cookieFile ? state->cookieFile : DEVNULL)))
+		return initCurlStuffFailed();
+	if (state->cookieFile &&
+	    (curlrc = curl_easy_setopt(state->easyhandle, CURLOPT_COOKIEJAR, state->cookieFile)))
 		return initCurlStuffFailed();
 
-	curlInitDone = 1;
+	state->curlInitDone = 1;
 	return 0;
 }
 
@@ -266,12 +741,102 @@ initCurlStuffFailed(void)
 void
 cleanupCurlStuff(void)
 {
-	if (easyhandle) {
-		curl_easy_cleanup(easyhandle);
-		easyhandle = NULL;
+	if (state->easyhandle) {
+		/* writes cookie file */
+#if defined(WIN32)
+		curl_easy_cleanup(state->easyhandle);
+#else
+		mode_t mask = umask(077);
+
+		curl_easy_cleanup(state->easyhandle);
+		umask(mask);
+		if (state->cookieFile)
+			(void)chmod(state->cookieFile, 0600);
+#endif
+		state->easyhandle = NULL;
+	}
+	if (state->sharehandle) {
+		curl_share_cleanup(state->sharehandle);
+		state->sharehandle = NULL;
 	}
 	curl_global_cleanup();
-	curlInitDone = 0;
+	state->curlInitDone = 0;
+}
+
+/* request limit key of a state, NULL for the first account */
+static const void *
+requestKey(const httpState_t *hs)
+{
+	return hs == &defaultState ? NULL : (const void *)hs;
+}
+
+httpState_t *
+newHttpState(void)
+{
+	httpState_t *hs = (httpState_t *)myMalloc(sizeof(httpState_t));
+
+	hs->easyhandle = NULL;
+	hs->sharehandle = NULL;
+	hs->curlInitDone = 0;
+	hs->cookieFile = NULL;
+	return hs;
+}
+
+void
+useHttpState(httpState_t *hs)
+{
+	state = hs ? hs : &defaultState;
+	setRequestKey(requestKey(state));
+}
+
+void
+freeHttpState(httpState_t *hs)
+{
+	httpState_t *old = state;
+
+	if (!hs || hs == &defaultState)
+		return;
+	state = hs;
+	cleanupCurlStuff();
+	free(hs->cookieFile);
+	state = old == hs ? &defaultState : old;
+	free(hs);
+}
+
+void
+setCookieFile(const char *path)
+{
+	free(state->cookieFile);
+	state->cookieFile = path ? myStrdup(path) : NULL;
+	if (state->easyhandle)
+		(void)curl_easy_setopt(state->easyhandle, CURLOPT_COOKIEJAR, state->cookieFile);
+}
+
+void
+saveCookies(void)
+{
+#if !defined(WIN32)
+	mode_t mask;
+#endif
+
+	if (!state->cookieFile || !state->easyhandle)
+		return;
+#if defined(WIN32)
+	(void)curl_easy_setopt(state->easyhandle, CURLOPT_COOKIELIST, "FLUSH");
+#else
+	mask = umask(077);
+	(void)curl_easy_setopt(state->easyhandle, CURLOPT_COOKIELIST, "FLUSH");
+	umask(mask);
+	(void)chmod(state->cookieFile, 0600);
+#endif
+	log(("cookies saved to %s", state->cookieFile));
+}
+
+void
+clearCookies(void)
+{
+	if (state->easyhandle)
+		(void)curl_easy_setopt(state->easyhandle, CURLOPT_COOKIELIST, "ALL");
 }
 
 static size_t
@@ -288,9 +853,764 @@ WriteMemoryCallback(void *ptr, size_t size, size_t nmemb, void *data)
 	memcpy(&(mp->memory[mp->size]), ptr, realsize);
 	mp->size += realsize;
 	mp->memory[mp->size] = 0;
+	scanMetaRefresh(mp);
 	return realsize;
 }
 
+/*
+ * Batch of concurrent transfers, see http.h.
+ */
+struct httpBatchRequest {
+	char *url;
+	memBuf_t *mp;
+	CURL *eh;		/* transfer handle, NULL if not set up yet */
+	httpDataFunc dataFunc;
+	httpDataFunc parseFunc;	/* run on a parser thread, see parser.h */
+	httpDoneFunc doneFunc;
+	void *data;
+	char errorbuf[CURL_ERROR_SIZE];
+	httpState_t *state;	/* of the account that queued it */
+	int redirects;		/* META Refresh redirections so far */
+	int nobody;		/* HEAD request */
+	int active;		/* transfer started */
+	int paused;		/* transfer paused for a higher class */
+	requestClass_t rc;	/* priority class, see ratelimit.h */
+	char *pattern;		/* redirect cache key, NULL if not cached */
+	urlValues_t values;	/* of pattern */
+	char *cachedFrom;	/* request URL if url is a learned redirection */
+	double queued;		/* monotonic time it was queued */
+	struct curl_slist *connectTo;	/* CURLOPT_CONNECT_TO, may be NULL */
+	httpBatchRequest_t *twin;	/* other request of a hedged pair */
+	int hedge;		/* second request of a hedged pair */
+	double startTime;	/* don't start before, monotonic clock */
+	double start;		/* system time transfer was started */
+	httpBatchRequest_t *next;
+};
+
+/* page of a batch request handed to a parser thread */
+typedef struct {
+	httpBatch_t *bp;
+	memBuf_t *mp;
+	httpDataFunc parseFunc;
+	httpDoneFunc doneFunc;
+	void *data;
+} parseJob_t;
+
+struct httpBatch {
+	CURLM *multi;
+	int maxTransfers;
+	int active;		/* transfers running, not paused */
+	int paused;
+	int parsing;		/* pages handed to parser threads */
+	int failed;
+	requestClass_t rc;	/* class of requests queued next */
+	httpBatchRequest_t *pending;	/* requests not yet started, by start time */
+	httpBatchRequest_t *lastPending;
+	httpBatchRequest_t *running;	/* started, paused or not */
+};
+
+httpBatch_t *
+newHttpBatch(int maxTransfers)
+{
+	httpBatch_t *bp = (httpBatch_t *)myMalloc(sizeof(httpBatch_t));
+
+	bp->multi = curl_multi_init();
+	bp->maxTransfers = maxTransfers > 0 ? maxTransfers : 1;
+	bp->active = 0;
+	bp->paused = 0;
+	bp->parsing = 0;
+	bp->failed = 0;
+	bp->rc = REQUEST_POLL;
+	bp->pending = bp->lastPending = NULL;
+	bp->running = NULL;
+	return bp;
+}
+
+void
+httpBatchClass(httpBatch_t *bp, requestClass_t rc)
+{
+	bp->rc = rc;
+}
+
+void
+httpBatchGet(httpBatch_t *bp, const char *url, httpDataFunc dataFunc, httpDoneFunc doneFunc, void *data)
+{
+	(void)queueBatchRequest(bp, url, 0, dataFunc, doneFunc, data, 0);
+}
+
+/*
+ * Timed requests are set up when queued, so that only the transfer
+ * itself is left for the start time.
+ */
+void
+httpBatchGetAt(httpBatch_t *bp, const char *url, double startTime, httpDataFunc dataFunc, httpDoneFunc doneFunc, void *data)
+{
+	httpBatchRequest_t *rp = queueBatchRequest(bp, url, startTime, dataFunc, doneFunc, data, 0);
+
+	if (!state->curlInitDone && initCurlStuff())
+		return;
+	(void)setupBatchRequest(rp);
+}
+
+void
+httpBatchGetParsed(httpBatch_t *bp, const char *url, double startTime, httpDataFunc parseFunc, httpDoneFunc doneFunc, void *data)
+{
+	httpBatchRequest_t *rp = queueBatchRequest(bp, url, startTime, NULL, doneFunc, data, 0);
+
+	rp->parseFunc = parseFunc;
+	if (!state->curlInitDone && initCurlStuff())
+		return;
+	(void)setupBatchRequest(rp);
+}
+
+/*
+ * Like httpRequest() with useCache, but a learned redirection that no
+ * longer holds is found out in finishBatchRequest().
+ */
+void
+httpBatchGetCached(httpBatch_t *bp, const char *url, double startTime, httpDataFunc parseFunc, httpDoneFunc doneFunc, void *data)
+{
+	urlValues_t values;
+	char *pattern = getUrlPattern(url, &values);
+	redirect_t *rdp = findRedirect(pattern);
+	char *target = rdp ? expandUrl(rdp->target, &values) : NULL;
+	httpBatchRequest_t *rp = queueBatchRequest(bp, target ? target : url, startTime, NULL, doneFunc, data, 0);
+
+	if (target) {
+		log(("redirect cache: using %s", target));
+		rp->cachedFrom = myStrdup(url);
+		free(target);
+	}
+	rp->pattern = pattern;
+	rp->values = values;
+	rp->parseFunc = parseFunc;
+	if (!state->curlInitDone && initCurlStuff())
+		return;
+	(void)setupBatchRequest(rp);
+}
+
+void
+httpBatchGetHedged(httpBatch_t *bp, const char *url, double startTime, double hedgeDelay, const char *connectTo, httpDoneFunc doneFunc, void *data)
+{
+	httpBatchRequest_t *rp = queueBatchRequest(bp, url, startTime, NULL, doneFunc, data, 0);
+	httpBatchRequest_t *hp = queueBatchRequest(bp, url, startTime + hedgeDelay, NULL, doneFunc, data, 0);
+
+	rp->twin = hp;
+	hp->twin = rp;
+	hp->hedge = 1;
+	if (connectTo)
+		hp->connectTo = curl_slist_append(NULL, connectTo);
+	if (!state->curlInitDone && initCurlStuff())
+		return;
+	(void)setupBatchRequest(rp);
+	(void)setupBatchRequest(hp);
+}
+
+void
+httpBatchConnect(httpBatch_t *bp, const char *url, const char *connectTo, double startTime)
+{
+	httpBatchRequest_t *rp = queueBatchRequest(bp, url, startTime, NULL, NULL, NULL, 0);
+
+	rp->nobody = 1;
+	if (connectTo)
+		rp->connectTo = curl_slist_append(NULL, connectTo);
+}
+
+char *
+getConnectTo(const char *host)
+{
+#if defined(WIN32)
+	return NULL;
+#else
+	const char *colon = strrchr(host, ':');
+	char *name = colon ? myStrndup(host, (size_t)(colon - host)) : myStrdup(host);
+	const char *port = colon ? colon + 1 : "80";
+	struct addrinfo hints, *res = NULL, *ap;
+	char first[NI_MAXHOST], addr[NI_MAXHOST];
+	char *ret = NULL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(name, port, &hints, &res) || !res) {
+		free(name);
+		return NULL;
+	}
+	/* curl uses the first address, take the last different one */
+	first[0] = '\0';
+	if (!getnameinfo(res->ai_addr, res->ai_addrlen, first, sizeof(first), NULL, 0, NI_NUMERICHOST)) {
+		for (ap = res->ai_next; ap; ap = ap->ai_next) {
+			if (getnameinfo(ap->ai_addr, ap->ai_addrlen, addr, sizeof(addr), NULL, 0, NI_NUMERICHOST) ||
+			    !strcmp(addr, first))
+				continue;
+			free(ret);
+			ret = myMalloc(strlen(name) + strlen(addr) + 2 * strlen(port) + 6);
+			if (strchr(addr, ':'))	/* IPv6 */
+				sprintf(ret, "%s:%s:[%s]:%s", name, port, addr, port);
+			else
+				sprintf(ret, "%s:%s:%s:%s", name, port, addr, port);
+		}
+	}
+	freeaddrinfo(res);
+	free(name);
+	log(("getConnectTo(%s): %s", host, nullStr(ret)));
+	return ret;
+#endif
+}
+
+static httpBatchRequest_t *
+queueBatchRequest(httpBatch_t *bp, const char *url, double startTime, httpDataFunc dataFunc, httpDoneFunc doneFunc, void *data, int redirects)
+{
+	httpBatchRequest_t *rp = (httpBatchRequest_t *)myMalloc(sizeof(httpBatchRequest_t));
+
+	rp->url = myStrdup(url);
+	rp->mp = NULL;
+	rp->eh = NULL;
+	rp->dataFunc = dataFunc;
+	rp->parseFunc = NULL;
+	rp->doneFunc = doneFunc;
+	rp->data = data;
+	rp->errorbuf[0] = '\0';
+	rp->state = state;
+	rp->redirects = redirects;
+	rp->nobody = 0;
+	rp->active = 0;
+	rp->paused = 0;
+	rp->rc = bp->rc;
+	rp->pattern = NULL;
+	rp->values.n = 0;
+	rp->cachedFrom = NULL;
+	rp->queued = getMonotonicTime();
+	rp->connectTo = NULL;
+	rp->twin = NULL;
+	rp->hedge = 0;
+	rp->startTime = startTime;
+	insertPending(bp, rp);
+	return rp;
+}
+
+/*
+ * Keep pending requests ordered by start time, FIFO within the same
+ * start time.
+ */
+static void
+insertPending(httpBatch_t *bp, httpBatchRequest_t *rp)
+{
+	rp->next = NULL;
+	if (!bp->lastPending || bp->lastPending->startTime <= rp->startTime) {
+		if (bp->lastPending)
+			bp->lastPending->next = rp;
+		else
+			bp->pending = rp;
+		bp->lastPending = rp;
+	} else {
+		httpBatchRequest_t **rpp = &bp->pending;
+
+		while ((*rpp)->startTime <= rp->startTime)
+			rpp = &(*rpp)->next;
+		rp->next = *rpp;
+		*rpp = rp;
+	}
+}
+
+static void
+unlinkPending(httpBatch_t *bp, httpBatchRequest_t *rp)
+{
+	httpBatchRequest_t **rpp = &bp->pending, *prev = NULL;
+
+	for (; *rpp && *rpp != rp; rpp = &(*rpp)->next)
+		prev = *rpp;
+	if (*rpp) {
+		*rpp = rp->next;
+		if (bp->lastPending == rp)
+			bp->lastPending = prev;
+	}
+	rp->next = NULL;
+}
+
+static void
+unlinkRunning(httpBatch_t *bp, httpBatchRequest_t *rp)
+{
+	httpBatchRequest_t **rpp;
+
+	for (rpp = &bp->running; *rpp; rpp = &(*rpp)->next) {
+		if (*rpp == rp) {
+			*rpp = rp->next;
+			break;
+		}
+	}
+	rp->next = NULL;
+}
+
+/*
+ * Remove request from the pending queue, or stop its transfer.
+ */
+static void
+removeBatchRequest(httpBatch_t *bp, httpBatchRequest_t *rp)
+{
+	if (rp->active) {
+		curl_multi_remove_handle(bp->multi, rp->eh);
+		if (rp->paused)
+			--bp->paused;
+		else
+			--bp->active;
+		unlinkRunning(bp, rp);
+	} else
+		unlinkPending(bp, rp);
+	freeBatchRequest(rp);
+}
+
+static void
+freeBatchRequest(httpBatchRequest_t *rp)
+{
+	if (rp->eh)
+		curl_easy_cleanup(rp->eh);
+	curl_slist_free_all(rp->connectTo);
+	freeMembuf(rp->mp);
+	free(rp->url);
+	free(rp->pattern);
+	freeUrlValues(&rp->values);
+	free(rp->cachedFrom);
+	free(rp);
+}
+
+/*
+ * Has the response of a started transfer begun to arrive?
+ */
+static int
+responseStarted(const httpBatchRequest_t *rp)
+{
+	double starttransfer = 0;
+
+	return rp->active &&
+	       !curl_easy_getinfo(rp->eh, CURLINFO_STARTTRANSFER_TIME, &starttransfer) &&
+	       starttransfer > 0;
+}
+
+/*
+ * Pending request of the highest class whose start time has come, the
+ * first queued of that class (a cancelled request keeps its place, see
+ * preemptBatchRequest()).  NULL if there is none.
+ */
+static httpBatchRequest_t *
+readyBatchRequest(httpBatch_t *bp)
+{
+	httpBatchRequest_t *rp, *best = NULL;
+	double now = getMonotonicTime();
+
+	for (rp = bp->pending; rp && rp->startTime <= now; rp = rp->next) {
+		if (!best || rp->rc < best->rc ||
+		    (rp->rc == best->rc && rp->queued < best->queued))
+			best = rp;
+	}
+	return best;
+}
+
+/*
+ * Make room for a request of class rc: stop the running transfer of the
+ * lowest class below rc.  If its response has started it is paused,
+ * else it is cancelled and queued again.  Transfers with a dataFunc are
+ * always paused: data passed on cannot be taken back, and the request
+ * must not be seen twice.
+ *
+ * returns 1 if a transfer was stopped, 0 if there is none to stop.
+ */
+static int
+preemptBatchRequest(httpBatch_t *bp, requestClass_t rc)
+{
+	httpBatchRequest_t *rp, *victim = NULL;
+
+	for (rp = bp->running; rp; rp = rp->next) {
+		if (!rp->paused && rp->rc > rc && !rp->twin &&
+		    (!victim || rp->rc >= victim->rc))
+			victim = rp;
+	}
+	if (!victim)
+		return 0;
+	if (responseStarted(victim) || victim->dataFunc) {
+		log(("batch: %s: paused for a %s request", victim->url, requestClassName(rc)));
+		(void)curl_easy_pause(victim->eh, CURLPAUSE_ALL);
+		victim->paused = 1;
+		++bp->paused;
+		--bp->active;
+		addPreemption(victim->rc, 0);
+	} else {
+		log(("batch: %s: cancelled for a %s request, queued again", victim->url, requestClassName(rc)));
+		curl_multi_remove_handle(bp->multi, victim->eh);
+		curl_easy_cleanup(victim->eh);
+		victim->eh = NULL;
+		freeMembuf(victim->mp);
+		victim->mp = NULL;
+		victim->active = 0;
+		--bp->active;
+		unlinkRunning(bp, victim);
+		victim->startTime = 0;
+		insertPending(bp, victim);
+		addPreemption(victim->rc, 1);
+	}
+	return 1;
+}
+
+/*
+ * Resume paused transfers, highest class first, while there is room and
+ * no pending request of a higher class is ready.
+ */
+static void
+resumeBatchRequests(httpBatch_t *bp)
+{
+	while (bp->paused && bp->active < bp->maxTransfers) {
+		httpBatchRequest_t *rp, *best = NULL, *ready = readyBatchRequest(bp);
+
+		for (rp = bp->running; rp; rp = rp->next) {
+			if (rp->paused && (!best || rp->rc < best->rc))
+				best = rp;
+		}
+		if (!best || (ready && ready->rc < best->rc))
+			return;
+		log(("batch: %s: resumed", best->url));
+		best->paused = 0;
+		--bp->paused;
+		++bp->active;
+		(void)curl_easy_pause(best->eh, CURLPAUSE_CONT);
+	}
+}
+
+/*
+ * Run all transfers in a batch, including those queued by callbacks.
+ *
+ * Of the requests whose start time has come, the highest class (see
+ * ratelimit.h) goes first.  If all maxTransfers are in use, a transfer
+ * of a lower class is paused or cancelled for it (see
+ * preemptBatchRequest()), and resumed when there is room again.
+ *
+ * returns number of failed transfers.
+ */
+int
+runHttpBatch(httpBatch_t *bp)
+{
+	if (!state->curlInitDone && initCurlStuff())
+		return -1;
+	while (stepHttpBatch(bp, 0))
+		;
+	return bp->failed;
+}
+
+int
+runHttpBatchUntil(httpBatch_t *bp, double until)
+{
+	if (!state->curlInitDone && initCurlStuff())
+		return httpBatchBusy(bp);
+	while (stepHttpBatch(bp, until) && getMonotonicTime() < until)
+		;
+	return httpBatchBusy(bp);
+}
+
+int
+httpBatchBusy(const httpBatch_t *bp)
+{
+	return bp->pending || bp->active || bp->paused || bp->parsing;
+}
+
+/*
+ * Start requests that are due, and wait for transfers at most a second,
+ * or until until (monotonic clock) if it is not 0.  Mail is only read
+ * while pages of this batch are parsed, so that other mail doesn't hold
+ * up timed requests, like bids.
+ *
+ * returns 1 if the batch is still busy, else 0.
+ */
+static int
+stepHttpBatch(httpBatch_t *bp, double until)
+{
+	int running, numfds, msgs, timeout = 1000;
+	CURLMsg *msg;
+	struct curl_waitfd mail;
+
+	if (until > 0) {
+		double left = until - getMonotonicTime();
+
+		if (left < timeout / 1000.0)
+			timeout = left > 0 ? (int)(left * 1000) : 0;
+	}
+	resumeBatchRequests(bp);
+	while (bp->pending) {
+		httpBatchRequest_t *rp = readyBatchRequest(bp);
+
+		if (!rp) {
+			double wait = bp->pending->startTime - getMonotonicTime();
+
+			/* not yet?  Keep other transfers going until
+			 * shortly before start time.
+			 */
+			if (wait > START_SPIN &&
+			    (bp->active || bp->paused || bp->parsing ||
+			     (until > 0 && bp->pending->startTime > until))) {
+				if (wait - START_SPIN < timeout / 1000.0)
+					timeout = (int)((wait - START_SPIN) * 1000);
+				break;
+			}
+			rp = bp->pending;
+		}
+		if (bp->active >= bp->maxTransfers &&
+		    !preemptBatchRequest(bp, rp->rc))
+			break;
+		if (rp->startTime > getMonotonicTime())
+			fireAt(rp->startTime);
+		startBatchRequest(bp, rp);
+	}
+
+	curl_multi_perform(bp->multi, &running);
+	while ((msg = curl_multi_info_read(bp->multi, &msgs))) {
+		if (msg->msg == CURLMSG_DONE)
+			finishBatchRequest(bp, msg->easy_handle, msg->data.result);
+	}
+	/* mail (parsed pages) wakes us up too */
+	mail.fd = bp->parsing ? mailboxFd() : -1;
+	mail.events = CURL_WAIT_POLLIN;
+	mail.revents = 0;
+	if (bp->active || bp->paused || bp->parsing)
+		curl_multi_wait(bp->multi, mail.fd >= 0 ? &mail : NULL,
+				mail.fd >= 0 ? 1 : 0, timeout, &numfds);
+	else if (bp->pending && until > 0)
+		fireAt(until);
+	if (mail.revents & CURL_WAIT_POLLIN)
+		(void)readMailbox();
+	return httpBatchBusy(bp);
+}
+
+void
+freeHttpBatch(httpBatch_t *bp)
+{
+	httpBatchRequest_t *rp, *next;
+
+	if (!bp)
+		return;
+	for (rp = bp->pending; rp; rp = next) {
+		next = rp->next;
+		freeBatchRequest(rp);
+	}
+	for (rp = bp->running; rp; rp = next) {
+		next = rp->next;
+		curl_multi_remove_handle(bp->multi, rp->eh);
+		freeBatchRequest(rp);
+	}
+	curl_multi_cleanup(bp->multi);
+	free(bp);
+}
+
+/*
+ * Create transfer handle and buffer of request.
+ *
+ * returns 0 on success, 1 on failure.
+ */
+static int
+setupBatchRequest(httpBatchRequest_t *rp)
+{
+	CURL *eh = NULL;
+
+	rp->mp = (memBuf_t *)myMalloc(sizeof(memBuf_t));
+	initMembuf(rp->mp);
+	if (!rp->state->easyhandle ||
+	    !(eh = curl_easy_duphandle(rp->state->easyhandle)) ||
+	    curl_easy_setopt(eh, CURLOPT_SHARE, rp->state->sharehandle) ||
+	    curl_easy_setopt(eh, CURLOPT_ERRORBUFFER, rp->errorbuf) ||
+	    curl_easy_setopt(eh, CURLOPT_WRITEFUNCTION, WriteBatchCallback) ||
+	    curl_easy_setopt(eh, CURLOPT_FILE, (void *)rp) ||
+	    curl_easy_setopt(eh, CURLOPT_WRITEHEADER, (void *)rp->mp) ||
+	    curl_easy_setopt(eh, CURLOPT_PRIVATE, (void *)rp) ||
+	    curl_easy_setopt(eh, CURLOPT_HTTPGET, 1L) ||
+	    (rp->nobody && curl_easy_setopt(eh, CURLOPT_NOBODY, 1L)) ||
+	    (rp->connectTo && curl_easy_setopt(eh, CURLOPT_CONNECT_TO, rp->connectTo)) ||
+	    curl_easy_setopt(eh, CURLOPT_URL, rp->url)) {
+		if (eh)
+			curl_easy_cleanup(eh);
+		freeMembuf(rp->mp);
+		rp->mp = NULL;
+		return 1;
+	}
+	rp->eh = eh;
+	return 0;
+}
+
+static void
+startBatchRequest(httpBatch_t *bp, httpBatchRequest_t *rp)
+{
+	double sent = getMonotonicTime();
+
+	unlinkPending(bp, rp);
+
+	/* hedge not needed? */
+	if (rp->hedge && rp->twin && responseStarted(rp->twin)) {
+		log(("batch: %s: response started, no second request", rp->url));
+		rp->twin->twin = NULL;
+		freeBatchRequest(rp);
+		return;
+	}
+
+	if ((!rp->eh && setupBatchRequest(rp)) ||
+	    curl_multi_add_handle(bp->multi, rp->eh)) {
+		log(("batch: cannot start transfer for %s", rp->url));
+		if (rp->twin) {
+			/* the other one may still make it */
+			rp->twin->twin = NULL;
+		} else {
+			++bp->failed;
+			if (rp->doneFunc)
+				(*rp->doneFunc)(NULL, rp->data);
+		}
+		freeBatchRequest(rp);
+		return;
+	}
+	rp->active = 1;
+	rp->next = bp->running;
+	bp->running = rp;
+	takeRequest(getUrlHost(rp->url), requestKey(rp->state));
+	addQueueDelay(rp->rc, sent - (rp->startTime > rp->queued ? rp->startTime : rp->queued));
+	rp->start = getWallTime();
+	rp->mp->sent = sent;
+	++bp->active;
+	log(("batch: %s%s%s", rp->nobody ? "HEAD " : "", rp->hedge ? "second request " : "", rp->url));
+}
+
+static void
+finishBatchRequest(httpBatch_t *bp, CURL *eh, CURLcode rc)
+{
+	httpBatchRequest_t *rp = NULL;
+	char *metaRefresh;
+	long code = 0;
+
+	curl_easy_getinfo(eh, CURLINFO_PRIVATE, (char **)&rp);
+	if (rc == CURLE_OK) {
+		hostSample(eh, rp->url, rp->start, rp->mp);
+		requestWritten(eh, rp->mp);
+		(void)curl_easy_getinfo(eh, CURLINFO_RESPONSE_CODE, &code);
+	}
+	curl_multi_remove_handle(bp->multi, eh);
+	curl_easy_cleanup(eh);
+	rp->eh = NULL;
+	rp->active = 0;
+	if (rp->paused)
+		--bp->paused;
+	else
+		--bp->active;
+	unlinkRunning(bp, rp);
+
+	if (rp->twin) {
+		httpBatchRequest_t *twin = rp->twin;
+
+		twin->twin = NULL;
+		if (rc != CURLE_OK) {
+			/* the other one may still make it */
+			log(("batch: %s: %s: %s, waiting for %s request", rp->url, curl_easy_strerror(rc), rp->errorbuf, rp->hedge ? "first" : "second"));
+			freeBatchRequest(rp);
+			return;
+		}
+		log(("batch: %s: %s request answered first", rp->url, rp->hedge ? "second" : "first"));
+		removeBatchRequest(bp, twin);
+	}
+
+	/* learned redirection no longer holds?  See httpRequest(). */
+	if (rp->cachedFrom) {
+		redirect_t *rdp = findRedirect(rp->pattern);
+
+		if (rc != CURLE_OK || code >= 400 || memGetMetaRefresh(rp->mp) ||
+		    (rdp && !isSamePage(rdp, rp->mp))) {
+			log(("redirect cache: %s no longer valid", rp->url));
+			if (rdp)
+				removeRedirect(rdp);
+			(void)requeueBatchRequest(bp, rp, rp->cachedFrom, 0);
+			freeBatchRequest(rp);
+			return;
+		}
+	}
+
+	if (rc != CURLE_OK) {
+		log(("batch: %s: %s: %s", rp->url, curl_easy_strerror(rc), rp->errorbuf));
+		freeMembuf(rp->mp);
+		rp->mp = NULL;
+		++bp->failed;
+	} else if ((metaRefresh = memGetMetaRefresh(rp->mp)) != NULL) {
+		if (rp->redirects < MAX_REDIRECTS) {
+			log(("batch: page redirection by META Refresh: %s\n", metaRefresh));
+			if (rp->dataFunc)
+				(*rp->dataFunc)(NULL, rp->data);
+			(void)requeueBatchRequest(bp, rp, metaRefresh, rp->redirects + 1);
+			freeBatchRequest(rp);
+			return;
+		}
+		freeMembuf(rp->mp);
+		rp->mp = NULL;
+		log(("batch: %s: too many META Refresh redirections", rp->url));
+		++bp->failed;
+	} else if (rp->pattern && rp->redirects > 0)
+		addRedirect(rp->pattern, rp->url, &rp->values, rp->mp);
+	if (rp->mp && rp->parseFunc) {
+		parseJob_t *jp = (parseJob_t *)myMalloc(sizeof(parseJob_t));
+
+		jp->bp = bp;
+		jp->mp = rp->mp;
+		jp->parseFunc = rp->parseFunc;
+		jp->doneFunc = rp->doneFunc;
+		jp->data = rp->data;
+		rp->mp = NULL;
+		++bp->parsing;
+		queueParse(parseWork, parseDone, jp);
+	} else if (rp->doneFunc)
+		(*rp->doneFunc)(rp->mp, rp->data);
+	freeBatchRequest(rp);
+}
+
+/*
+ * Queue request rp again for url, with its callbacks, class and redirect
+ * cache key.
+ */
+static httpBatchRequest_t *
+requeueBatchRequest(httpBatch_t *bp, httpBatchRequest_t *rp, const char *url, int redirects)
+{
+	httpBatchRequest_t *np = queueBatchRequest(bp, url, 0, rp->dataFunc, rp->doneFunc, rp->data, redirects);
+
+	np->parseFunc = rp->parseFunc;
+	np->state = rp->state;
+	np->rc = rp->rc;
+	np->pattern = rp->pattern;
+	np->values = rp->values;
+	rp->pattern = NULL;
+	rp->values.n = 0;
+	return np;
+}
+
+/* parser thread */
+static void
+parseWork(void *data)
+{
+	parseJob_t *jp = (parseJob_t *)data;
+
+	(*jp->parseFunc)(jp->mp, jp->data);
+}
+
+static void
+parseDone(void *data)
+{
+	parseJob_t *jp = (parseJob_t *)data;
+
+	--jp->bp->parsing;
+	if (jp->doneFunc)
+		(*jp->doneFunc)(jp->mp, jp->data);
+	freeMembuf(jp->mp);
+	free(jp);
+}
+
+static size_t
+WriteBatchCallback(void *ptr, size_t size, size_t nmemb, void *data)
+{
+	httpBatchRequest_t *rp = (httpBatchRequest_t *)data;
+	size_t ret = WriteMemoryCallback(ptr, size, nmemb, rp->mp);
+
+	if (rp->dataFunc)
+		(*rp->dataFunc)(rp->mp, rp->data);
+	return ret;
+}
+
 int
 memEof(memBuf_t *mp)
 {
@@ -341,100 +1661,120 @@ memChr(memBuf_t *mp, char c)
 	return ret;
 }
 
-/* get META refresh URL (if any) */
-char *
-memGetMetaRefresh(memBuf_t *mp)
+/*
+ * Parse META tag, returns refresh URL (in buf) or NULL.
+ */
+static char *
+parseMetaRefresh(char *buf)
 {
-	char *cp;
-	static char *buf = NULL;
-	char *bufptr;
-	static size_t bufsize = 0;
-	char *metaRefresh = NULL;
+	char *cp, *url;
 
-	if (!buf) {
-		bufsize = 1024;
-		buf = myMalloc(bufsize);
+	log(("found META tag: %s", buf));
+	cp = strstr(buf, "http-equiv=");
+	if (!cp) {
+		log(("no http-equiv"));
+		return NULL;
 	}
+	cp += 11;
 
-	/* look for all "meta" tags until Refresh found */
-	while (!metaRefresh && (cp = memStr(mp, "<meta")) != NULL) {
-		int c;
+	if (strncasecmp(cp, "\"Refresh\"", 9)) {
+		log(("no Refresh"));
+		return NULL;
+	}
 
-		bufptr = buf;
-		/* copy whole tag to buffer for processing */
-		for (c = memGetc(mp); c != EOF && c != '>'; c = memGetc(mp)) {
-			*bufptr++ = (char)c;
-			if (bufptr > buf + (bufsize -1)) {
-				bufsize += 1024;
-				buf = myRealloc(buf, bufsize);
-			}
-		}
+	cp = strstr(buf, "content=\"");
+	if (!cp) {
+		log(("no content"));
+		return NULL;
+	}
+	cp += 9;
+
+	/* skip delay value (everything until ';') */
+	while (*cp && *cp != ';') cp++;
+	/* if not end of string skip ';' */
+	if (*cp) cp++;
+	/* and skip whitespace */
+	while (*cp && isspace(*cp)) cp++;
+
+	/* now there should be "url=" with optional whitespace around '=' */
+	if (strncasecmp(cp, "url", 3)) {
+		log(("no url key"));
+		return NULL;
+	}
+	cp += 3;
 
-		/* terminate string */
-		*bufptr = '\0';
-		log(("found META tag: %s", buf));
+	while (*cp && isspace(*cp)) cp++;
+	if (*cp != '=') {
+		log(("no = after url"));
+		return NULL;
+	}
+	cp++;
+	while (*cp && isspace(*cp)) cp++;
+
+	/* this is the beginning of the redirection URL */
+	url = cp;
+	cp = strchr(url, '"');
+	if (!cp) {
+		log(("no closing \""));
+		return NULL;
+	}
+	/* cut off terminating '"' and other trailing garbage */
+	*cp = '\0';
+	return url;
+}
 
-		cp = strstr(buf, "http-equiv=");
-		if (!cp) {
-			log(("no http-equiv, looking for next"));
-			continue;
-		}
-		cp += 11;
+/*
+ * Look for META Refresh in the part of the document head received so
+ * far.  Called as data arrives, scanning stops at the end of the head
+ * or when a refresh is found.  Incomplete tags are left for next time.
+ */
+static void
+scanMetaRefresh(memBuf_t *mp)
+{
+	char *cp = mp->memory + mp->headScanned;
+	char *end = mp->memory + mp->size;
 
-		if (strncasecmp(cp, "\"Refresh\"", 9)) {
-			log(("no Refresh, looking for next"));
-			continue;
-		}
+	while (!mp->headDone && cp < end) {
+		char *tag, *tagEnd;
 
-		cp = strstr(buf, "content=\"");
-		if (!cp) {
-			log(("no content, looking for next"));
-			continue;
-		}
-		cp += 9;
-
-		/* skip delay value (everything until ';') */
-		while (*cp && *cp != ';') cp++;
-		/* if not end of string skip ';' */
-		if (*cp) cp++;
-		/* and skip whitespace */
-		while (*cp && isspace(*cp)) cp++;
-
-		/* now there should be "url=" with optional whitespace around '=' */
-		if (strncasecmp(cp, "url", 3)) {
-			log(("no url key, looking for next"));
-			continue;
+		if (!(tag = memchr(cp, '<', (size_t)(end - cp)))) {
+			cp = end;
+			break;
 		}
-		cp += 3;
-
-		while (*cp && isspace(*cp)) cp++;
-		if (*cp != '=') {
-			log(("no = after url, looking for next"));
-			continue;
+		if (!(tagEnd = memchr(tag, '>', (size_t)(end - tag)))) {
+			cp = tag;
+			break;
 		}
-		cp++;
-		while (*cp && isspace(*cp)) cp++;
-
-		/* this is the beginning of the redirection URL */
-		bufptr = cp;
-		cp = strchr(bufptr, '"');
-		if (!cp) {
-			log(("no closing \", looking for next"));
-			continue;
+		++tag;
+		cp = tagEnd + 1;
+		if (!strncasecmp(tag, "/head", 5) || !strncasecmp(tag, "body", 4)) {
+			mp->headDone = 1;
+		} else if (!strncasecmp(tag, "meta", 4)) {
+			char *buf = myStrndup(tag, (size_t)(tagEnd - tag));
+			char *url = parseMetaRefresh(buf);
+
+			if (url) {
+				mp->metaRefresh = myStrdup(url);
+				mp->headDone = 1;
+			}
+			free(buf);
 		}
-		/* cut off terminating '"' and other trailing garbage */
-		*cp = '\0';
-		metaRefresh = bufptr;
 	}
+	mp->headScanned = (size_t)(cp - mp->memory);
+}
 
-	if (metaRefresh)
+/* get META refresh URL (if any) */
+char *
+memGetMetaRefresh(memBuf_t *mp)
+{
+	if (!mp->memory)
+		return NULL;
+	scanMetaRefresh(mp);
+	if (mp->metaRefresh)
 		log(("found redirection"));
 	else
 		log(("no redirection found"));
-
-	memReset(mp);
-
-	return metaRefresh;
+	return mp->metaRefresh;
 }
 
 time_t
@@ -28,12 +28,23 @@
 #define HTTP_H_INCLUDED
 
 #include "auctioninfo.h"
+#include "ratelimit.h"
 
 typedef struct {
    char *memory;
    size_t size;
    char *readptr;
    time_t timeToFirstByte;
+   size_t headScanned;	/* META Refresh scan done up to here */
+   int headDone;	/* end of head or META Refresh found */
+   char *metaRefresh;	/* META Refresh URL, NULL if none */
+   time_t date;		/* Date header, 0 if none */
+   double dateReceived;	/* system time Date header was received */
+   double sent;		/* monotonic time transfer was started */
+   double written;	/* monotonic time request was written, 0 if unknown */
+   double connected;	/* seconds from start until connected, 0 if reused */
+   double firstByte;	/* seconds from start until first response byte */
+   double total;	/* seconds from start until transfer done */
 } memBuf_t;
 
 extern int memEof(memBuf_t *mp);
@@ -46,15 +57,113 @@ extern char *memChr(memBuf_t *mp, char c);
 extern char *memGetMetaRefresh(memBuf_t *mp);
 extern time_t getTimeToFirstByte(memBuf_t *mp);
 
+/*
+ * Curl state of an account: cookies, connections, DNS and SSL session
+ * caches.  httpGet(), the functions below and requests queued on a
+ * batch use the current state, the one of the first account until
+ * useHttpState() is called.  Requests count against the request limit
+ * of their state's account (see ratelimit.h).
+ */
+typedef struct httpState httpState_t;
+
+extern httpState_t *newHttpState(void);
+/* make hs current, NULL: the first account's */
+extern void useHttpState(httpState_t *hs);
+/* cleanupCurlStuff() and free, the first account's is kept */
+extern void freeHttpState(httpState_t *hs);
+
 extern int initCurlStuff(void);
 extern void cleanupCurlStuff(void);
 
+/*
+ * Keep cookies in file (NULL: don't keep them), readable only by the
+ * user.  Cookies are loaded by initCurlStuff(), written by saveCookies()
+ * and cleanupCurlStuff().
+ */
+extern void setCookieFile(const char *path);
+extern void saveCookies(void);
+/* forget all cookies, keeping connections */
+extern void clearCookies(void);
+
 extern int httpError(auctionInfo *aip);
 extern memBuf_t *httpGet(const char *url, const char *logUrl);
+/* like httpGet(), but remembers META Refresh redirections, only use it
+ * for pages that can be fetched any number of times.
+ */
+extern memBuf_t *httpGetCached(const char *url, const char *logUrl);
 extern memBuf_t *httpPost(const char *url, const char *data, const char *logData);
 extern void freeMembuf(memBuf_t *mp);
 extern memBuf_t *strToMemBuf(const char *s, memBuf_t *buf);
 
+/*
+ * Concurrent transfers.  Requests queued on a batch are run in parallel,
+ * at most maxTransfers at a time, sharing cookies and connections with
+ * httpGet().  dataFunc (may be NULL) is called each time more data has
+ * arrived, and with mp NULL when the page is redirected by META Refresh
+ * and its data starts over.  doneFunc is called when a transfer is
+ * complete (mp is NULL on failure).
+ * Callbacks may queue more requests on the same batch.
+ */
+typedef struct httpBatch httpBatch_t;
+typedef void (*httpDataFunc)(memBuf_t *mp, void *data);
+typedef void (*httpDoneFunc)(memBuf_t *mp, void *data);
+
+extern httpBatch_t *newHttpBatch(int maxTransfers);
+/*
+ * Priority class of requests queued from now on, REQUEST_POLL by
+ * default.  Each request keeps its class, requests of several classes
+ * may share a batch.  See runHttpBatch().
+ */
+extern void httpBatchClass(httpBatch_t *bp, requestClass_t rc);
+extern void httpBatchGet(httpBatch_t *bp, const char *url, httpDataFunc dataFunc, httpDoneFunc doneFunc, void *data);
+/*
+ * Like httpBatchGet(), but don't start the transfer before startTime
+ * (monotonic clock, see timer.h).  Requests are started in the order they
+ * were queued, so start times must not decrease.
+ */
+extern void httpBatchGetAt(httpBatch_t *bp, const char *url, double startTime, httpDataFunc dataFunc, httpDoneFunc doneFunc, void *data);
+/*
+ * Like httpBatchGetAt(), but parseFunc(mp, data) is called on a parser
+ * thread (see parser.h) before doneFunc(mp, data) is called on this one.
+ * parseFunc is not called if the transfer failed.
+ */
+extern void httpBatchGetParsed(httpBatch_t *bp, const char *url, double startTime, httpDataFunc parseFunc, httpDoneFunc doneFunc, void *data);
+/*
+ * Like httpBatchGetParsed(), but uses and learns META Refresh
+ * redirections like httpGetCached().  parseFunc may be NULL.
+ */
+extern void httpBatchGetCached(httpBatch_t *bp, const char *url, double startTime, httpDataFunc parseFunc, httpDoneFunc doneFunc, void *data);
+/*
+ * Hedged request: like httpBatchGetAt(), but if no response has started
+ * hedgeDelay seconds after startTime, the request is sent again on
+ * another connection.  doneFunc is called once, with the response that
+ * arrives first, or with NULL if both fail.  connectTo (may be NULL) is
+ * a CURLOPT_CONNECT_TO entry for the second request, see getConnectTo().
+ */
+extern void httpBatchGetHedged(httpBatch_t *bp, const char *url, double startTime, double hedgeDelay, const char *connectTo, httpDoneFunc doneFunc, void *data);
+/*
+ * Open a connection to the host of url at startTime, so that later
+ * requests don't have to wait for it.  A HEAD request is used, the
+ * connection is kept for reuse.  connectTo is as in httpBatchGetHedged().
+ */
+extern void httpBatchConnect(httpBatch_t *bp, const char *url, const char *connectTo, double startTime);
+/*
+ * CURLOPT_CONNECT_TO entry that sends requests for host (host or
+ * host:port) to another of its addresses.  Returns NULL if it has only
+ * one address.
+ */
+extern char *getConnectTo(const char *host);
+extern int runHttpBatch(httpBatch_t *bp);
+/*
+ * Like runHttpBatch(), but return when until (monotonic clock) has come,
+ * for a batch that is run between other work.  Returns 1 if transfers
+ * or pages being parsed are left, else 0.
+ */
+extern int runHttpBatchUntil(httpBatch_t *bp, double until);
+/* are transfers or pages being parsed left? */
+extern int httpBatchBusy(const httpBatch_t *bp);
+extern void freeHttpBatch(httpBatch_t *bp);
+
 #include <stdio.h>
 extern memBuf_t *readFile(FILE *fp);
 
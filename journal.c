@@ -0,0 +1,552 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "journal.h"
+#include "buffer.h"
+#include "esniper.h"
+#include "host.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "util.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if !defined(WIN32)
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+static const char JOURNAL_HEADER[] = "# esniper journal 1\n";
+
+/* fields of a record */
+#define AUCTION_FIELDS 20
+#define HOST_FIELDS (5 + LATENCY_QUANTILES * 17 + 4)
+#define MAX_FIELDS HOST_FIELDS
+
+/* latest record of each auction */
+typedef struct {
+	char *auction;
+	char *line;
+} record_t;
+
+static record_t *records = NULL;
+static int numRecords = 0;
+static FILE *journal = NULL;
+static char *journalPath = NULL;
+static int lockFd = -1;			/* JOURNAL_LOCK_FILE, -1 if none */
+static double hostsWritten = 0;
+
+/* record being written */
+static char *recBuf = NULL;
+static size_t recSize = 0, recCount = 0;
+
+static int lockJournal(const char *logdir);
+static void shareJournal(void);
+static char *mapFile(const char *path, size_t *size);
+static void unmapFile(char *data, size_t size);
+static void replay(const char *data, size_t size);
+static int splitFields(char *line, char **fields, int max);
+static void restoreHost(char **fields);
+static void writeHosts(FILE *fp);
+static void addText(const char *s);
+static void addField(const char *s);
+static double toWall(double monotonic);
+
+/*
+ * Map file into memory, read-only.
+ *
+ * returns NULL if the file doesn't exist or is empty.
+ */
+static char *
+mapFile(const char *path, size_t *size)
+{
+#if defined(WIN32)
+	FILE *fp = fopen(path, "rb");
+	char *data;
+	long len;
+
+	if (!fp)
+		return NULL;
+	if (fseek(fp, 0, SEEK_END) || (len = ftell(fp)) <= 0) {
+		fclose(fp);
+		return NULL;
+	}
+	rewind(fp);
+	data = (char *)myMalloc((size_t)len);
+	*size = fread(data, 1, (size_t)len, fp);
+	fclose(fp);
+	return data;
+#else
+	struct stat sb;
+	void *data;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &sb) || sb.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+	data = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+	*size = (size_t)sb.st_size;
+	return (char *)data;
+#endif
+}
+
+static void
+unmapFile(char *data, size_t size)
+{
+#if defined(WIN32)
+	free(data);
+#else
+	(void)munmap(data, size);
+#endif
+}
+
+/*
+ * Split line at tabs.  Empty fields are kept.
+ *
+ * returns number of fields.
+ */
+static int
+splitFields(char *line, char **fields, int max)
+{
+	int n = 0;
+
+	while (n < max) {
+		fields[n++] = line;
+		if (!(line = strchr(line, '\t')))
+			break;
+		*line++ = '\0';
+	}
+	return n;
+}
+
+/*
+ * Read records: keep the latest record of each auction, restore hosts.
+ */
+static void
+replay(const char *data, size_t size)
+{
+	double now = getWallTime();
+	const char *end = data + size;
+	const char *p;
+
+	if (size < sizeof(JOURNAL_HEADER) - 1 ||
+	    strncmp(data, JOURNAL_HEADER, sizeof(JOURNAL_HEADER) - 1)) {
+		printLog(stderr, "Ignoring journal %s: unknown format\n", journalPath);
+		return;
+	}
+	for (p = data; p < end; ) {
+		const char *eol = memchr(p, '\n', (size_t)(end - p));
+		char *fields[MAX_FIELDS];
+		char *line, *copy;
+		int n, i;
+
+		/* last line incomplete: interrupted write */
+		if (!eol)
+			break;
+		line = myStrndup(p, (size_t)(eol - p));
+		p = eol + 1;
+		copy = myStrdup(line);
+		n = splitFields(copy, fields, MAX_FIELDS);
+		if (line[0] == '#' || n < 2 || now - atof(fields[1]) > JOURNAL_KEEP)
+			;
+		else if (!strcmp(fields[0], "A") && n == AUCTION_FIELDS) {
+			for (i = 0; i < numRecords; ++i) {
+				if (!strcmp(records[i].auction, fields[2]))
+					break;
+			}
+			if (i == numRecords) {
+				records = (record_t *)myRealloc(records, (size_t)(numRecords + 1) * sizeof(record_t));
+				records[numRecords].auction = myStrdup(fields[2]);
+				++numRecords;
+			} else
+				free(records[i].line);
+			records[i].line = line;
+			line = NULL;
+		} else if (!strcmp(fields[0], "H") && n == HOST_FIELDS)
+			restoreHost(fields);
+		else
+			log(("journal: bad record: %s", line));
+		free(copy);
+		free(line);
+	}
+}
+
+/*
+ * Restore latency and clock offset estimates of a host, if there are
+ * none yet.
+ */
+static void
+restoreHost(char **fields)
+{
+	host_t *hp = getHost(fields[2]);
+	int i, j, f = 5;
+
+	if (hp->latencySamples == 0) {
+		hp->latencySamples = atoi(fields[3]);
+		hp->latencyAverage = atof(fields[4]);
+	}
+	for (i = 0; i < LATENCY_QUANTILES; ++i, f += 17) {
+		quantile_t *qp = &hp->latency[i];
+
+		double p = atof(fields[f]);
+
+		/* latencyQuantile may have changed */
+		if (qp->count > 0 || p < qp->p - 1e-4 || p > qp->p + 1e-4)
+			continue;
+		qp->count = atoi(fields[f + 1]);
+		for (j = 0; j < 5; ++j) {
+			qp->q[j] = atof(fields[f + 2 + j]);
+			qp->n[j] = atoi(fields[f + 7 + j]);
+			qp->np[j] = atof(fields[f + 12 + j]);
+		}
+	}
+	if (hp->clockSamples == 0 && atoi(fields[f]) > 0) {
+		/* drift since then widens the bounds, see host.h */
+		hp->clockSamples = atoi(fields[f]);
+		hp->offsetLow = atof(fields[f + 1]);
+		hp->offsetHigh = atof(fields[f + 2]);
+		hp->offsetTime = wallToMonotonic(atof(fields[f + 3]));
+	}
+	log(("journal: restored host %s, %d latency samples, %d clock samples",
+	     hp->name, hp->latencySamples, hp->clockSamples));
+}
+
+/*
+ * Lock the journal for the life of this process.  A process that gets
+ * the lock alone may compact the journal, others share it and only
+ * append, so that no process appends to a journal that was replaced.
+ * The lock file is never renamed, its lock outlives compaction.
+ *
+ * returns 1 if the journal may be compacted, else 0.
+ */
+static int
+lockJournal(const char *logdir)
+{
+#if defined(WIN32)
+	return 1;
+#else
+	char *path = logPath(logdir, JOURNAL_LOCK_FILE);
+	struct flock fl;
+
+	if ((lockFd = open(path, O_RDWR | O_CREAT, 0600)) < 0) {
+		log(("cannot open %s: %s, journal not compacted", path, strerror(errno)));
+		free(path);
+		return 0;
+	}
+	free(path);
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	if (!fcntl(lockFd, F_SETLK, &fl))
+		return 1;
+	/* in use, wait while another process compacts */
+	fl.l_type = F_RDLCK;
+	while (fcntl(lockFd, F_SETLKW, &fl) && errno == EINTR)
+		;
+	log(("journal in use by another process, not compacted"));
+	return 0;
+#endif
+}
+
+/* compacted, let other processes use the journal */
+static void
+shareJournal(void)
+{
+#if !defined(WIN32)
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_RDLCK;
+	fl.l_whence = SEEK_SET;
+	(void)fcntl(lockFd, F_SETLK, &fl);
+#endif
+}
+
+/*
+ * Replace journal by the latest record of each auction and host.
+ *
+ * returns 0 on success, 1 on failure.
+ */
+static int
+compactJournal(void)
+{
+	char *tmpPath;
+	FILE *fp;
+	int i;
+
+	tmpPath = myStrdup2(journalPath, ".tmp");
+	if (!(fp = fopen(tmpPath, "w"))) {
+		printLog(stderr, "Cannot write journal %s: %s\n", tmpPath, strerror(errno));
+		free(tmpPath);
+		return 1;
+	}
+	fputs(JOURNAL_HEADER, fp);
+	for (i = 0; i < numRecords; ++i)
+		fprintf(fp, "%s\n", records[i].line);
+	writeHosts(fp);
+	if (fclose(fp) || rename(tmpPath, journalPath)) {
+		printLog(stderr, "Cannot write journal %s: %s\n", journalPath, strerror(errno));
+		(void)remove(tmpPath);
+		free(tmpPath);
+		return 1;
+	}
+	free(tmpPath);
+	return 0;
+}
+
+int
+openJournal(const char *logdir)
+{
+	char *data;
+	size_t size = 0;
+	int compact, ret;
+
+	closeJournal();
+	compact = lockJournal(logdir);
+	journalPath = logPath(logdir, JOURNAL_FILE);
+	if ((data = mapFile(journalPath, &size))) {
+		replay(data, size);
+		unmapFile(data, size);
+	}
+	if (compact) {
+		ret = compactJournal();
+		shareJournal();
+		if (ret)
+			return 1;
+	}
+	if (!(journal = fopen(journalPath, "a"))) {
+		printLog(stderr, "Cannot open journal %s: %s\n", journalPath, strerror(errno));
+		return 1;
+	}
+	/* host estimates with the first auction record */
+	hostsWritten = 0;
+	log(("journal %s: %d auction(s)", journalPath, numRecords));
+	return 0;
+}
+
+void
+closeJournal(void)
+{
+	int i;
+
+	if (journal) {
+		writeHosts(journal);
+		fclose(journal);
+		journal = NULL;
+	}
+	for (i = 0; i < numRecords; ++i) {
+		free(records[i].auction);
+		free(records[i].line);
+	}
+	free(records);
+	records = NULL;
+	numRecords = 0;
+	free(recBuf);
+	recBuf = NULL;
+	recSize = recCount = 0;
+	free(journalPath);
+	journalPath = NULL;
+#if !defined(WIN32)
+	if (lockFd >= 0) {
+		close(lockFd);
+		lockFd = -1;
+	}
+#endif
+}
+
+/* monotonic time as system time, 0 stays 0 */
+static double
+toWall(double monotonic)
+{
+	return monotonic > 0 ? monotonic - getMonotonicTime() + getWallTime() : 0;
+}
+
+int
+restoreAuction(auctionInfo *aip)
+{
+	char *fields[AUCTION_FIELDS], *copy;
+	double age, lastPoll, nextPoll;
+	time_t now;
+	int i, fresh;
+
+	for (i = 0; i < numRecords; ++i) {
+		if (!strcmp(records[i].auction, aip->auction))
+			break;
+	}
+	if (i == numRecords)
+		return 0;
+	copy = myStrdup(records[i].line);
+	(void)splitFields(copy, fields, AUCTION_FIELDS);
+
+	now = historyTime();
+	age = getWallTime() - atof(fields[1]);
+	aip->endTime = (time_t)atol(fields[4]);
+	aip->remain = aip->endTime > now ? aip->endTime - now : 0;
+	lastPoll = atof(fields[5]);
+	nextPoll = atof(fields[6]);
+	aip->quantity = atoi(fields[7]);
+	aip->bids = atoi(fields[8]);
+	aip->price = atof(fields[9]);
+	aip->lastBids = atoi(fields[10]);
+	aip->lastPrice = atof(fields[11]);
+	aip->activity = atof(fields[12]);
+	aip->won = atoi(fields[13]);
+	aip->winning = atoi(fields[14]);
+	aip->reserve = atoi(fields[15]);
+	free(aip->currency);
+	aip->currency = *fields[16] ? myStrdup(fields[16]) : NULL;
+	free(aip->shipping);
+	aip->shipping = *fields[17] ? myStrdup(fields[17]) : NULL;
+	free(aip->title);
+	aip->title = *fields[19] ? myStrdup(fields[19]) : NULL;
+	if (lastPoll > 0 && wallToMonotonic(lastPoll) > 0)
+		aip->lastPollTime = wallToMonotonic(lastPoll);
+
+	/* ended with known result, or recent and not ending soon */
+	fresh = (aip->endTime <= now && aip->won >= 0) ||
+		(age < JOURNAL_FRESH && aip->endTime - now > JOURNAL_MIN_REMAIN);
+	if (fresh) {
+		if (nextPoll > 0)
+			aip->nextPoll = wallToMonotonic(nextPoll);
+		/* bid key is for the price it was fetched with */
+		if (*fields[18] && aip->bidPriceStr &&
+		    !strcmp(fields[3], aip->bidPriceStr)) {
+			free(aip->biduiid);
+			aip->biduiid = myStrdup(fields[18]);
+		}
+	}
+	log(("journal: restored auction %s, %.0f seconds old%s", aip->auction, age, fresh ? "" : ", stale"));
+	free(copy);
+	return fresh;
+}
+
+/* append text to record */
+static void
+addText(const char *s)
+{
+	for (; *s; ++s)
+		addchar(recBuf, recSize, recCount, *s);
+}
+
+/* append field to record, tabs and line breaks replaced by spaces */
+static void
+addField(const char *s)
+{
+	addchar(recBuf, recSize, recCount, '\t');
+	for (; s && *s; ++s)
+		addchar(recBuf, recSize, recCount,
+			*s == '\t' || *s == '\n' || *s == '\r' ? ' ' : *s);
+}
+
+void
+journalAuction(const auctionInfo *aip)
+{
+	const event_t *ev;
+	double nextPoll = 0;
+	char tmp[256];
+	int i;
+
+	if (!journal)
+		return;
+	if ((ev = findEvent(aip)) && ev->type == EVENT_POLL)
+		nextPoll = toWall(ev->time);
+	recCount = 0;
+	sprintf(tmp, "A\t%.0f", getWallTime());
+	addText(tmp);
+	addField(aip->auction);
+	addField(aip->bidPriceStr);
+	sprintf(tmp, "\t%ld\t%.0f\t%.0f\t%d\t%d\t%.2f\t%d\t%.2f\t%.6g\t%d\t%d\t%d",
+		(long)aip->endTime, toWall(aip->lastPollTime), nextPoll,
+		aip->quantity, aip->bids, aip->price, aip->lastBids,
+		aip->lastPrice, aip->activity, aip->won, aip->winning,
+		aip->reserve);
+	addText(tmp);
+	addField(aip->currency);
+	addField(aip->shipping);
+	addField(aip->biduiid);
+	addField(aip->title);
+	term(recBuf, recSize, recCount);
+	fprintf(journal, "%s\n", recBuf);
+	if (getMonotonicTime() - hostsWritten >= JOURNAL_HOST_INTERVAL)
+		writeHosts(journal);
+	fflush(journal);
+
+	/* auctions added later (daemon) see the latest state */
+	for (i = 0; i < numRecords; ++i) {
+		if (!strcmp(records[i].auction, aip->auction))
+			break;
+	}
+	if (i == numRecords) {
+		records = (record_t *)myRealloc(records, (size_t)(numRecords + 1) * sizeof(record_t));
+		records[numRecords].auction = myStrdup(aip->auction);
+		++numRecords;
+	} else
+		free(records[i].line);
+	records[i].line = myStrdup(recBuf);
+}
+
+/*
+ * Write latency and clock offset estimates of all hosts.
+ */
+static void
+writeHosts(FILE *fp)
+{
+	const host_t *hp;
+	double now = getWallTime();
+
+	for (hp = firstHost(); hp; hp = hp->next) {
+		int i, j;
+
+		if (hp->latencySamples == 0 && hp->clockSamples == 0)
+			continue;
+		fprintf(fp, "H\t%.0f\t%s\t%d\t%.6f", now, hp->name, hp->latencySamples, hp->latencyAverage);
+		for (i = 0; i < LATENCY_QUANTILES; ++i) {
+			const quantile_t *qp = &hp->latency[i];
+
+			fprintf(fp, "\t%.4f\t%d", qp->p, qp->count);
+			for (j = 0; j < 5; ++j)
+				fprintf(fp, "\t%.6f", j < qp->count ? qp->q[j] : 0.0);
+			for (j = 0; j < 5; ++j)
+				fprintf(fp, "\t%d", qp->count >= 5 ? qp->n[j] : 0);
+			for (j = 0; j < 5; ++j)
+				fprintf(fp, "\t%.4f", qp->count >= 5 ? qp->np[j] : 0.0);
+		}
+		fprintf(fp, "\t%d\t%.6f\t%.6f\t%.3f\n", hp->clockSamples,
+			hp->offsetLow, hp->offsetHigh, toWall(hp->offsetTime));
+	}
+	fflush(fp);
+	hostsWritten = getMonotonicTime();
+}
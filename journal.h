@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef JOURNAL_H_INCLUDED
+#define JOURNAL_H_INCLUDED
+
+#include "auctioninfo.h"
+
+/*
+ * State journal: auction state and the latency and clock offset
+ * estimates of each host are appended to esniper.journal in the log
+ * directory.  At startup the journal is replayed, so that after a
+ * restart auctions with recent state need not be fetched again.  The
+ * journal is compacted to the latest record of each auction and host
+ * when it is opened, unless another process is using it (see
+ * JOURNAL_LOCK_FILE).
+ *
+ * Records are lines of tab separated fields:
+ *
+ *	A time auction price endTime lastPoll nextPoll quantity bids
+ *	  currentPrice lastBids lastPrice activity won winning reserve
+ *	  currency shipping biduiid title
+ *	H time host latencySamples latencyAverage (p count q[5] n[5]
+ *	  np[5]) x 4 clockSamples offsetLow offsetHigh offsetTime
+ *
+ * Times are system times (seconds since the epoch), 0 if none.
+ */
+
+#define JOURNAL_FILE "esniper.journal"
+
+/* locked by each process using the journal */
+#define JOURNAL_LOCK_FILE "esniper.journal.lock"
+
+/* auction state younger than this is used without fetching, seconds */
+#define JOURNAL_FRESH 3600
+
+/* state of auctions ending sooner than this is fetched, seconds */
+#define JOURNAL_MIN_REMAIN 600
+
+/* records older than this are dropped, seconds */
+#define JOURNAL_KEEP (14 * 86400)
+
+/* host estimates are written at most this often, seconds */
+#define JOURNAL_HOST_INTERVAL 300
+
+/*
+ * Replay journal in logdir (NULL for current directory), restoring host
+ * estimates, and open it for appending.
+ *
+ * returns 0 on success, 1 on failure.
+ */
+extern int openJournal(const char *logdir);
+
+/* write host estimates and close journal */
+extern void closeJournal(void);
+
+/*
+ * Restore saved state of auction.
+ *
+ * returns 1 if the state is recent enough to be used without fetching
+ * the auction, else 0.
+ */
+extern int restoreAuction(auctionInfo *aip);
+
+/* append auction state, and host estimates if they are due */
+extern void journalAuction(const auctionInfo *aip);
+
+#endif /* JOURNAL_H_INCLUDED */
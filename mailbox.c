@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "mailbox.h"
+#include "esniper.h"
+#include "filewatch.h"
+#include "parser.h"
+#include "timer.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#if !defined(WIN32)
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+#if defined(__linux__)
+#	include <stdint.h>
+#	include <sys/eventfd.h>
+#endif
+#if defined(PARSER_THREADS)
+#	include <pthread.h>
+#	include <sched.h>
+#endif
+
+/* first position of the round of the ring pos is in */
+#define ROUND(pos) ((pos) & ~(unsigned long)(MAILBOX_SIZE - 1))
+
+/*
+ * A slot is free for position pos if seq is ROUND(pos), filled if it is
+ * ROUND(pos) + 1.  Reading it frees it for the next round.  All slots
+ * start free for the first round.
+ */
+typedef struct {
+	unsigned long seq;
+	mailFunc func;
+	void *data;
+} slot_t;
+
+static slot_t slots[MAILBOX_SIZE];
+static unsigned long posted = 0;	/* next position to post to */
+static unsigned long readPos = 0;	/* next position to read */
+static int wakeFd = -1;			/* read end */
+static int wakeWriteFd = -1;
+
+static void wakeUp(void);
+static void clearWakeUp(void);
+
+int
+openMailbox(void)
+{
+	if (wakeFd >= 0)
+		return 0;
+#if defined(__linux__)
+	if ((wakeFd = eventfd(0, EFD_NONBLOCK)) >= 0) {
+		wakeWriteFd = wakeFd;
+		return 0;
+	}
+#endif
+#if !defined(WIN32)
+	{
+		int fds[2];
+
+		if (!pipe(fds)) {
+			(void)fcntl(fds[0], F_SETFL, O_NONBLOCK);
+			(void)fcntl(fds[1], F_SETFL, O_NONBLOCK);
+			wakeFd = fds[0];
+			wakeWriteFd = fds[1];
+			return 0;
+		}
+	}
+#endif
+	log(("openMailbox(): no descriptor"));
+	return 1;
+}
+
+int
+postMail(mailFunc func, void *data)
+{
+	unsigned long pos = __atomic_load_n(&posted, __ATOMIC_RELAXED);
+	slot_t *sp;
+
+	for (;;) {
+		long diff;
+
+		sp = &slots[pos & (MAILBOX_SIZE - 1)];
+		diff = (long)(__atomic_load_n(&sp->seq, __ATOMIC_ACQUIRE) - ROUND(pos));
+		if (diff == 0) {
+			/* free, take it unless another thread was faster */
+			if (__atomic_compare_exchange_n(&posted, &pos, pos + 1, 1,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0)
+			return 1;	/* not read since the last round */
+		else
+			pos = __atomic_load_n(&posted, __ATOMIC_RELAXED);
+	}
+	sp->func = func;
+	sp->data = data;
+	__atomic_store_n(&sp->seq, ROUND(pos) + 1, __ATOMIC_SEQ_CST);
+	/* the main thread stopped at this slot or will find it filled */
+	if (__atomic_load_n(&readPos, __ATOMIC_SEQ_CST) == pos)
+		wakeUp();
+	return 0;
+}
+
+int
+mailboxFd(void)
+{
+	return wakeFd;
+}
+
+/*
+ * Stops at the first slot that isn't filled, even if later ones are: the
+ * thread filling it wakes us up when it is done, since readPos is its
+ * position then.  Nothing here waits for another thread.
+ */
+int
+readMailbox(void)
+{
+	unsigned long pos = readPos;
+	int n = 0;
+
+	/* before reading, mail posted later wakes us up again */
+	clearWakeUp();
+	for (;;) {
+		slot_t *sp = &slots[pos & (MAILBOX_SIZE - 1)];
+		mailFunc func;
+		void *data;
+
+		if (__atomic_load_n(&sp->seq, __ATOMIC_SEQ_CST) != ROUND(pos) + 1)
+			break;
+		func = sp->func;
+		data = sp->data;
+		__atomic_store_n(&sp->seq, ROUND(pos) + MAILBOX_SIZE, __ATOMIC_RELEASE);
+		__atomic_store_n(&readPos, ++pos, __ATOMIC_SEQ_CST);
+		(*func)(data);
+		++n;
+	}
+	return n;
+}
+
+static void
+wakeUp(void)
+{
+#if defined(__linux__)
+	if (wakeWriteFd == wakeFd) {
+		uint64_t one = 1;
+
+		(void)write(wakeWriteFd, &one, sizeof(one));
+		return;
+	}
+#endif
+#if !defined(WIN32)
+	if (wakeWriteFd >= 0) {
+		char c = 0;
+
+		(void)write(wakeWriteFd, &c, 1);
+	}
+#endif
+}
+
+static void
+clearWakeUp(void)
+{
+#if !defined(WIN32)
+	char buf[64];
+
+	if (wakeFd >= 0) {
+		/* eventfd: one read clears the counter */
+		while (read(wakeFd, buf, sizeof(buf)) > 0 && wakeWriteFd != wakeFd)
+			;
+	}
+#endif
+}
+
+#if defined(PARSER_THREADS)
+
+#define BENCH_MAIL 200000	/* per posting thread */
+
+typedef struct {
+	double *stamps;		/* time each mail was ready to post */
+	int count;
+	long full;		/* postMail() found the mailbox full */
+	double busy;		/* seconds to post all */
+} poster_t;
+
+static double *latency = NULL;
+static int received = 0;
+
+static void benchRead(void *data);
+static void *benchPost(void *arg);
+static int compareDouble(const void *p1, const void *p2);
+
+static void
+benchRead(void *data)
+{
+	latency[received++] = getMonotonicTime() - *(double *)data;
+}
+
+static void *
+benchPost(void *arg)
+{
+	poster_t *pp = (poster_t *)arg;
+	double start = getMonotonicTime();
+	int i;
+
+	for (i = 0; i < pp->count; ++i) {
+		pp->stamps[i] = getMonotonicTime();
+		while (postMail(benchRead, &pp->stamps[i])) {
+			++pp->full;
+			sched_yield();
+		}
+	}
+	pp->busy = getMonotonicTime() - start;
+	return arg;
+}
+
+static int
+compareDouble(const void *p1, const void *p2)
+{
+	double d1 = *(const double *)p1, d2 = *(const double *)p2;
+
+	return d1 < d2 ? -1 : d1 > d2;
+}
+
+/*
+ * Threads post BENCH_MAIL calls each as fast as they can, the main
+ * thread reads them as the event loop does, waking up by waitFileWatch().
+ * Latency is the time from a call being ready to post until it is made.
+ */
+void
+benchMailbox(void)
+{
+	static const int threadCounts[] = { 1, 2, 4, 8 };
+	int t;
+
+	if (openMailbox()) {
+		printf("no mailbox descriptor\n");
+		return;
+	}
+	printf("mailbox: %d slots, %d calls per thread\n", MAILBOX_SIZE, BENCH_MAIL);
+	printf("%7s %10s %8s %8s %8s %8s %8s %8s\n", "threads", "calls/s",
+	       "post ns", "p50 us", "p99 us", "p99.9 us", "max us", "full");
+	for (t = 0; t < (int)(sizeof(threadCounts) / sizeof(threadCounts[0])); ++t) {
+		int threads = threadCounts[t], total = threads * BENCH_MAIL, i;
+		pthread_t *tids = (pthread_t *)myMalloc((size_t)threads * sizeof(pthread_t));
+		poster_t *posters = (poster_t *)myMalloc((size_t)threads * sizeof(poster_t));
+		double start, elapsed, busy = 0;
+		long full = 0;
+
+		latency = (double *)myMalloc((size_t)total * sizeof(double));
+		received = 0;
+		start = getMonotonicTime();
+		for (i = 0; i < threads; ++i) {
+			posters[i].stamps = (double *)myMalloc(BENCH_MAIL * sizeof(double));
+			posters[i].count = BENCH_MAIL;
+			posters[i].full = 0;
+			posters[i].busy = 0;
+			if (pthread_create(&tids[i], NULL, benchPost, &posters[i])) {
+				printf("cannot create thread\n");
+				exit(1);
+			}
+		}
+		while (received < total)
+			(void)waitFileWatch(0, -1);
+		elapsed = getMonotonicTime() - start;
+		for (i = 0; i < threads; ++i) {
+			pthread_join(tids[i], NULL);
+			busy += posters[i].busy;
+			full += posters[i].full;
+			free(posters[i].stamps);
+		}
+		qsort(latency, (size_t)total, sizeof(double), compareDouble);
+		printf("%7d %10.0f %8.1f %8.1f %8.1f %8.1f %8.1f %8ld\n",
+		       threads, total / elapsed, busy / total * 1e9,
+		       latency[total / 2] * 1e6, latency[total / 100 * 99] * 1e6,
+		       latency[total / 1000 * 999] * 1e6,
+		       latency[total - 1] * 1e6, full);
+		free(latency);
+		latency = NULL;
+		free(posters);
+		free(tids);
+	}
+}
+
+#else
+
+void
+benchMailbox(void)
+{
+	printf("no threads\n");
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef MAILBOX_H_INCLUDED
+#define MAILBOX_H_INCLUDED
+
+/*
+ * Mailbox of the main thread.  Other threads (see parser.h) post
+ * function calls, the main thread makes them between sockets and timers:
+ * runHttpBatch() and waitFileWatch() wait for mailboxFd() and call
+ * readMailbox().
+ *
+ * Parser threads are the only posters: they hand back the pages fetched
+ * at startup and the bid history and bid pages of polls, bid keys and
+ * result checks (see runAuctionEvents()).  Logins, session renewal and
+ * control commands need the main thread's HTTP state and run there.
+ *
+ * The mailbox is a ring of MAILBOX_SIZE slots, each with a sequence
+ * number that tells whether it is free or filled.  Posting takes a slot
+ * with one compare and swap, the main thread never waits for a lock or
+ * for another thread.  The descriptor (an eventfd on Linux, a pipe
+ * elsewhere) is only written to when the filled slot is the next one the
+ * main thread reads, so it may be waiting for it.
+ */
+
+#define MAILBOX_SIZE 1024	/* power of 2 */
+
+typedef void (*mailFunc)(void *data);
+
+/*
+ * Create the descriptor.  Called by the main thread before other threads
+ * post.
+ *
+ * returns 0 on success, 1 if there is no descriptor (mail is read
+ * anyway, but nobody is woken up).
+ */
+extern int openMailbox(void);
+
+/*
+ * Post func(data), from any thread.
+ *
+ * returns 0 on success, 1 if the mailbox is full.
+ */
+extern int postMail(mailFunc func, void *data);
+
+/* descriptor readable while mail is waiting, -1 if none */
+extern int mailboxFd(void);
+
+/* call posted functions in the order they were posted, returns number */
+extern int readMailbox(void);
+
+/* throughput and latency of postMail() with 1 to 8 threads posting */
+extern void benchMailbox(void);
+
+#endif /* MAILBOX_H_INCLUDED */
@@ -5,8 +5,10 @@
 #	 of gcc's warning options enabled
 #
 
-SRC = auction.c auctionfile.c auctioninfo.c buffer.c esniper.c \
-	history.c html.c http.c options.c util.c
+SRC = account.c auction.c auctionfile.c auctioninfo.c buffer.c daemon.c \
+	esniper.c filewatch.c history.c host.c html.c http.c journal.c \
+	mailbox.c options.c parser.c polling.c ratelimit.c rehearsal.c \
+	scheduler.c schema.c timer.c util.c
 
 # System dependencies
 # HP-UX 10.20
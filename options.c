@@ -177,11 +177,12 @@ parseConfigValue(const char *name, const char *value,
 		log(("parsing name %s value %s\n", name, nullStr(value)));
 	}
 
-	/* lookup name in table */
+	/* lookup name in table, configuration name "*" matches any name */
 	for (tableptr=table; tableptr->value; tableptr++) {
 		tablename = filename ?
 				tableptr->configname : tableptr->optionname;
-		if (tablename && !strcmp(name, tablename))
+		if (tablename && (!strcmp(name, tablename) ||
+				  (filename && !strcmp(tablename, "*"))))
 			break;
 	}
 	if (tableptr->value) {	/* found */
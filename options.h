@@ -50,7 +50,7 @@
 typedef struct optionTable optionTable_t;
 
 struct optionTable {
-	const char *configname;	/* keyword in configuration files */
+	const char *configname;	/* keyword in configuration files, "*" = any */
 	const char *optionname;	/* option without '-' */
 	void *value;		/* variable to store value */
 	int type;		/* data type of expected value or option arg */
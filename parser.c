@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "parser.h"
+#include "esniper.h"
+#include "mailbox.h"
+#include "util.h"
+#include <stdlib.h>
+#if defined(PARSER_THREADS)
+#	include <pthread.h>
+#	include <sched.h>
+#	include <signal.h>
+#endif
+
+typedef struct parseJob {
+	parseFunc work;
+	parseFunc done;
+	void *data;
+	struct parseJob *next;
+} parseJob_t;
+
+#if defined(PARSER_THREADS)
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobReady = PTHREAD_COND_INITIALIZER;
+static parseJob_t *jobs = NULL;		/* queued, oldest first */
+static parseJob_t *lastJob = NULL;
+static int threads = 0;
+static int started = 0;
+static THREAD_LOCAL int parserThread = 0;
+
+static void *parserMain(void *arg);
+static int startParsers(void);
+
+static void *
+parserMain(void *arg)
+{
+	parserThread = 1;
+	for (;;) {
+		parseJob_t *jp;
+
+		pthread_mutex_lock(&jobLock);
+		while (!jobs)
+			pthread_cond_wait(&jobReady, &jobLock);
+		jp = jobs;
+		if (!(jobs = jp->next))
+			lastJob = NULL;
+		pthread_mutex_unlock(&jobLock);
+
+		(*jp->work)(jp->data);
+		/* full: the main thread is busy, it will read soon */
+		while (postMail(jp->done, jp->data))
+			sched_yield();
+		free(jp);
+	}
+	return arg;
+}
+
+/*
+ * Start options.parseThreads threads, the first time it is called.
+ * Signals are left to the main thread.
+ *
+ * returns number of threads running.
+ */
+static int
+startParsers(void)
+{
+	sigset_t all, old;
+
+	if (started || options.parseThreads <= 0)
+		return threads;
+	started = 1;
+	if (openMailbox()) {
+		log(("startParsers(): no mailbox, parsing on the main thread"));
+		return 0;
+	}
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (; threads < options.parseThreads; ++threads) {
+		pthread_t t;
+
+		if (pthread_create(&t, NULL, parserMain, NULL))
+			break;
+		pthread_detach(t);
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	log(("startParsers(): %d parser thread(s)", threads));
+	return threads;
+}
+#endif
+
+void
+queueParse(parseFunc work, parseFunc done, void *data)
+{
+#if defined(PARSER_THREADS)
+	if (startParsers() > 0) {
+		parseJob_t *jp = (parseJob_t *)myMalloc(sizeof(parseJob_t));
+
+		jp->work = work;
+		jp->done = done;
+		jp->data = data;
+		jp->next = NULL;
+		pthread_mutex_lock(&jobLock);
+		if (lastJob)
+			lastJob->next = jp;
+		else
+			jobs = jp;
+		lastJob = jp;
+		pthread_cond_signal(&jobReady);
+		pthread_mutex_unlock(&jobLock);
+		return;
+	}
+#endif
+	(*work)(data);
+	(*done)(data);
+}
+
+int
+isParserThread(void)
+{
+#if defined(PARSER_THREADS)
+	return parserThread;
+#else
+	return 0;
+#endif
+}
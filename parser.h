@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef PARSER_H_INCLUDED
+#define PARSER_H_INCLUDED
+
+#if defined(HAVE_PTHREAD) && !defined(WIN32)
+#	define PARSER_THREADS
+#	define THREAD_LOCAL __thread
+#else
+#	define THREAD_LOCAL
+#endif
+
+/*
+ * Parser threads.  Pages fetched by an HTTP batch (see
+ * httpBatchGetParsed() in http.h) are parsed by a fixed pool of
+ * options.parseThreads threads, so that the thread running transfers and
+ * timers isn't held up by parsing.  Jobs are taken in the order they
+ * were queued.  Their done functions are posted to the main thread's
+ * mailbox (see mailbox.h) and called by readMailbox().
+ *
+ * Work functions run on a parser thread: they may only read their page
+ * and write their own data.  No auction state, no printLog(), log() is
+ * ignored.  Static buffers of functions they call must be THREAD_LOCAL.
+ * Without threads (parseThreads 0, or no pthreads) queueParse() calls
+ * work and done right away.
+ */
+typedef void (*parseFunc)(void *data);
+
+/* done(data) is called by readMailbox() after work(data) */
+extern void queueParse(parseFunc work, parseFunc done, void *data);
+
+/* no log() from this thread, set on parser threads */
+extern int isParserThread(void);
+
+#endif /* PARSER_H_INCLUDED */
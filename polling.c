@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "polling.h"
+#include "host.h"
+#include "ratelimit.h"
+#include "timer.h"
+#include "esniper.h"
+
+/* shortest and longest time between polls, seconds */
+#define MIN_POLL_DELAY 30
+#define MAX_POLL_DELAY 86400
+
+/* extra margin for final poll, maximum seconds */
+#define MAX_FINAL_MARGIN 25
+
+/* weight of newest poll in bid activity average */
+#define ACTIVITY_WEIGHT 0.3
+
+/* bids per hour at which the poll interval is halved */
+#define ACTIVITY_SCALE 2.0
+
+/* interval stretch for auctions with no activity at all */
+#define QUIET_STRETCH 1.5
+
+/* request budget, token bucket shared by all auctions */
+static tokenBucket_t budget;
+static int budgetInit = 0;
+
+/*
+ * Update bid activity with changes since the last poll.  A price change
+ * without a new bid (proxy bidding) counts as half a bid.
+ */
+static void
+updateActivity(auctionInfo *aip)
+{
+	double now = getMonotonicTime();
+
+	if (aip->lastPollTime > 0 && aip->bids >= 0) {
+		double hours = (now - aip->lastPollTime) / 3600;
+		double changes = 0;
+
+		if (aip->lastBids >= 0 && aip->bids > aip->lastBids)
+			changes += aip->bids - aip->lastBids;
+		else if (aip->price != aip->lastPrice)
+			changes += 0.5;
+		if (hours > 0) {
+			double rate = changes / hours;
+
+			aip->activity += ACTIVITY_WEIGHT * (rate - aip->activity);
+		}
+	}
+	aip->lastPollTime = now;
+	aip->lastBids = aip->bids;
+	aip->lastPrice = aip->price;
+}
+
+/*
+ * Take one request from the budget.  Returns seconds until a request is
+ * available, 0 if one was.
+ */
+static double
+useBudget(void)
+{
+	if (!budgetInit) {
+		initTokenBucket(&budget, options.pollBudget / 3600.0, options.pollBudget);
+		budgetInit = 1;
+	}
+	return takeToken(&budget);
+}
+
+long
+getPollDelay(auctionInfo *aip, long remain)
+{
+	const host_t *hp = getHost(options.historyHost);
+	double spread = getLatency(hp, LATENCY_P99) - getLatency(hp, LATENCY_P50);
+	long finalPoll = FINAL_POLL;
+	double delay, budgetWait;
+
+	updateActivity(aip);
+	budgetWait = useBudget();
+
+	/* unreliable connection?  Get final update earlier */
+	if (spread > 0)
+		finalPoll += spread * 4 < MAX_FINAL_MARGIN ? (long)(spread * 4) : MAX_FINAL_MARGIN;
+
+	/* halfway to the end, scaled by activity */
+	delay = remain / 2.0;
+	if (aip->activity > 0)
+		delay /= 1 + aip->activity / ACTIVITY_SCALE;
+	else if (aip->lastBids >= 0)
+		delay *= QUIET_STRETCH;
+	if (delay < budgetWait)
+		delay = budgetWait;
+	if (delay < MIN_POLL_DELAY)
+		delay = MIN_POLL_DELAY;
+	if (delay > MAX_POLL_DELAY)
+		delay = MAX_POLL_DELAY;
+
+	/* never sleep past the final poll */
+	if (remain - delay < finalPoll)
+		delay = remain - finalPoll;
+	if (delay < 1)
+		delay = 1;
+
+	log(("poll schedule %s: remain %ld, activity %.2f bids/hour, latency spread %.3f, budget %.1f (wait %.0f), final poll at %ld -> next poll in %.0f seconds",
+	     aip->auction, remain, aip->activity, spread, budget.tokens,
+	     budgetWait, finalPoll, delay));
+	return (long)delay;
+}
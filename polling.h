@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef POLLING_H_INCLUDED
+#define POLLING_H_INCLUDED
+
+#include "auctioninfo.h"
+
+/*
+ * Poll scheduling.  The time until the next bid history poll of an
+ * auction is chosen from:
+ *
+ * - time remaining: poll about halfway to the end, and get a final
+ *   update about 2 minutes before bidding,
+ * - bid activity: an average of bids and price changes per hour,
+ *   active auctions are polled more often, quiet ones less,
+ * - latency spread of the history host: an unreliable connection gets
+ *   its final update a little earlier,
+ * - request budget: polls of all auctions share pollBudget requests per
+ *   hour.  If it is used up, polls are delayed, except the final one.
+ */
+
+/* seconds before bid time of the final poll */
+#define FINAL_POLL 120
+
+/*
+ * Record poll results and return seconds until next poll.  remain is the
+ * time until bid time.
+ */
+extern long getPollDelay(auctionInfo *aip, long remain);
+
+#endif /* POLLING_H_INCLUDED */
@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "ratelimit.h"
+#include "esniper.h"
+#include "host.h"
+#include "timer.h"
+
+/* statistics of a request class */
+typedef struct {
+	long requests;		/* admitted */
+	long delayed;		/* admitted after waiting */
+	double totalWait;	/* seconds, delayed requests */
+	double maxWait;
+	int waiting;		/* queue depth now */
+	int maxWaiting;
+	long transfers;		/* batch transfers started */
+	double totalQueued;	/* seconds, batch queueing delay */
+	double maxQueued;
+	long paused;		/* batch transfers paused for a higher class */
+	long cancelled;		/* batch transfers cancelled and queued again */
+} requestStats_t;
+
+static requestStats_t stats[REQUEST_CLASSES];
+static const char *const classNames[REQUEST_CLASSES] = {
+	"bid", "bid key", "confirm", "poll", "my items"
+};
+/* tokens a request of each class leaves for higher ones, plus 1 */
+static const double tokensNeeded[REQUEST_CLASSES] = {
+	0, 1, 2, 1 + POLL_RESERVE, 1 + POLL_RESERVE
+};
+
+/* request limit of a host for one account */
+typedef struct limit {
+	const host_t *hp;
+	const void *key;
+	tokenBucket_t bucket;
+	struct limit *next;
+} limit_t;
+
+static limit_t *limits = NULL;
+static const void *limitKey = NULL;	/* account of admitted requests */
+
+static tokenBucket_t *hostBucket(const host_t *hp, const void *key);
+
+void
+initTokenBucket(tokenBucket_t *tbp, double rate, double size)
+{
+	tbp->rate = rate;
+	tbp->size = size;
+	tbp->tokens = size;
+	tbp->time = getMonotonicTime();
+}
+
+double
+takeToken(tokenBucket_t *tbp)
+{
+	double now = getMonotonicTime();
+
+	tbp->tokens += (now - tbp->time) * tbp->rate;
+	if (tbp->tokens > tbp->size)
+		tbp->tokens = tbp->size;
+	tbp->time = now;
+	tbp->tokens -= 1;
+	if (tbp->tokens >= 0)
+		return 0;
+	return -tbp->tokens / tbp->rate;
+}
+
+static tokenBucket_t *
+hostBucket(const host_t *hp, const void *key)
+{
+	limit_t *lp;
+
+	for (lp = limits; lp; lp = lp->next) {
+		if (lp->hp == hp && lp->key == key)
+			return &lp->bucket;
+	}
+	lp = (limit_t *)myMalloc(sizeof(limit_t));
+	lp->hp = hp;
+	lp->key = key;
+	initTokenBucket(&lp->bucket, options.requestRate / 60.0, REQUEST_BURST);
+	lp->next = limits;
+	limits = lp;
+	return &lp->bucket;
+}
+
+void
+setRequestKey(const void *key)
+{
+	limitKey = key;
+}
+
+double
+admitRequest(host_t *hp, requestClass_t rc, requestWait_t *wp)
+{
+	tokenBucket_t *tbp = hostBucket(hp, limitKey);
+	requestStats_t *sp = &stats[rc];
+	double now = getMonotonicTime();
+	double need = tokensNeeded[rc];
+
+	/* refill, without taking a token */
+	tbp->tokens += (now - tbp->time) * tbp->rate;
+	if (tbp->tokens > tbp->size)
+		tbp->tokens = tbp->size;
+	tbp->time = now;
+
+	if (rc == REQUEST_BID || tbp->tokens >= need) {
+		++sp->requests;
+		if (wp->since > 0) {
+			double wait = now - wp->since;
+
+			++sp->delayed;
+			sp->totalWait += wait;
+			if (wait > sp->maxWait)
+				sp->maxWait = wait;
+			--stats[wp->rc].waiting;
+			wp->since = 0;
+		}
+		return 0;
+	}
+	if (wp->since > 0 && wp->rc != rc)
+		cancelRequest(wp);
+	if (wp->since <= 0) {
+		wp->since = now;
+		wp->rc = rc;
+		if (++sp->waiting > sp->maxWaiting)
+			sp->maxWaiting = sp->waiting;
+	}
+	return (need - tbp->tokens) / tbp->rate;
+}
+
+void
+cancelRequest(requestWait_t *wp)
+{
+	if (wp->since > 0) {
+		--stats[wp->rc].waiting;
+		wp->since = 0;
+	}
+}
+
+/*
+ * Debt is limited to one burst, so that a burst of unscheduled requests
+ * (startup, retries) doesn't hold up polls for long.
+ */
+void
+takeRequest(host_t *hp, const void *key)
+{
+	tokenBucket_t *tbp;
+
+	if (!hp)
+		return;
+	tbp = hostBucket(hp, key);
+	(void)takeToken(tbp);
+	if (tbp->tokens < -tbp->size)
+		tbp->tokens = -tbp->size;
+}
+
+int
+requestsWaiting(requestClass_t rc)
+{
+	return stats[rc].waiting;
+}
+
+void
+addQueueDelay(requestClass_t rc, double delay)
+{
+	requestStats_t *sp = &stats[rc];
+
+	if (delay < 0)
+		delay = 0;
+	++sp->transfers;
+	sp->totalQueued += delay;
+	if (delay > sp->maxQueued)
+		sp->maxQueued = delay;
+}
+
+void
+addPreemption(requestClass_t rc, int cancelled)
+{
+	if (cancelled)
+		++stats[rc].cancelled;
+	else
+		++stats[rc].paused;
+}
+
+const char *
+requestClassName(requestClass_t rc)
+{
+	return classNames[rc];
+}
+
+long
+requestsDelayed(void)
+{
+	long n = 0;
+	int i;
+
+	for (i = 0; i < REQUEST_CLASSES; ++i)
+		n += stats[i].delayed + stats[i].waiting + stats[i].paused + stats[i].cancelled;
+	return n;
+}
+
+void
+printRequestStats(FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "Request limit: %d per minute, host and account\n", options.requestRate);
+	fprintf(fp, "%-8s %9s %9s %9s %9s %9s %9s\n",
+		"", "requests", "delayed", "avg wait", "max wait", "waiting", "max");
+	for (i = 0; i < REQUEST_CLASSES; ++i) {
+		const requestStats_t *sp = &stats[i];
+
+		fprintf(fp, "%-8s %9ld %9ld %9.1f %9.1f %9d %9d\n",
+			classNames[i], sp->requests, sp->delayed,
+			sp->delayed ? sp->totalWait / sp->delayed : 0.0,
+			sp->maxWait, sp->waiting, sp->maxWaiting);
+	}
+	fprintf(fp, "Concurrent transfers: queueing delay (ms)\n");
+	fprintf(fp, "%-8s %9s %9s %9s %9s %9s\n",
+		"", "transfers", "average", "max", "paused", "cancelled");
+	for (i = 0; i < REQUEST_CLASSES; ++i) {
+		const requestStats_t *sp = &stats[i];
+
+		fprintf(fp, "%-8s %9ld %9.3f %9.3f %9ld %9ld\n",
+			classNames[i], sp->transfers,
+			sp->transfers ? sp->totalQueued / sp->transfers * 1e3 : 0.0,
+			sp->maxQueued * 1e3, sp->paused, sp->cancelled);
+	}
+}
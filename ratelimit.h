@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef RATELIMIT_H_INCLUDED
+#define RATELIMIT_H_INCLUDED
+
+#include <stdio.h>
+
+/*
+ * Token bucket rate limit.  A bucket holds up to size tokens and gains
+ * rate tokens per second.  Each request takes one token; if there is
+ * none, the token is reserved ahead and the request has to wait for it,
+ * so requests taken one after another are spaced 1/rate seconds apart
+ * once the bucket is empty.
+ */
+typedef struct {
+	double rate;	/* tokens per second */
+	double size;	/* most tokens held, burst size */
+	double tokens;	/* tokens held, negative if reserved ahead */
+	double time;	/* last update, monotonic clock */
+} tokenBucket_t;
+
+/* start with a full bucket */
+extern void initTokenBucket(tokenBucket_t *tbp, double rate, double size);
+
+/*
+ * Take one token.  Returns seconds until it is available, 0 if it is
+ * available now.
+ */
+extern double takeToken(tokenBucket_t *tbp);
+
+/*
+ * Request limit shared by all auctions of an account.  Each host has a
+ * token bucket of REQUEST_BURST tokens for each account, refilled at
+ * requestRate tokens per minute.
+ * Every request sent takes a token (see takeRequest()), scheduled
+ * requests wait for one by class:
+ *
+ * - bids never wait,
+ * - bid key requests and logins wait for a token,
+ * - result checks after a bid wait until 1 token is left,
+ * - polls and watch list pages wait until POLL_RESERVE tokens are left.
+ *
+ * The class is also the priority of a request in an HTTP batch (see
+ * http.h), highest first.
+ */
+#define REQUEST_BURST 10
+#define POLL_RESERVE 3
+
+typedef enum {
+	REQUEST_BID,		/* place bid */
+	REQUEST_BIDKEY,		/* get bid key, login */
+	REQUEST_CONFIRM,	/* result of a bid */
+	REQUEST_POLL,		/* bid history */
+	REQUEST_MYITEMS,	/* watch list */
+	REQUEST_CLASSES
+} requestClass_t;
+
+/* place of a request in the queue of its class */
+typedef struct {
+	double since;	/* first refused (monotonic clock), 0 if not waiting */
+	requestClass_t rc;
+} requestWait_t;
+
+struct host;
+
+/*
+ * Account of requests admitted from now on, an opaque key (see
+ * useHttpState() in http.h), NULL until set.
+ */
+extern void setRequestKey(const void *key);
+
+/*
+ * May a request of class rc be sent to host hp now?  Returns 0 if it
+ * may, else seconds to wait before asking again.  wp keeps the place of
+ * a refused request in the queue statistics.
+ */
+extern double admitRequest(struct host *hp, requestClass_t rc, requestWait_t *wp);
+
+/* refused request given up */
+extern void cancelRequest(requestWait_t *wp);
+
+/* request of account key sent to host hp (may be NULL) */
+extern void takeRequest(struct host *hp, const void *key);
+
+/* requests waiting now of class rc */
+extern int requestsWaiting(requestClass_t rc);
+
+/* requests that waited, are waiting or were preempted, all classes */
+extern long requestsDelayed(void);
+
+/* time from queueing to start of a batch transfer (see http.h) */
+extern void addQueueDelay(requestClass_t rc, double delay);
+
+/* batch transfer of class rc paused (cancelled = 0) or cancelled */
+extern void addPreemption(requestClass_t rc, int cancelled);
+
+extern const char *requestClassName(requestClass_t rc);
+
+/* requests, waits, queue depth and batch queueing delay of each class */
+extern void printRequestStats(FILE *fp);
+
+#endif /* RATELIMIT_H_INCLUDED */
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rehearsal.h"
+#include "util.h"
+#include <stdlib.h>
+
+/* phases of a rehearsal bid */
+enum {
+	PHASE_LATE,	/* timer wakeup - planned time */
+	PHASE_WRITE,	/* request written - timer wakeup (critical path) */
+	PHASE_CONNECT,	/* new connection set up, 0 if reused */
+	PHASE_RESPONSE,	/* first response byte - request written */
+	PHASE_TOTAL,	/* transfer done - timer wakeup */
+	PHASES
+};
+
+static const char *phaseNames[PHASES] = {
+	"late",
+	"critical path",
+	"connect",
+	"response",
+	"total"
+};
+
+static double *samples[PHASES];
+static int numSamples = 0;
+static int failed = 0;
+
+void
+addRehearsal(double planned, const memBuf_t *mp)
+{
+	double written;
+	int i;
+
+	if (!mp) {
+		++failed;
+		return;
+	}
+	for (i = 0; i < PHASES; ++i)
+		samples[i] = (double *)myRealloc(samples[i], (size_t)(numSamples + 1) * sizeof(double));
+	written = mp->written > 0 ? mp->written - mp->sent : 0;
+	samples[PHASE_LATE][numSamples] = mp->sent - planned;
+	samples[PHASE_WRITE][numSamples] = written;
+	samples[PHASE_CONNECT][numSamples] = mp->connected;
+	samples[PHASE_RESPONSE][numSamples] = mp->firstByte > written ? mp->firstByte - written : 0;
+	samples[PHASE_TOTAL][numSamples] = mp->total;
+	++numSamples;
+}
+
+static int
+compareDouble(const void *p1, const void *p2)
+{
+	double d1 = *(const double *)p1, d2 = *(const double *)p2;
+
+	return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+/* quantile q of sorted samples */
+static double
+quantile(const double *sorted, double q)
+{
+	return sorted[(int)(q * (numSamples - 1) + 0.5)];
+}
+
+void
+printRehearsal(FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "\nRehearsal: %d bid(s) sent, %d failed\n", numSamples, failed);
+	if (numSamples == 0)
+		return;
+	fprintf(fp, "%-14s %9s %9s %9s %9s %9s  (ms)\n",
+		"", "min", "median", "90%", "99%", "max");
+	for (i = 0; i < PHASES; ++i) {
+		double *s = samples[i];
+
+		qsort(s, (size_t)numSamples, sizeof(double), compareDouble);
+		fprintf(fp, "%-14s %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+			phaseNames[i], s[0] * 1e3, quantile(s, 0.5) * 1e3,
+			quantile(s, 0.9) * 1e3, quantile(s, 0.99) * 1e3,
+			s[numSamples - 1] * 1e3);
+	}
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef REHEARSAL_H_INCLUDED
+#define REHEARSAL_H_INCLUDED
+
+#include "http.h"
+#include <stdio.h>
+
+/*
+ * Rehearsal: bids are prepared and sent exactly as real ones, but to the
+ * rehearsalHost instead of the bid host.  The time each request was
+ * sent, compared to the planned time, and the network phases of the
+ * transfer are collected, and their distributions printed at the end.
+ */
+
+/* rehearsal bids sent for each auction, REHEARSAL_INTERVAL seconds apart */
+#define REHEARSAL_BIDS 10
+#define REHEARSAL_INTERVAL 1.0
+
+/* record a rehearsal bid planned at monotonic time planned, mp NULL if failed */
+extern void addRehearsal(double planned, const memBuf_t *mp);
+
+/* print distributions of all rehearsal bids */
+extern void printRehearsal(FILE *fp);
+
+#endif /* REHEARSAL_H_INCLUDED */
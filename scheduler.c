@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "scheduler.h"
+#include "util.h"
+#include <stdlib.h>
+
+static event_t *heap = NULL;
+static int heapSize = 0;
+static int heapAlloc = 0;
+static unsigned long heapSeq = 0;
+
+static int before(const event_t *e1, const event_t *e2);
+static void swap(int i, int j);
+static void siftDown(int i);
+
+static int
+before(const event_t *e1, const event_t *e2)
+{
+	if (e1->time != e2->time)
+		return e1->time < e2->time;
+	return e1->seq < e2->seq;
+}
+
+static void
+swap(int i, int j)
+{
+	event_t tmp = heap[i];
+
+	heap[i] = heap[j];
+	heap[j] = tmp;
+}
+
+static void
+siftDown(int i)
+{
+	for (;;) {
+		int child = 2 * i + 1;
+
+		if (child >= heapSize)
+			break;
+		if (child + 1 < heapSize && before(&heap[child + 1], &heap[child]))
+			++child;
+		if (!before(&heap[child], &heap[i]))
+			break;
+		swap(i, child);
+		i = child;
+	}
+}
+
+void
+addEvent(double time, eventType_t type, auctionInfo *aip)
+{
+	int i;
+
+	if (heapSize == heapAlloc) {
+		heapAlloc = heapAlloc ? heapAlloc * 2 : 16;
+		heap = (event_t *)myRealloc(heap, (size_t)heapAlloc * sizeof(event_t));
+	}
+	i = heapSize++;
+	heap[i].time = time;
+	heap[i].type = type;
+	heap[i].aip = aip;
+	heap[i].seq = heapSeq++;
+
+	/* sift up */
+	while (i > 0 && before(&heap[i], &heap[(i - 1) / 2])) {
+		swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+int
+nextEvent(event_t *ev)
+{
+	if (heapSize == 0)
+		return 0;
+	*ev = heap[0];
+	heap[0] = heap[--heapSize];
+	siftDown(0);
+	return 1;
+}
+
+const event_t *
+peekEvent(void)
+{
+	return heapSize ? &heap[0] : NULL;
+}
+
+double
+getNextEventTime(eventType_t type)
+{
+	double ret = 0;
+	int i;
+
+	for (i = 0; i < heapSize; ++i) {
+		if (heap[i].type == type && (ret == 0 || heap[i].time < ret))
+			ret = heap[i].time;
+	}
+	return ret;
+}
+
+const event_t *
+findEvent(const auctionInfo *aip)
+{
+	const event_t *ret = NULL;
+	int i;
+
+	for (i = 0; i < heapSize; ++i) {
+		if (heap[i].aip == aip && (!ret || before(&heap[i], ret)))
+			ret = &heap[i];
+	}
+	return ret;
+}
+
+void
+removeEvents(const auctionInfo *aip)
+{
+	int i, j;
+
+	for (i = j = 0; i < heapSize; ++i) {
+		if (heap[i].aip != aip)
+			heap[j++] = heap[i];
+	}
+	heapSize = j;
+	for (i = heapSize / 2 - 1; i >= 0; --i)
+		siftDown(i);
+}
+
+int
+eventCount(void)
+{
+	return heapSize;
+}
+
+const event_t *
+getEvent(int i)
+{
+	return i >= 0 && i < heapSize ? &heap[i] : NULL;
+}
+
+const char *
+eventName(eventType_t type)
+{
+	switch (type) {
+	case EVENT_POLL: return "poll";
+	case EVENT_LOGIN: return "login";
+	case EVENT_PREBID: return "bid key";
+	case EVENT_FIRE: return "bid";
+	case EVENT_RESULT: return "result";
+	case EVENT_SESSION: return "login renewal";
+	}
+	return "unknown";
+}
+
+void
+clearEvents(void)
+{
+	free(heap);
+	heap = NULL;
+	heapSize = heapAlloc = 0;
+}
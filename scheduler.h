@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SCHEDULER_H_INCLUDED
+#define SCHEDULER_H_INCLUDED
+
+#include "auctioninfo.h"
+
+/*
+ * Event queue for watching several auctions at once.  Each auction has
+ * one pending event, which says what to do next and when.  Events are
+ * kept in a binary heap ordered by time (monotonic clock, see timer.h),
+ * events with the same time are returned in the order they were added.
+ */
+
+typedef enum {
+	EVENT_POLL,	/* get bid history */
+	EVENT_LOGIN,	/* refresh login before bidding */
+	EVENT_PREBID,	/* get bid key */
+	EVENT_FIRE,	/* place bid */
+	EVENT_RESULT,	/* get auction result after bid */
+	EVENT_SESSION	/* renew login session, aip is the account's (see account.h) */
+} eventType_t;
+
+typedef struct {
+	double time;		/* when, monotonic clock */
+	eventType_t type;
+	auctionInfo *aip;
+	unsigned long seq;	/* order of addEvent() calls */
+} event_t;
+
+extern void addEvent(double time, eventType_t type, auctionInfo *aip);
+
+/*
+ * Remove earliest event and copy it to ev.
+ *
+ * returns 0 if there are no events, else 1.
+ */
+extern int nextEvent(event_t *ev);
+
+/* earliest event, NULL if there are none */
+extern const event_t *peekEvent(void);
+
+/* time of earliest event of given type, 0 if there are none */
+extern double getNextEventTime(eventType_t type);
+
+/* earliest event of auction, NULL if there are none */
+extern const event_t *findEvent(const auctionInfo *aip);
+
+/* remove all events of auction */
+extern void removeEvents(const auctionInfo *aip);
+
+extern int eventCount(void);
+
+/* i-th event, 0 <= i < eventCount(), in no particular order */
+extern const event_t *getEvent(int i);
+extern const char *eventName(eventType_t type);
+extern void clearEvents(void);
+
+#endif /* SCHEDULER_H_INCLUDED */
@@ -0,0 +1,740 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Page schema engine.  Schemas are compiled into a hash of anchor keys.
+ * A page is evaluated by walking its tags and text tokens once, looking
+ * up each token in the hash and filling in pending captures, so the cost
+ * of evaluation doesn't depend on the number of fields.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "schema.h"
+#include "html.h"
+#include "buffer.h"
+#include "esniper.h"
+
+#define ANCHOR_TAG 1
+#define ANCHOR_TEXT 2
+#define ANCHOR_LABEL 3
+
+#define CONV_TEXT 1
+#define CONV_INT 2
+#define CONV_PRICE 3
+#define CONV_FLAG 4
+
+#define HASHSIZE 127
+
+typedef struct {
+	char *name;
+	int conv;	/* CONV_xxx */
+	int offset;	/* text tokens after anchor */
+	int first;	/* first anchor in page wins */
+	int nanchors;
+	int alt;	/* first alternative number */
+} field_t;
+
+typedef struct {
+	char *name;
+	int headerColumn;
+	int minColumns;
+	int nheaders;
+	char **headers;
+	int ncolumns;
+	char **columns;
+	int *index;
+} table_t;
+
+typedef struct hashEntry {
+	const char *key;
+	int field;
+	int alt;
+	struct hashEntry *next;
+} hashEntry_t;
+
+struct schema {
+	char *name;
+	int nfields;
+	field_t *fields;
+	int nalts;
+	int ntables;
+	table_t *tables;
+	hashEntry_t *hash[HASHSIZE];
+	struct schema *next;
+};
+
+typedef struct {
+	int found;
+	long pos;
+	char *text;
+} capture_t;
+
+typedef struct pending {
+	int alt;
+	int remain;	/* text tokens to go */
+	struct pending *next;
+} pending_t;
+
+struct schemaResult {
+	const schema_t *sp;
+	capture_t *captures;	/* one per alternative */
+	schemaValue_t *values;	/* one per field */
+};
+
+static schema_t *schemas = NULL;
+static int builtinLoaded = 0;
+
+/*
+ * Built-in schemas.  A schema file can replace any of these.
+ */
+static const char builtinSchemas[] =
+	"page ViewBids\n"
+	"field bidHistory flag 0 first text:\"Bid History\"\n"
+	"field unknownItem flag 0 first text:\"Unknown Item\"\n"
+	"field item text 2 tag:BHCtBidLabel | tag:vizItemNum | tag:BHitemNo\n"
+	"field title text 2 tag:itemTitle | tag:BHitemTitle | tag:BHitemDesc\n"
+	"field price price 1 first label:BHCtBid:\"Current bid:\" | label:BHCtBid:\"Winning bid:\" | label:BHCtBid:\"Your maximum bid:\" | label:BHCtBid:\"price:\"\n"
+	"field reserve text 2 first label:BHCtBid:\"Current bid:\" | label:BHCtBid:\"Winning bid:\" | label:BHCtBid:\"Your maximum bid:\" | label:BHCtBid:\"price:\"\n"
+	"field quantity int 1 label:BHCtBid:\"Quantity:\"\n"
+	"field shipping text 1 label:BHCtBid:\"Shipping:\"\n"
+	"field ended flag 0 text:\"Time Ended:\"\n"
+	"field timeLeft text 1 tag:timeLeft\n"
+	"field bids int 1 text:\"Total Bids:\"\n"
+	"table bids 1 5 \"Bidder\" | \"User ID\"\n"
+	"column bids bidder 1\n"
+	"column bids amount 2\n"
+	"column bids quantity 3\n";
+
+static int loadSchemaString(const char *s, const char *source);
+static int parseSchemaLine(char **words, int nwords, const char *source, int lineNo);
+static int addAnchor(schema_t *sp, int field, const char *word);
+static unsigned hashKey(const char *key);
+static char *makeKey(int type, const char *word, const char *text);
+static void matchKey(const schema_t *sp, schemaResult_t *rp, pending_t **pendpp, const char *key, long pos, const char *text);
+static void freeSchema(schema_t *sp);
+
+static void
+loadBuiltinSchemas(void)
+{
+	if (!builtinLoaded) {
+		builtinLoaded = 1;
+		if (loadSchemaString(builtinSchemas, "built-in schema"))
+			printLog(stderr, "Cannot compile built-in schema\n");
+	}
+}
+
+int
+loadSchemaFile(const char *filename)
+{
+	FILE *fp;
+	char *buf = NULL;
+	size_t bufsize = 0, count = 0;
+	int c, ret;
+
+	loadBuiltinSchemas();
+	if (!(fp = fopen(filename, "r"))) {
+		printLog(stderr, "Cannot open schema file %s: %s\n", filename,
+			 strerror(errno));
+		return 1;
+	}
+	while ((c = getc(fp)) != EOF)
+		addchar(buf, bufsize, count, (char)c);
+	term(buf, bufsize, count);
+	fclose(fp);
+	ret = loadSchemaString(buf, filename);
+	free(buf);
+	return ret;
+}
+
+const schema_t *
+getSchema(const char *page)
+{
+	schema_t *sp;
+
+	loadBuiltinSchemas();
+	for (sp = schemas; sp; sp = sp->next)
+		if (!strcmp(sp->name, page))
+			return sp;
+	return NULL;
+}
+
+/*
+ * Split schema text into lines and lines into words.  Quotes group
+ * words, and are kept so that anchors can tell text from tag words.
+ */
+static int
+loadSchemaString(const char *s, const char *source)
+{
+	char *buf = NULL;
+	size_t bufsize = 0, count = 0;
+	char *words[64];
+	int lineNo = 0, ret = 0;
+
+	while (*s && !ret) {
+		int nwords = 0, inQuote = 0;
+
+		++lineNo;
+		count = 0;
+		for (; *s && *s != '\n'; ++s) {
+			if (*s == '#' && !inQuote)
+				break;
+			if (*s == '"')
+				inQuote = !inQuote;
+			if (isspace((int)*s) && !inQuote) {
+				if (count && buf[count-1] != '\0')
+					addchar(buf, bufsize, count, '\0');
+			} else
+				addchar(buf, bufsize, count, *s);
+		}
+		while (*s && *s != '\n')
+			++s;
+		if (*s)
+			++s;
+		if (count && buf[count-1] != '\0')
+			addchar(buf, bufsize, count, '\0');
+		if (inQuote) {
+			printLog(stderr, "%s line %d: unterminated quote\n", source, lineNo);
+			ret = 1;
+			break;
+		}
+		/* buf may move while adding, so find words afterwards */
+		{
+			size_t i;
+
+			for (i = 0; i < count && nwords < 64; i += strlen(&buf[i]) + 1)
+				words[nwords++] = &buf[i];
+		}
+		if (nwords)
+			ret = parseSchemaLine(words, nwords, source, lineNo);
+	}
+	free(buf);
+	return ret;
+}
+
+static char *
+unquote(const char *s)
+{
+	size_t len = strlen(s);
+
+	if (len < 2 || s[0] != '"' || s[len-1] != '"')
+		return NULL;
+	return myStrndup(s + 1, len - 2);
+}
+
+static table_t *
+findTable(const schema_t *sp, const char *name)
+{
+	int i;
+
+	for (i = 0; i < sp->ntables; ++i)
+		if (!strcmp(sp->tables[i].name, name))
+			return &sp->tables[i];
+	return NULL;
+}
+
+static int
+parseSchemaLine(char **words, int nwords, const char *source, int lineNo)
+{
+	schema_t *sp = schemas;
+
+	if (!strcmp(words[0], "page") && nwords == 2) {
+		schema_t **spp;
+
+		/* new definition replaces old one */
+		for (spp = &schemas; *spp; spp = &(*spp)->next) {
+			if (!strcmp((*spp)->name, words[1])) {
+				schema_t *old = *spp;
+
+				*spp = old->next;
+				freeSchema(old);
+				break;
+			}
+		}
+		sp = (schema_t *)myMalloc(sizeof(schema_t));
+		memset(sp, 0, sizeof(schema_t));
+		sp->name = myStrdup(words[1]);
+		sp->next = schemas;
+		schemas = sp;
+		return 0;
+	}
+	if (!sp) {
+		printLog(stderr, "%s line %d: page must be defined first\n", source, lineNo);
+		return 1;
+	}
+	if (!strcmp(words[0], "field") && nwords >= 5) {
+		field_t *fp;
+		int i = 4, conv;
+
+		if (!strcmp(words[2], "text"))
+			conv = CONV_TEXT;
+		else if (!strcmp(words[2], "int"))
+			conv = CONV_INT;
+		else if (!strcmp(words[2], "price"))
+			conv = CONV_PRICE;
+		else if (!strcmp(words[2], "flag"))
+			conv = CONV_FLAG;
+		else {
+			printLog(stderr, "%s line %d: unknown converter %s\n", source, lineNo, words[2]);
+			return 1;
+		}
+		sp->fields = (field_t *)myRealloc(sp->fields, (size_t)(sp->nfields + 1) * sizeof(field_t));
+		fp = &sp->fields[sp->nfields];
+		fp->name = myStrdup(words[1]);
+		fp->conv = conv;
+		fp->offset = atoi(words[3]);
+		fp->first = !strcmp(words[4], "first");
+		fp->nanchors = 0;
+		fp->alt = sp->nalts;
+		++sp->nfields;
+		if (fp->first)
+			++i;
+		for (; i < nwords; ++i) {
+			if (!strcmp(words[i], "|"))
+				continue;
+			if (addAnchor(sp, sp->nfields - 1, words[i])) {
+				printLog(stderr, "%s line %d: bad anchor %s\n", source, lineNo, words[i]);
+				return 1;
+			}
+		}
+		if (!sp->fields[sp->nfields - 1].nanchors) {
+			printLog(stderr, "%s line %d: field %s has no anchor\n", source, lineNo, words[1]);
+			return 1;
+		}
+		return 0;
+	}
+	if (!strcmp(words[0], "table") && nwords >= 5) {
+		table_t *tp;
+		int i;
+
+		if (findTable(sp, words[1])) {
+			printLog(stderr, "%s line %d: table %s already defined\n", source, lineNo, words[1]);
+			return 1;
+		}
+		sp->tables = (table_t *)myRealloc(sp->tables, (size_t)(sp->ntables + 1) * sizeof(table_t));
+		tp = &sp->tables[sp->ntables++];
+		memset(tp, 0, sizeof(table_t));
+		tp->name = myStrdup(words[1]);
+		tp->headerColumn = atoi(words[2]);
+		tp->minColumns = atoi(words[3]);
+		tp->headers = (char **)myMalloc((size_t)nwords * sizeof(char *));
+		for (i = 4; i < nwords; ++i) {
+			if (!strcmp(words[i], "|"))
+				continue;
+			if (!(tp->headers[tp->nheaders] = unquote(words[i]))) {
+				printLog(stderr, "%s line %d: header %s must be quoted\n", source, lineNo, words[i]);
+				return 1;
+			}
+			++tp->nheaders;
+		}
+		return 0;
+	}
+	if (!strcmp(words[0], "column") && nwords == 4) {
+		table_t *tp = findTable(sp, words[1]);
+
+		if (!tp) {
+			printLog(stderr, "%s line %d: unknown table %s\n", source, lineNo, words[1]);
+			return 1;
+		}
+		tp->columns = (char **)myRealloc(tp->columns, (size_t)(tp->ncolumns + 1) * sizeof(char *));
+		tp->index = (int *)myRealloc(tp->index, (size_t)(tp->ncolumns + 1) * sizeof(int));
+		tp->columns[tp->ncolumns] = myStrdup(words[2]);
+		tp->index[tp->ncolumns] = atoi(words[3]);
+		++tp->ncolumns;
+		return 0;
+	}
+	printLog(stderr, "%s line %d: syntax error\n", source, lineNo);
+	return 1;
+}
+
+/*
+ * Compile an anchor into a hash key.
+ */
+static int
+addAnchor(schema_t *sp, int field, const char *word)
+{
+	char *key = NULL, *text, *colon;
+	hashEntry_t *hp;
+	unsigned h;
+
+	if (!strncmp(word, "tag:", 4) && word[4] && word[4] != '"') {
+		key = makeKey(ANCHOR_TAG, word + 4, NULL);
+	} else if (!strncmp(word, "text:", 5)) {
+		if (!(text = unquote(word + 5)))
+			return 1;
+		key = makeKey(ANCHOR_TEXT, NULL, text);
+		free(text);
+	} else if (!strncmp(word, "label:", 6) && (colon = strchr(word + 6, ':'))) {
+		char *tag = myStrndup(word + 6, (size_t)(colon - word - 6));
+
+		if ((text = unquote(colon + 1)))
+			key = makeKey(ANCHOR_LABEL, tag, text);
+		free(tag);
+		free(text);
+	}
+	if (!key)
+		return 1;
+	hp = (hashEntry_t *)myMalloc(sizeof(hashEntry_t));
+	hp->key = key;
+	hp->field = field;
+	hp->alt = sp->nalts++;
+	h = hashKey(key);
+	hp->next = sp->hash[h];
+	sp->hash[h] = hp;
+	++sp->fields[field].nanchors;
+	return 0;
+}
+
+static unsigned
+hashKey(const char *key)
+{
+	unsigned h = 0;
+
+	for (; *key; ++key)
+		h = h * 31 + (unsigned char)*key;
+	return h % HASHSIZE;
+}
+
+/*
+ * Keys are "<word" for tags, ">text" for text and "word>text" for
+ * labels.  Text is compared without case.
+ */
+static char *
+makeKey(int type, const char *word, const char *text)
+{
+	char *key, *cp;
+
+	switch (type) {
+	case ANCHOR_TAG:
+		return myStrdup2("<", word);
+	case ANCHOR_TEXT:
+		key = myStrdup2(">", text);
+		break;
+	default:
+		key = myStrdup3(word, ">", text);
+		break;
+	}
+	for (cp = strchr(key, '>') + 1; *cp; ++cp)
+		*cp = (char)tolower((int)*cp);
+	return key;
+}
+
+/*
+ * Anchor found: record position and start capture.
+ */
+static void
+matchKey(const schema_t *sp, schemaResult_t *rp, pending_t **pendpp, const char *key, long pos, const char *text)
+{
+	hashEntry_t *hp;
+
+	for (hp = sp->hash[hashKey(key)]; hp; hp = hp->next) {
+		capture_t *cp = &rp->captures[hp->alt];
+		int offset = sp->fields[hp->field].offset;
+
+		if (cp->found || strcmp(hp->key, key))
+			continue;
+		cp->found = 1;
+		cp->pos = pos;
+		if (offset == 0) {
+			cp->text = text ? myStrdup(text) : NULL;
+		} else {
+			pending_t *pendp = (pending_t *)myMalloc(sizeof(pending_t));
+
+			pendp->alt = hp->alt;
+			pendp->remain = offset;
+			pendp->next = *pendpp;
+			*pendpp = pendp;
+		}
+	}
+}
+
+schemaResult_t *
+evalSchema(const schema_t *sp, memBuf_t *mp)
+{
+	schemaResult_t *rp;
+	pending_t *pending = NULL;
+	char **labelWords = NULL;
+	size_t nlabelWords = 0, labelWordsSize = 0;
+	char *key = NULL;
+	size_t keysize = 0;
+	const char *cp = mp->memory, *end = mp->memory + mp->size;
+	long pos = 0;
+	int i;
+
+	rp = (schemaResult_t *)myMalloc(sizeof(schemaResult_t));
+	rp->sp = sp;
+	rp->captures = (capture_t *)myMalloc((size_t)(sp->nalts + 1) * sizeof(capture_t));
+	memset(rp->captures, 0, (size_t)(sp->nalts + 1) * sizeof(capture_t));
+	rp->values = (schemaValue_t *)myMalloc((size_t)(sp->nfields + 1) * sizeof(schemaValue_t));
+	memset(rp->values, 0, (size_t)(sp->nfields + 1) * sizeof(schemaValue_t));
+	rp->values[sp->nfields].number = -1;
+
+	while (cp < end) {
+		if (*cp == '<') {
+			const char *tagEnd;
+			int inStr = 0;
+
+			if (end - cp >= 4 && !strncmp(cp, "<!--", 4)) {
+				for (tagEnd = cp + 4; tagEnd + 3 <= end && strncmp(tagEnd, "-->", 3); ++tagEnd)
+					;
+				cp = tagEnd + 3 <= end ? tagEnd + 3 : end;
+				continue;
+			}
+			/* tag words are the words in quoted attribute values */
+			for (tagEnd = cp + 1; tagEnd < end && (inStr || *tagEnd != '>'); ++tagEnd) {
+				const char *wordEnd;
+				size_t len, k, count = 0;
+
+				if (*tagEnd == '"') {
+					inStr = !inStr;
+					continue;
+				}
+				if (!inStr || isspace((int)*tagEnd))
+					continue;
+				for (wordEnd = tagEnd; wordEnd < end && *wordEnd != '"' && !isspace((int)*wordEnd); ++wordEnd)
+					;
+				len = (size_t)(wordEnd - tagEnd);
+				addchar(key, keysize, count, '<');
+				for (k = 0; k < len; ++k)
+					addchar(key, keysize, count, tagEnd[k]);
+				term(key, keysize, count);
+				matchKey(sp, rp, &pending, key, pos, NULL);
+				if (nlabelWords >= labelWordsSize) {
+					labelWordsSize = labelWordsSize ? labelWordsSize * 2 : 16;
+					labelWords = (char **)myRealloc(labelWords, labelWordsSize * sizeof(char *));
+				}
+				labelWords[nlabelWords++] = myStrdup(key + 1);
+				tagEnd = wordEnd - 1;
+			}
+			cp = tagEnd < end ? tagEnd + 1 : end;
+		} else {
+			const char *textEnd = memchr(cp, '<', (size_t)(end - cp));
+			memBuf_t view;
+			char *text;
+
+			if (!textEnd)
+				textEnd = end;
+			memset(&view, 0, sizeof(view));
+			view.memory = view.readptr = (char *)cp;
+			view.size = (size_t)(textEnd - cp);
+			cp = textEnd;
+			if (!(text = getNonTag(&view)))
+				continue;
+			++pos;
+
+			/* captures started before this token */
+			{
+				pending_t **pendpp = &pending;
+
+				while (*pendpp) {
+					pending_t *pendp = *pendpp;
+
+					if (--pendp->remain == 0) {
+						rp->captures[pendp->alt].text = myStrdup(text);
+						*pendpp = pendp->next;
+						free(pendp);
+					} else
+						pendpp = &pendp->next;
+				}
+			}
+
+			/* text anchors */
+			{
+				char *lower = myStrdup(text), *lp;
+
+				for (lp = lower; *lp; ++lp)
+					*lp = (char)tolower((int)*lp);
+				free(key);
+				key = myStrdup2(">", lower);
+				keysize = strlen(key) + 1;
+				matchKey(sp, rp, &pending, key, pos, text);
+
+				/* label anchors */
+				while (nlabelWords) {
+					char *word = labelWords[--nlabelWords];
+
+					free(key);
+					key = myStrdup3(word, ">", lower);
+					keysize = strlen(key) + 1;
+					matchKey(sp, rp, &pending, key, pos, text);
+					free(word);
+				}
+				free(lower);
+			}
+		}
+	}
+	while (pending) {
+		pending_t *next = pending->next;
+
+		free(pending);
+		pending = next;
+	}
+	while (nlabelWords)
+		free(labelWords[--nlabelWords]);
+	free(labelWords);
+	free(key);
+
+	/* pick alternative and convert value */
+	for (i = 0; i < sp->nfields; ++i) {
+		const field_t *fp = &sp->fields[i];
+		schemaValue_t *vp = &rp->values[i];
+		const capture_t *best = NULL;
+		int alt;
+
+		for (alt = fp->alt; alt < fp->alt + fp->nanchors; ++alt) {
+			const capture_t *capp = &rp->captures[alt];
+
+			if (!capp->found)
+				continue;
+			if (!best || (fp->first && capp->pos < best->pos))
+				best = capp;
+			if (!fp->first)
+				break;
+		}
+		vp->number = -1;
+		if (!best)
+			continue;
+		vp->found = 1;
+		vp->pos = best->pos;
+		vp->text = best->text;
+		if (!vp->text)
+			continue;
+		switch (fp->conv) {
+		case CONV_INT:
+			errno = 0;
+			if (isdigit((int)*vp->text)) {
+				vp->number = strtol(vp->text, NULL, 10);
+				if (vp->number == 0 && errno == EINVAL)
+					vp->number = -1;
+			}
+			break;
+		case CONV_PRICE:
+		    {
+			char *price = myStrdup(vp->text);
+
+			vp->price = atof(priceFixup(price, NULL));
+			free(price);
+			break;
+		    }
+		}
+		log(("evalSchema(): %s = %s", fp->name, vp->text));
+	}
+	return rp;
+}
+
+const schemaValue_t *
+getSchemaValue(const schemaResult_t *rp, const char *field)
+{
+	int i;
+
+	for (i = 0; i < rp->sp->nfields; ++i)
+		if (!strcmp(rp->sp->fields[i].name, field))
+			return &rp->values[i];
+	/* unknown field, return empty value */
+	return &rp->values[rp->sp->nfields];
+}
+
+void
+freeSchemaResult(schemaResult_t *rp)
+{
+	int i;
+
+	if (!rp)
+		return;
+	for (i = 0; i < rp->sp->nalts; ++i)
+		free(rp->captures[i].text);
+	free(rp->captures);
+	free(rp->values);
+	free(rp);
+}
+
+int
+isSchemaTableHeader(const schema_t *sp, const char *table, char **row)
+{
+	const table_t *tp = findTable(sp, table);
+	char *header;
+	int i, ret = 0;
+
+	if (!tp || numColumns(row) < tp->minColumns ||
+	    tp->headerColumn >= numColumns(row))
+		return 0;
+	if (!(header = getNonTagFromString(row[tp->headerColumn])))
+		return 0;
+	for (i = 0; !ret && i < tp->nheaders; ++i)
+		ret = !strncmp(header, tp->headers[i], strlen(tp->headers[i]));
+	free(header);
+	return ret;
+}
+
+int
+getSchemaColumn(const schema_t *sp, const char *table, const char *column)
+{
+	const table_t *tp = findTable(sp, table);
+	int i;
+
+	if (tp)
+		for (i = 0; i < tp->ncolumns; ++i)
+			if (!strcmp(tp->columns[i], column))
+				return tp->index[i];
+	return -1;
+}
+
+static void
+freeSchema(schema_t *sp)
+{
+	int i, j;
+
+	for (i = 0; i < HASHSIZE; ++i) {
+		while (sp->hash[i]) {
+			hashEntry_t *next = sp->hash[i]->next;
+
+			free((char *)sp->hash[i]->key);
+			free(sp->hash[i]);
+			sp->hash[i] = next;
+		}
+	}
+	for (i = 0; i < sp->nfields; ++i)
+		free(sp->fields[i].name);
+	free(sp->fields);
+	for (i = 0; i < sp->ntables; ++i) {
+		table_t *tp = &sp->tables[i];
+
+		free(tp->name);
+		for (j = 0; j < tp->nheaders; ++j)
+			free(tp->headers[j]);
+		free(tp->headers);
+		for (j = 0; j < tp->ncolumns; ++j)
+			free(tp->columns[j]);
+		free(tp->columns);
+		free(tp->index);
+	}
+	free(sp->tables);
+	free(sp->name);
+	free(sp);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SCHEMA_H_INCLUDED
+#define SCHEMA_H_INCLUDED
+
+#include "http.h"
+
+/*
+ * Page schemas: declarative description of where the fields of a page are.
+ *
+ * Each field has one or more anchors and a token offset.  Anchors are:
+ *
+ *	tag:WORD		a tag with WORD in a quoted attribute value
+ *	text:"TEXT"		a text token equal to TEXT (case is ignored)
+ *	label:WORD:"TEXT"	text token TEXT, first text after tag:WORD
+ *
+ * The value of a field is the text token OFFSET tokens after the anchor
+ * (0 is the anchor itself).  Alternative anchors, separated by |, are
+ * tried in order.  If the field is marked "first", the anchor found
+ * first in the page is used instead.
+ *
+ * Schema files contain one definition per line, # starts a comment:
+ *
+ *	page NAME
+ *	field NAME CONVERTER OFFSET [first] ANCHOR [| ANCHOR ...]
+ *	table NAME HEADERCOLUMN MINCOLUMNS "HEADER" [| "HEADER" ...]
+ *	column TABLE NAME INDEX
+ *
+ * Converters are text, int, price and flag.  Definitions for a page
+ * replace any earlier (including built-in) definitions for that page.
+ */
+
+typedef struct schema schema_t;
+typedef struct schemaResult schemaResult_t;
+
+typedef struct {
+	int found;	/* anchor found */
+	long pos;	/* token number of anchor */
+	char *text;	/* value, NULL if there is no token at offset */
+	long number;	/* int converter: value, -1 if not a number */
+	double price;	/* price converter: value, 0 if not a price */
+} schemaValue_t;
+
+/*
+ * Load schema file.  Built-in schemas are always loaded first.
+ *
+ * returns 0 on success, 1 on error.
+ */
+extern int loadSchemaFile(const char *filename);
+
+/*
+ * Get schema for page, NULL if there is none.
+ */
+extern const schema_t *getSchema(const char *page);
+
+/*
+ * Evaluate all fields of a schema in a single pass over the page.
+ */
+extern schemaResult_t *evalSchema(const schema_t *sp, memBuf_t *mp);
+extern const schemaValue_t *getSchemaValue(const schemaResult_t *rp, const char *field);
+extern void freeSchemaResult(schemaResult_t *rp);
+
+/*
+ * Table column mapping.  isSchemaTableHeader() returns 1 if row is the
+ * header row of the table, getSchemaColumn() returns the index of a
+ * column, or -1 if it isn't defined.
+ */
+extern int isSchemaTableHeader(const schema_t *sp, const char *table, char **row);
+extern int getSchemaColumn(const schema_t *sp, const char *table, const char *column);
+
+#endif /* SCHEMA_H_INCLUDED */
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2002, 2003, Scott Nicol <esniper@users.sf.net>
+ * All rights reserved
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "timer.h"
+#include "esniper.h"
+#include <errno.h>
+#include <string.h>
+#if defined(WIN32)
+#	include <windows.h>
+#else
+#	include <sys/time.h>
+#	include <unistd.h>
+#endif
+
+/* time spent spinning before the target, seconds */
+#define SPIN_TIME 0.002
+
+#if !defined(WIN32) && defined(CLOCK_MONOTONIC) && defined(TIMER_ABSTIME)
+#	define HAVE_CLOCK_NANOSLEEP 1
+#endif
+
+double
+getMonotonicTime(void)
+{
+#if defined(CLOCK_MONOTONIC) && !defined(WIN32)
+	struct timespec ts;
+
+	if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+		return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+	/* no monotonic clock, fall back to system time */
+	return getWallTime();
+}
+
+double
+getWallTime(void)
+{
+#if defined(WIN32)
+	FILETIME ft;
+	ULARGE_INTEGER t;
+
+	/* 100ns units since 1601 */
+	GetSystemTimeAsFileTime(&ft);
+	t.LowPart = ft.dwLowDateTime;
+	t.HighPart = ft.dwHighDateTime;
+	return (double)(t.QuadPart - 116444736000000000ULL) / 1e7;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+#endif
+}
+
+double
+wallToMonotonic(double wall)
+{
+	return getMonotonicTime() + (wall - getWallTime());
+}
+
+double
+fireAt(double target)
+{
+	double now = getMonotonicTime();
+
+	if (target - now > SPIN_TIME) {
+#if defined(HAVE_CLOCK_NANOSLEEP)
+		struct timespec ts;
+		double wake = target - SPIN_TIME;
+		int rc;
+
+		ts.tv_sec = (time_t)wake;
+		ts.tv_nsec = (long)((wake - (double)ts.tv_sec) * 1e9);
+		/* interrupted by a signal?  Just go back to sleep. */
+		while ((rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR)
+			;
+		if (rc) {
+			log(("fireAt(): clock_nanosleep: %s", strerror(rc)));
+		}
+#elif defined(WIN32)
+		Sleep((DWORD)((target - now - SPIN_TIME) * 1e3));
+#else
+		while ((now = getMonotonicTime()) < target - SPIN_TIME) {
+			double wait = target - SPIN_TIME - now;
+
+			if (wait >= 1)
+				sleep((unsigned int)wait);
+			else
+				usleep((useconds_t)(wait * 1e6));
+		}
+#endif
+	}
+	while ((now = getMonotonicTime()) < target)
+		;
+	return now;
+}
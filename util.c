@@ -28,6 +28,7 @@
 #include "esniper.h"
 #include "auction.h"
 #include "buffer.h"
+#include "parser.h"
 #include <ctype.h>
 #include <curl/curl.h>
 #include <errno.h>
@@ -155,62 +156,73 @@ logClose()
 	}
 }
 
-void
-logOpen(const auctionInfo *aip, const char *logdir)
+/*
+ * Path of file name in logdir, NULL for the current directory.  Returns
+ * malloc'ed string.
+ */
+char *
+logPath(const char *logdir, const char *name)
 {
-	char *logfilename;
-
-	if (aip == NULL)
-		logfilename = myStrdup2(getProgname(), ".log");
-	else
-		logfilename = myStrdup4(getProgname(), ".", aip->auction, ".log");
-	if (logdir) {
-		char *tmp = logfilename;
+	char *path;
 
+	if (!logdir)
+		return myStrdup(name);
 /* not win32 --> *nix */
 #if defined(WIN32)
-		logfilename = myStrdup3(logdir, "/", logfilename);
+	path = myStrdup3(logdir, "/", name);
 #else
-		/*
-		 * Usually the logdir on *nix looks something like this: ~/esniper/logs
-		 * we want it to look (typically) like this: /home/user/esniper/logs/
-		 * (depends on environment HOME variable).
-		 *
-		 * Need to distinguish between * ~/ (i.e. $HOME) and
-		 * ~foo/ (i.e. foo's home directory in /etc/passwd).
-		 */
-		if (logdir[0] == '~') {
-			if (logdir[1] == '\0') {
-				logfilename = myStrdup3(getenv("HOME"), "/", logfilename);
-			} else if (logdir[1] == '/') {
-				logfilename = myStrdup4(getenv("HOME"), logdir+1, "/", logfilename);
+	/*
+	 * Usually the logdir on *nix looks something like this: ~/esniper/logs
+	 * we want it to look (typically) like this: /home/user/esniper/logs/
+	 * (depends on environment HOME variable).
+	 *
+	 * Need to distinguish between * ~/ (i.e. $HOME) and
+	 * ~foo/ (i.e. foo's home directory in /etc/passwd).
+	 */
+	if (logdir[0] == '~') {
+		if (logdir[1] == '\0') {
+			path = myStrdup3(getenv("HOME"), "/", name);
+		} else if (logdir[1] == '/') {
+			path = myStrdup4(getenv("HOME"), logdir+1, "/", name);
+		} else {
+			const char *slash = strchr(logdir, '/');
+			struct passwd *pw;
+
+			if (slash) {
+				size_t namelen = (size_t)(slash - (logdir+1));
+				char *username = myMalloc(namelen + 1);
+
+				strncpy(username, logdir + 1, namelen);
+				username[namelen] = '\0';
+				pw = getpwnam(username);
+				free(username);
 			} else {
-				const char *slash = strchr(logdir, '/');
-				struct passwd *pw;
-
-				if (slash) {
-					size_t namelen = (size_t)(slash - (logdir+1));
-					char *username = myMalloc(namelen + 1);
-
-					strncpy(username, logdir + 1, namelen);
-					username[namelen] = '\0';
-					pw = getpwnam(username);
-					free(username);
-				} else {
-					slash = logdir + strlen(logdir);
-					pw = getpwnam(logdir + 1);
-				}
-
-				if (pw)
-					logfilename = myStrdup4(pw->pw_dir, slash, "/", logfilename);
-				else
-					logfilename = myStrdup3(logdir, "/", logfilename);
+				slash = logdir + strlen(logdir);
+				pw = getpwnam(logdir + 1);
 			}
-		} else
-			logfilename = myStrdup3(logdir, "/", logfilename);
+
+			if (pw)
+				path = myStrdup4(pw->pw_dir, slash, "/", name);
+			else
+				path = myStrdup3(logdir, "/", name);
+		}
+	} else
+		path = myStrdup3(logdir, "/", name);
 #endif
-		free(tmp);
-	}
+	return path;
+}
+
+void
+logOpen(const auctionInfo *aip, const char *logdir)
+{
+	char *logfilename, *tmp;
+
+	if (aip == NULL)
+		tmp = myStrdup2(getProgname(), ".log");
+	else
+		tmp = myStrdup4(getProgname(), ".", aip->auction, ".log");
+	logfilename = logPath(logdir, tmp);
+	free(tmp);
 	logClose();
 	if (!(logfile = fopen(logfilename, "a"))) {
 		/* non-fatal error! */
@@ -235,7 +247,8 @@ vlog(const char *fmt, va_list arglist)
 	char timebuf[80];	/* more than big enough */
 	time_t t;
 
-	if (!logfile)
+	/* the log file is switched by the main thread */
+	if (!logfile || isParserThread())
 		return;
 
 #if defined(WIN32)
@@ -354,7 +367,7 @@ bugReport(const char *func, const char *file, int line, auctionInfo *aip, memBuf
 	if (aip) {
 		printLog(stdout,
 			"\tauction = %s, price = %s, remain = %d\n"
-			"\tlatency = %d, result = %d, error = %d\n",
+			"\tlatency = %.3f, result = %d, error = %d\n",
 			nullStr(aip->auction), nullStr(aip->bidPriceStr),
 			aip->remain, aip->latency, aip->bidResult,
 			aip->auctionError);
@@ -757,6 +770,24 @@ freePassword(char *password)
 	free(password);
 }
 
+/*
+ * Exchange the password set with setPassword() and its pad with those
+ * of another account (see account.h).
+ */
+void
+swapPassword(char **password, char **pad, size_t *len)
+{
+	char *p = options.password, *q = passwordPad;
+	size_t l = passwordLen;
+
+	options.password = *password;
+	passwordPad = *pad;
+	passwordLen = *len;
+	*password = p;
+	*pad = q;
+	*len = l;
+}
+
 /*
  * Cygwin doesn't provide basename and dirname?
  *
@@ -43,6 +43,7 @@ extern char *myStrdup4(const char *, const char *, const char *, const char *);
 
 extern void logClose(void);
 extern void logOpen(const auctionInfo *aip, const char *logdir);
+extern char *logPath(const char *logdir, const char *name);
 extern void dlog(const char *fmt, ...);
 extern void printLog(FILE *fp, const char *fmt, ...);
 extern const char *checkVersion(void);
@@ -64,6 +65,7 @@ extern void setUsername(char *username);
 extern void setPassword(char *password);
 extern char *getPassword(void);
 extern void freePassword(char *password);
+extern void swapPassword(char **password, char **pad, size_t *len);
 
 #if defined(__CYGWIN__) || defined(WIN32)
 extern char *basename(char *);